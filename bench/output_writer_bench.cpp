@@ -0,0 +1,62 @@
+// Throughput of the assembly output: OutputWriter against the std::ostream formatting it replaced
+// (std::setw for the padding, std::to_string for the immediates, std::endl after every line).
+//
+// usage: output_writer_bench [output file, default output_writer_bench.out] [number of lines, default 4000000]
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "headers/output_writer.h"
+#include "headers/riscv/format_instr.h"
+
+static const char* OP_NAMES[] = {"addi", "lw", "sw", "add", "mul", "bnez", "j", "li"};
+static const char* REGS[] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6", "a0", "sp", "ra"};
+
+// an imm that is not always a single digit
+static int imm_of(size_t i) {
+    return int(i * 2654435761u % 4096) - 2048;
+}
+
+static void emit_ostream(std::ostream& out, size_t line_num) {
+    for (size_t i = 0; i < line_num; i++) {
+        out << "  " << std::left << std::setw(INSTR_WIDTH) << OP_NAMES[i % 8] << " " << REGS[i % 10]
+            << ", " << REGS[(i + 3) % 10] << ", " << std::to_string(imm_of(i)) << std::endl;
+    }
+}
+
+static void emit_writer(std::ostream& out, size_t line_num) {
+    OutputWriter writer(out);
+    for (size_t i = 0; i < line_num; i++) {
+        begin_instr(writer, OP_NAMES[i % 8]) << REGS[i % 10] << ", " << REGS[(i + 3) % 10] << ", "
+                                             << imm_of(i) << '\n';
+    }
+}
+
+template<typename Emit>
+static void run(const char* name, const char* path, size_t line_num, Emit emit) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::invalid_argument(std::string("output_writer_bench: cannot open ") + path);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    emit(out, line_num);
+    out.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double bytes = double(out.tellp());
+    std::cout << std::left << std::setw(10) << name << std::fixed << std::setprecision(1)
+              << bytes / seconds / (1 << 20) << " MiB/s  (" << bytes / (1 << 20) << " MiB in "
+              << std::setprecision(3) << seconds << " s)\n";
+}
+
+int main(int argc, const char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "output_writer_bench.out";
+    size_t line_num = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4000000;
+    run("ostream", path, line_num, emit_ostream);
+    run("writer", path, line_num, emit_writer);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef COMPILER_ARENA_H
+#define COMPILER_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// bytes requested from the heap at a time
+#define ARENA_CHUNK_SIZE    (1 << 16)
+
+
+/* A bump allocator for the many small objects that all die together: the AST nodes (ast_arena)
+ * and the instructions and basic blocks of the IR (ir_arena). Objects are carved out of chunks
+ * of ARENA_CHUNK_SIZE bytes and are never freed one by one; the pointers to them own nothing.
+ * release() destroys every object at once, the newest first, and frees the chunks, e.g.
+ *     Instruction* jump = ir_arena.make<Instruction>(OpType::JUMP, target);
+ * Objects with a trivial destructor are not even visited by release().
+ */
+class Arena {
+public:
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Arena::make: over-aligned type!");
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            auto cleanup = new (allocate(sizeof(Cleanup), alignof(Cleanup))) Cleanup;
+            cleanup->object = object;
+            cleanup->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+            cleanup->next = cleanups;
+            cleanups = cleanup;
+        }
+        return object;
+    }
+
+    void release() {
+        for (auto cleanup = cleanups; cleanup != nullptr; cleanup = cleanup->next) {
+            cleanup->destroy(cleanup->object);
+        }
+        cleanups = nullptr;
+        for (auto chunk : chunks) {
+            ::operator delete(chunk);
+        }
+        chunks.clear();
+        next_byte = 0;
+        chunk_end = 0;
+    }
+
+private:
+    // how to destroy an object, linked from the newest
+    class Cleanup {
+    public:
+        void* object;
+        void (*destroy)(void*);
+        Cleanup* next;
+    };
+    std::vector<void*> chunks;
+    uintptr_t next_byte = 0;
+    uintptr_t chunk_end = 0;
+    Cleanup* cleanups = nullptr;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t begin = (next_byte + align - 1) & ~uintptr_t(align - 1);
+        if (chunks.empty() || begin + size > chunk_end) {
+            // an object larger than a chunk gets a chunk of its own
+            size_t chunk_size = std::max(size, size_t(ARENA_CHUNK_SIZE));
+            chunks.push_back(::operator new(chunk_size));
+            begin = reinterpret_cast<uintptr_t>(chunks.back());
+            chunk_end = begin + chunk_size;
+        }
+        next_byte = begin + size;
+        return reinterpret_cast<void*>(begin);
+    }
+};
+
+#endif //COMPILER_ARENA_H
@@ -1,138 +1,176 @@
 #ifndef COMPILER_ARRAY_H
 #define COMPILER_ARRAY_H
 
-#include <variant>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "instruction.h"
 
+// an initializer is kept sparse while at most 1 / ARRAY_SPARSE_RATIO of its elements are nonzero
+#define ARRAY_SPARSE_RATIO  16
 
+
+/* The value of an array initializer, aligned with the shape of the array and kept flat in
+ * row-major order: either dense, or as a map from the indices of the nonzero elements.
+ *
+ * It is filled by walking the initializer as written: begin_list() / end_list() for the braces,
+ * append_int() for the values. A list inside a list takes the largest trailing dimensions that
+ * the current position is aligned to, e.g. for int[2][3][4]:
+ *     {1, 2, 3, 4, {5}}   ==>   {5} fills the [4] starting at index 4
+ *     {{1}, {2}}          ==>   {1} fills [0][0..11], {2} fills [1][0..11]
+ */
 class Array {
-    std::shared_ptr<Array> align_with_array_lens(std::vector<std::shared_ptr<Array> >& arrays,
-                                                 std::vector<size_t>& reversed_lens,
-                                                 std::vector<size_t>& reversed_pros) {
-        size_t buffer_size = reversed_lens.size() + 1;
-        auto buffer = std::vector<std::vector<std::shared_ptr<Array> > >(buffer_size);
-        std::fill(buffer.begin(), buffer.end(), std::vector<std::shared_ptr<Array> >());
-        size_t buffer_pos = 0;
-        for (auto& array_ptr: arrays) {
-            if (array_ptr->contained_val.index() != 2) {
-                // is not another array
-                buffer[0].push_back(array_ptr);
-                aggregate(buffer, reversed_lens);
-                buffer_pos++;
-            } else {
-                // is an array
-                // for example, if we have filled 12 elements for [2][3][4],
-                // then the reversed_array_size_to_fill will be {4, 3}, representing [3][4] to fill.
-                // and the reversed_pros_to_fill will be {4, 12}.
-                std::vector<size_t> reversed_array_size_to_fill;
-                std::vector<size_t> reversed_pros_to_fill;
-                std::optional<size_t> seek_fill_pos;
-                for (size_t i = 0; i < buffer_size; i++) {
-                    if (!buffer[i].empty()) {
-                        seek_fill_pos = i;
-                        break;
-                    }
-                }
-
-                if (seek_fill_pos.has_value()) {
-                    reversed_array_size_to_fill = std::vector<size_t>(reversed_lens.begin(), reversed_lens.begin() + seek_fill_pos.value());
-                    reversed_pros_to_fill = std::vector<size_t>(reversed_pros.begin(), reversed_pros.begin() + seek_fill_pos.value());
-                } else {
-                    // all empty, we have to fill, e.g., [3][4]
-                    reversed_array_size_to_fill = std::vector<size_t>(reversed_lens.begin(), reversed_lens.end() - 1);
-                    reversed_pros_to_fill = std::vector<size_t>(reversed_pros.begin(), reversed_pros.end() - 1);
-                }
-                buffer[reversed_array_size_to_fill.size()].push_back(align_with_array_lens(array_ptr->get_sub_arr(),
-                                                                                           reversed_array_size_to_fill,
-                                                                                           reversed_pros_to_fill));
-                aggregate(buffer, reversed_lens);
-                buffer_pos += reversed_pros_to_fill.back();
-            }
-        }
-        while (buffer_pos < reversed_pros.back()) {  // < the entire number of elements
-            buffer[0].push_back(std::make_shared<Array>(0));
-            aggregate(buffer, reversed_lens);
-            buffer_pos++;
+public:
+    std::vector<size_t> shape;  // e.g. int[2][3] has the shape {2, 3}
+    std::vector<int32_t> values;  // when dense
+    std::map<size_t, int32_t> sparse_values;  // when sparse: index -> value, nonzero values only
+    bool is_sparse = true;
+
+    Array(const OperandType& op_type): shape(op_type.get_array_dim(false)) {
+        elem_num = 1;
+        for (auto len : shape) {
+            elem_num *= len;
         }
-        return std::move(buffer.back().back());
     }
-    void aggregate(std::vector<std::vector<std::shared_ptr<Array> > >& buffer,
-                                     std::vector<size_t>& reversed_lens) {
-        for (size_t i = 0; i < reversed_lens.size(); i++) {
-            if (buffer[i].size() == reversed_lens[i]) {
-                auto new_array_ptr = std::make_shared<Array>(buffer[i]);
-                buffer[i] = std::vector<std::shared_ptr<Array> >();
-                buffer[i + 1].push_back(new_array_ptr);
-            }
+
+    size_t size() const {
+        return elem_num;
+    }
+
+    int32_t get(size_t index) const {
+        if (!is_sparse) {
+            return values[index];
         }
+        auto it = sparse_values.find(index);
+        return it == sparse_values.end() ? 0 : it->second;
     }
-public:
-    // std::string was originally for compatibility with ComputeConstVal.
-    // But now it seems that it can be removed.
-    std::variant<int, std::string, std::vector<std::shared_ptr<Array> > > contained_val;
 
-    Array(int _val): contained_val(_val) { }
-    Array(std::string _val): contained_val(_val) { }
-    Array(std::vector<std::shared_ptr<Array> > _val): contained_val(_val) { }
+    size_t nonzero_num() const {
+        if (is_sparse) {
+            return sparse_values.size();
+        }
+        return values.size() - std::count(values.begin(), values.end(), 0);
+    }
 
-    int get_int() const {
-        return std::get<int>(contained_val);
+    // whether the elements in [begin, end) are all 0
+    bool is_zero(size_t begin, size_t end) const {
+        if (is_sparse) {
+            auto it = sparse_values.lower_bound(begin);
+            return it == sparse_values.end() || it->first >= end;
+        }
+        for (size_t i = begin; i < end; i++) {
+            if (values[i] != 0) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    std::string get_str() const {
-        return std::get<std::string>(contained_val);
+    void begin_list() {
+        if (list_stack.empty()) {
+            list_stack.push_back({0, shape.size()});
+            return;
+        }
+        // the largest trailing dimensions (of the enclosing list) the position is aligned to,
+        // none for a braced scalar
+        size_t dim_num = 0;
+        for (size_t i = 1; i < list_stack.back().dim_num; i++) {
+            if ((pos - list_stack.back().begin) % get_extent(i) != 0) {
+                break;
+            }
+            dim_num = i;
+        }
+        list_stack.push_back({pos, dim_num});
     }
 
-    std::vector<std::shared_ptr<Array> >& get_sub_arr() {
-        return std::get<std::vector<std::shared_ptr<Array> > >(contained_val);
+    void end_list() {
+        pos = list_stack.back().begin + get_extent(list_stack.back().dim_num);
+        list_stack.pop_back();
     }
 
-    std::shared_ptr<Array> align_with_operand_type(const OperandType& op_type) {
-        std::vector<size_t> reversed_array_lens = op_type.get_array_dim();
-        if (contained_val.index() != 2 && reversed_array_lens.empty()) {
-            // is not an array
-            return std::shared_ptr<Array>(this);
+    void append_int(int32_t val) {
+        if (list_stack.empty() || pos >= list_stack.back().begin + get_extent(list_stack.back().dim_num)) {
+            throw std::invalid_argument("Array::append_int: too many values in the initializer!");
         }
-        std::vector<size_t> reversed_array_pros;  // pros: products
-        size_t pro = 1;
-        for (size_t i = 0; i < reversed_array_lens.size(); i++) {
-            pro *= reversed_array_lens[i];
-            reversed_array_pros.push_back(pro);
+        set(pos++, val);
+    }
+
+    // an initializer written without inner braces, e.g. that of a scalar
+    void assign(const std::vector<int32_t>& flat_values) {
+        begin_list();
+        for (auto val : flat_values) {
+            append_int(val);
         }
+        end_list();
+    }
 
-        return align_with_array_lens(get_sub_arr(),
-                              reversed_array_lens,
-                              reversed_array_pros);
+    // Koopa aggregate, e.g. {{1, 0}, zeroinit}
+    friend OutputWriter& operator<<(OutputWriter& out, const Array& a) {
+        a.print(out, 0, 0);
+        return out;
     }
 
-    friend std::ostream& operator<<(std::ostream& out, Array& a) {
-        switch(a.contained_val.index()) {
-            case 0: {
-                // int
-                out << a.get_int();
-                break;
-            }
-            case 1: {
-                // str
-                out << a.get_str();
-                break;
+private:
+    class List {
+    public:
+        size_t begin;
+        size_t dim_num;  // the number of trailing dimensions the list fills
+    };
+    size_t elem_num;
+    size_t pos = 0;
+    std::vector<List> list_stack;
+
+    // the number of elements in the last dim_num dimensions
+    size_t get_extent(size_t dim_num) const {
+        size_t extent = 1;
+        for (size_t i = shape.size() - dim_num; i < shape.size(); i++) {
+            extent *= shape[i];
+        }
+        return extent;
+    }
+
+    void set(size_t index, int32_t val) {
+        if (!is_sparse) {
+            values[index] = val;
+            return;
+        }
+        if (val == 0) {
+            sparse_values.erase(index);
+            return;
+        }
+        sparse_values[index] = val;
+        if (sparse_values.size() * ARRAY_SPARSE_RATIO > elem_num) {
+            values.assign(elem_num, 0);
+            for (auto& [i, v] : sparse_values) {
+                values[i] = v;
             }
-            case 2: {
-                // Array!
-                // Assume that this has already been aligned!
-                auto sub_arr = a.get_sub_arr();
-                out << "{" << *(sub_arr[0]);
-                for (size_t i = 1; i < sub_arr.size(); i++) {
-                    out << ", " << *(sub_arr[i]);
-                }
-                out << "}";
-                break;
+            sparse_values.clear();
+            is_sparse = false;
+        }
+    }
+
+    void print(OutputWriter& out, size_t dim, size_t begin) const {
+        if (dim == shape.size()) {
+            out << get(begin);
+            return;
+        }
+        size_t stride = get_extent(shape.size() - dim - 1);
+        if (is_zero(begin, begin + stride * shape[dim])) {
+            out << "zeroinit";
+            return;
+        }
+        out << "{";
+        for (size_t i = 0; i < shape[dim]; i++) {
+            if (i != 0) {
+                out << ", ";
             }
+            print(out, dim + 1, begin + i * stride);
         }
-        return out;
+        out << "}";
     }
 };
 
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <cstring>
+#include <functional>
 #include <sstream>
 #include <utility>
 #include <vector>
@@ -12,6 +13,14 @@
 #include "scope.h"
 #include "variable.h"
 #include "function.h"
+#include "program.h"
+#include "inliner.h"
+#include "mem2reg.h"
+#include "sccp.h"
+#include "dce.h"
+#include "gvn.h"
+#include "licm.h"
+#include "strength_reduction.h"
 
 #define WHILE_ENTRY_BASENAME        "%while_entry"
 #define WHILE_BODY_BASENAME         "%while_body"
@@ -23,6 +32,12 @@
 #define END_AND_BLOCK_BASENAME      "%end_and_block"
 
 
+/* Owns every AST node but the root and the list of items (which are on the heap, since they outlive
+ * the items in the streaming mode), and the strings of the tokens. Released as a whole once the IR
+ * is built: after the whole translation unit, or after each item in the streaming mode.
+ */
+inline Arena ast_arena;
+
 // 所有 AST 的基类
 class BaseAST {
 public:
@@ -45,7 +60,7 @@ public:
     virtual std::vector<Operand> DumpRParams() const {
         throw std::invalid_argument("Used BaseAST DumpRParams!");
     }
-    virtual std::vector<std::unique_ptr<BaseAST> >& GetVector() {
+    virtual std::vector<BaseAST*>& GetVector() {
         throw std::invalid_argument("Used BaseAST DumpRParams!");
     }
     virtual Operand ComputeInitVal() const {
@@ -54,54 +69,124 @@ public:
     virtual void DumpInstructions() const {
         throw std::invalid_argument("Used BaseAST DumpInstructions!");
     }
+    // collects and optimizes the whole translation unit, without printing it
+    virtual Program& DumpProgram() const {
+        throw std::invalid_argument("Used BaseAST DumpProgram!");
+    }
     virtual void DumpGlobalDecl(std::ostream& out) const {
         throw std::invalid_argument("Used BaseAST DumpGlobalDecl!");
     }
     virtual OperandType GetOperandType(std::ostream& out, std::string btype) const {
         throw std::invalid_argument("Used BaseAST GetOperandType!");
     }
-    virtual std::shared_ptr<Array> ComputeConstArrayVal(std::ostream& out) const {
+    // fills array with the value of an initializer list, see Array
+    virtual void ComputeConstArrayVal(Array& array, std::ostream& out) const {
         throw std::invalid_argument("Used BaseAST ComputeConstArrayVal!");
     }
     virtual bool isExpInsteadOfList() const {
         throw std::invalid_argument("Used BaseAST isExpInsteadOfList!");
     }
+    // Ends the current block by going to true_block_name when the expression is nonzero and to
+    // false_block_name otherwise. "&&" and "||" branch on their operands instead of computing a
+    // value, so that a condition needs no memory:
+    //     if (a && b)  ==>  br a, %and_true_block, %else_block
+    //                       %and_true_block: br b, %true_block, %else_block
+    virtual void DumpCondition(Symbol true_block_name, Symbol false_block_name) const {
+        Operand cond = DumpExp();
+        Instruction* instr;
+        if (ConstantFolder::is_int(cond)) {
+            Symbol target_name = ConstantFolder::is_int(cond, 0) ? false_block_name : true_block_name;
+            instr = ir_arena.make<Instruction>(OpType::JUMP,
+                                               Operand(target_name, OperandTypeEnum::BLOCK));
+        } else {
+            instr = ir_arena.make<Instruction>(OpType::BR,
+                                               cond,
+                                               Operand(true_block_name, OperandTypeEnum::BLOCK),
+                                               Operand(false_block_name, OperandTypeEnum::BLOCK));
+        }
+        scope.current_func_ptr->end_current_block_by_instr(instr, false);
+    }
     inline static int temp_var = 0;
     static Scope scope;
+    inline static Program program;
 };
 
 // CompUnit 是 BaseAST
 class CompUnitAST : public BaseAST {
 public:
-    // 用智能指针管理对象
+    // 用智能指针管理对象, 其余的 AST 结点都在 ast_arena 中
     std::unique_ptr<BaseAST> comp_unit_item_list_ast;
     void Dump(std::ostream& out) const override {
-        scope.DumpStdlibSignatures(out);
-        comp_unit_item_list_ast->Dump(out);
+        OutputWriter writer(out);
+        scope.DumpStdlibSignatures(writer);
+        writer << DumpProgram();
+    }
+    Program& DumpProgram() const override {
+        comp_unit_item_list_ast->Dump(std::cout);  // collects the items into program, prints nothing
+        Inliner(program, temp_var).run();
+        auto constant_globals = program.get_constant_globals();
+        for (auto func_ptr : program.get_functions()) {
+            Optimize(*func_ptr, constant_globals);
+        }
+        return program;
+    }
+
+    /* The program of a single item, for the streaming mode (see CompUnitItemListAST::stream_item),
+     * replacing that of the item before, which has been written out. No function is inlined since
+     * the callees are gone, and no global is constant since a later function may store to it.
+     */
+    static Program& DumpItem(const BaseAST& item) {
+        program.clear_items();
+        ir_arena.release();
+        item.Dump(std::cout);  // prints nothing
+        for (auto func_ptr : program.get_functions()) {
+            Optimize(*func_ptr, std::unordered_map<Symbol, int>());
+        }
+        return program;
+    }
+
+    static void Optimize(Function& func, const std::unordered_map<Symbol, int>& constant_globals) {
+        Mem2Reg(func, temp_var).run();
+        ConstantPropagation(func, constant_globals).run();
+        DeadCodeElimination(func).run();
+        GlobalValueNumbering(func).run();
+        LoopInvariantCodeMotion(func, temp_var).run();
+        StrengthReduction(func, temp_var).run();
+        DeadCodeElimination(func).run();  // what the loads and stores reused leave behind
     }
 };
 
 class CompUnitItemListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > comp_unit_item_list;
+    std::vector<BaseAST*> comp_unit_item_list;
+    // when set, each item is handed over as soon as it is parsed instead of being kept in the list
+    inline static std::function<void(BaseAST*)> stream_item;
+    void append(BaseAST* item) {
+        if (stream_item) {
+            stream_item(item);
+            // An item ends with ';' or '}', upon which Bison reduces without reading ahead,
+            // so the arena holds nothing of the next item yet.
+            ast_arena.release();
+        } else {
+            comp_unit_item_list.push_back(item);
+        }
+    }
     void Dump(std::ostream& out) const override {
-        for (auto& item : comp_unit_item_list) {
+        for (auto item : comp_unit_item_list) {
             item->Dump(out);
-            out << std::endl;
         }
     }
 };
 
 class CompUnitItemAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> func_def;
-    std::unique_ptr<BaseAST> decl;
+    BaseAST* func_def = nullptr;
+    BaseAST* decl = nullptr;
     void Dump(std::ostream& out) const override {
         if (decl != nullptr) {
-            decl->DumpGlobalDecl(out);
+            decl->DumpGlobalDecl(out);  // appends the declarations to program
         } else if (func_def != nullptr) {
             func_def->Dump(out);
-            out << std::endl;
         } else {
             throw std::invalid_argument("Both decl and func_def are nullptr(s)!");
         }
@@ -110,8 +195,8 @@ public:
 
 class DeclAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> const_decl;
-    std::unique_ptr<BaseAST> var_decl;
+    BaseAST* const_decl = nullptr;
+    BaseAST* var_decl = nullptr;
     void Dump(std::ostream& out) const override {
         if (const_decl != nullptr) {
             // For now, because the Decl only declares a value that can be directly computed,
@@ -129,7 +214,6 @@ public:
             const_decl->DumpGlobalDecl(out);
         } else if (var_decl != nullptr) {
             var_decl->DumpGlobalDecl(out);
-            out << std::endl;
         } else {
             throw std::invalid_argument("DeclAST::DumpGlobalDecl: both members are nullptr!");
         }
@@ -140,7 +224,7 @@ class ConstDeclAST : public BaseAST {
 public:
     std::string btype;
     // _ast to be distinguished from the vector in const_def_list
-    std::unique_ptr<BaseAST> const_def_list_ast;
+    BaseAST* const_def_list_ast = nullptr;
     void Dump(std::ostream& out) const override {
         const_def_list_ast->InsertSymbol(btype, out, false);
     }
@@ -151,17 +235,17 @@ public:
 
 class ConstDefAST : public BaseAST {
 public:
-    std::string ident;
-    std::unique_ptr<BaseAST> array_dim_list_ast;
-    std::unique_ptr<BaseAST> const_init_val;
+    Symbol ident;
+    BaseAST* array_dim_list_ast = nullptr;
+    BaseAST* const_init_val = nullptr;
     void InsertSymbol(std::string btype, std::ostream& out, bool is_global) const override {
         if (array_dim_list_ast == nullptr) {
             // ConstDefAST ::= IDENT '=' ConstInitVal
             std::string computed_val = const_init_val->ComputeConstVal(out);
             std::optional<int> const_init_val_int(std::stoi(computed_val));
-            std::string koopa_var_name;
+            Symbol koopa_var_name;
             if (is_global) {
-                koopa_var_name = "@" + ident;  // Assume that a global name will not repeat itself
+                koopa_var_name = scope.get_global_koopa_var_name(ident);
             } else {
                 koopa_var_name = scope.current_func_ptr->get_koopa_var_name(ident);
             }
@@ -175,15 +259,15 @@ public:
             scope.insert_var(ident, new_var);
         } else {
             // ConstDefAST ::= IDENT ArrayDimList '=' ConstInitVal;
-            std::string koopa_var_name;
+            Symbol koopa_var_name;
             if (is_global) {
-                koopa_var_name = "@" + ident;
+                koopa_var_name = scope.get_global_koopa_var_name(ident);
             } else {
-                koopa_var_name = "@" + scope.current_func_ptr->get_koopa_var_name(ident);
+                koopa_var_name = scope.current_func_ptr->get_koopa_var_name(ident).prefixed("@");
             }
             OperandType op_type = array_dim_list_ast->GetOperandType(out, btype);
-            std::shared_ptr<Array> array_ptr = const_init_val->ComputeConstArrayVal(out);
-            array_ptr = array_ptr->align_with_operand_type(op_type);
+            auto array_ptr = std::make_shared<Array>(op_type);
+            const_init_val->ComputeConstArrayVal(*array_ptr, out);
 
             auto new_var = Variable(op_type,
                                     true,
@@ -194,15 +278,9 @@ public:
 
             Operand alloc_op = Operand(koopa_var_name, op_type, true);
             if (is_global) {
-                out << "global " << koopa_var_name << " = alloc " << to_string(op_type) << ", ";
-                std::shared_ptr<Array> array_ptr = const_init_val->ComputeConstArrayVal(out);
-                array_ptr = array_ptr->align_with_operand_type(op_type);
-                out << *array_ptr;
-                out << std::endl;
+                program.append_global_decl(GlobalDecl(koopa_var_name, op_type, array_ptr));
             } else {
                 scope.current_func_ptr->append_alloc_to_entry_block(alloc_op);
-                std::shared_ptr<Array> array_ptr = const_init_val->ComputeConstArrayVal(out);
-                array_ptr = array_ptr->align_with_operand_type(op_type);
                 scope.current_func_ptr->append_init_array(koopa_var_name,
                                                           op_type,
                                                           array_ptr,
@@ -214,7 +292,7 @@ public:
 
 class ArrayDimListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > array_dim_list;
+    std::vector<BaseAST*> array_dim_list;
     OperandType GetOperandType(std::ostream& out, std::string btype) const override {
         if (btype == "int") {
             OperandType base_type {OperandTypeEnum::INT};
@@ -234,7 +312,7 @@ public:
 
 class ConstDefListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > const_def_list;
+    std::vector<BaseAST*> const_def_list;
     void InsertSymbol(std::string btype, std::ostream& out, bool is_global) const override {
         for (auto it = const_def_list.begin();
              it != const_def_list.end();
@@ -246,17 +324,17 @@ public:
 
 class ConstInitValAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> const_exp;
-    std::unique_ptr<BaseAST> const_init_val_list_ast;
+    BaseAST* const_exp = nullptr;
+    BaseAST* const_init_val_list_ast = nullptr;
     std::string ComputeConstVal(std::ostream& out) const override {
         return const_exp->ComputeConstVal(out);
     }
-    std::shared_ptr<Array> ComputeConstArrayVal(std::ostream& out) const override {
+    void ComputeConstArrayVal(Array& array, std::ostream& out) const override {
+        array.begin_list();
         if (const_init_val_list_ast != nullptr) {
-            return const_init_val_list_ast->ComputeConstArrayVal(out);
-        } else {
-            return std::make_shared<Array>(std::vector<std::shared_ptr<Array> >());
+            const_init_val_list_ast->ComputeConstArrayVal(array, out);
         }
+        array.end_list();
     }
     bool isExpInsteadOfList() const override {
         return const_exp != nullptr;
@@ -265,26 +343,23 @@ public:
 
 class ConstInitValListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > const_init_val_list;
-    std::shared_ptr<Array> ComputeConstArrayVal(std::ostream& out) const override {
-        std::vector<std::shared_ptr<Array> > res_vec;
+    std::vector<BaseAST*> const_init_val_list;
+    void ComputeConstArrayVal(Array& array, std::ostream& out) const override {
         for (auto& ptr: const_init_val_list) {
             // each of them is a ConstInitValAST
             if (ptr->isExpInsteadOfList()) {
-                int val = std::stoi(ptr->ComputeConstVal(out));
-                res_vec.push_back(std::make_shared<Array>(val));
+                array.append_int(std::stoi(ptr->ComputeConstVal(out)));
             } else {
-                res_vec.push_back(ptr->ComputeConstArrayVal(out));
+                ptr->ComputeConstArrayVal(array, out);
             }
         }
-        return std::make_shared<Array>(res_vec);
     }
 };
 
 class VarDeclAST : public BaseAST {
 public:
     std::string btype;
-    std::unique_ptr<BaseAST> var_def_list_ast;
+    BaseAST* var_def_list_ast = nullptr;
     void Dump(std::ostream& out) const override {
         var_def_list_ast->InsertSymbol(btype, out, false);
     }
@@ -295,7 +370,7 @@ public:
 
 class VarDefListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > var_def_list;
+    std::vector<BaseAST*> var_def_list;
     void InsertSymbol(std::string btype, std::ostream& out, bool is_global = false) const override {
         for (auto it = var_def_list.begin();
              it != var_def_list.end();
@@ -307,17 +382,17 @@ public:
 
 class VarDefAST : public BaseAST {
 public:
-    std::string ident;
-    std::unique_ptr<BaseAST> array_dim_list_ast;
-    std::unique_ptr<BaseAST> init_val;
+    Symbol ident;
+    BaseAST* array_dim_list_ast = nullptr;
+    BaseAST* init_val = nullptr;
     void InsertSymbol(std::string btype, std::ostream& out, bool is_global) const override {
         // e.g. @x = alloc i32
 
-        std::string koopa_var_name;
+        Symbol koopa_var_name;
         if (is_global) {
-            koopa_var_name = "@" + ident;  // Assume that a global var name will not repeat itself.
+            koopa_var_name = scope.get_global_koopa_var_name(ident);
         } else {
-            koopa_var_name = "@" + scope.current_func_ptr->get_koopa_var_name(ident);
+            koopa_var_name = scope.current_func_ptr->get_koopa_var_name(ident).prefixed("@");
         }
 
         OperandType op_type;
@@ -327,9 +402,7 @@ public:
             op_type = OperandTypeEnum::INT;
         }
         Operand alloc_op = Operand(koopa_var_name, op_type, true);
-        if (is_global) {
-            out << "global " << koopa_var_name << " = alloc " << to_string(op_type) << ", ";
-        } else {
+        if (!is_global) {
             scope.current_func_ptr->append_alloc_to_entry_block(alloc_op);
         }
 
@@ -337,32 +410,33 @@ public:
         scope.insert_var(ident, new_var);
 
         if (is_global) {
+            std::shared_ptr<Array> init;  // zeroinit without an initializer
             if (init_val != nullptr) {
+                init = std::make_shared<Array>(op_type);
                 if (init_val->isExpInsteadOfList()) {
-                    std::string init_val_str = init_val->ComputeConstVal(out);
-                    out << init_val_str;
+                    int init_val_int = std::stoi(init_val->ComputeConstVal(out));
+                    init->assign({init_val_int});
+                    program.scalar_global_inits[koopa_var_name] = init_val_int;
                 } else {
-                    std::shared_ptr<Array> array_ptr = init_val->ComputeConstArrayVal(out);
-                    array_ptr = array_ptr->align_with_operand_type(op_type);
-                    out << *array_ptr;
+                    init_val->ComputeConstArrayVal(*init, out);
                 }
-            } else {
-                out << "zeroinit";
+            } else if (op_type.type_enum == OperandTypeEnum::INT) {
+                program.scalar_global_inits[koopa_var_name] = 0;
             }
-            out << std::endl;
+            program.append_global_decl(GlobalDecl(koopa_var_name, op_type, init));
         } else {
             // e.g. store 10, @x
             if (init_val != nullptr) {
                 if (init_val->isExpInsteadOfList()) {
                     Operand computed_init_val = init_val->ComputeInitVal();
                     Operand store_koopa_var = Operand(koopa_var_name, OperandTypeEnum::INT, true);
-                    auto instr = std::make_unique<Instruction>(OpType::STORE,
-                                                               computed_init_val,
-                                                               store_koopa_var);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+                    auto instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                            computed_init_val,
+                                                            store_koopa_var);
+                    scope.current_func_ptr->append_instr_to_current_block(instr);
                 } else {
-                    std::shared_ptr<Array> array_ptr = init_val->ComputeConstArrayVal(out);
-                    array_ptr = array_ptr->align_with_operand_type(op_type);
+                    auto array_ptr = std::make_shared<Array>(op_type);
+                    init_val->ComputeConstArrayVal(*array_ptr, out);
                     scope.current_func_ptr->append_init_array(koopa_var_name,
                                                               op_type,
                                                               array_ptr,
@@ -375,8 +449,8 @@ public:
 
 class InitValAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> exp;
-    std::unique_ptr<BaseAST> init_val_list_ast;
+    BaseAST* exp = nullptr;
+    BaseAST* init_val_list_ast = nullptr;
     Operand ComputeInitVal() const override {
         return exp->DumpExp();
     }
@@ -384,13 +458,13 @@ public:
         // Only use for global decl
         return exp->ComputeConstVal(out);
     }
-    std::shared_ptr<Array> ComputeConstArrayVal(std::ostream& out) const override {
+    void ComputeConstArrayVal(Array& array, std::ostream& out) const override {
         // Assume that when initializing an array, all the values are const (can be computed at compiler time)
+        array.begin_list();
         if (init_val_list_ast != nullptr) {
-            return init_val_list_ast->ComputeConstArrayVal(out);
-        } else {
-            return std::make_shared<Array>(std::vector<std::shared_ptr<Array> >());
+            init_val_list_ast->ComputeConstArrayVal(array, out);
         }
+        array.end_list();
     }
     bool isExpInsteadOfList() const override {
         return exp != nullptr;
@@ -399,25 +473,22 @@ public:
 
 class InitValListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > init_val_list;
-    std::shared_ptr<Array> ComputeConstArrayVal(std::ostream& out) const override {
-        std::vector<std::shared_ptr<Array> > res_vec;
+    std::vector<BaseAST*> init_val_list;
+    void ComputeConstArrayVal(Array& array, std::ostream& out) const override {
         for (auto& ptr: init_val_list) {
             // each of them is a InitValAST
             if (ptr->isExpInsteadOfList()) {
-                int val = std::stoi(ptr->ComputeConstVal(out));
-                res_vec.push_back(std::make_shared<Array>(val));
+                array.append_int(std::stoi(ptr->ComputeConstVal(out)));
             } else {
-                res_vec.push_back(ptr->ComputeConstArrayVal(out));
+                ptr->ComputeConstArrayVal(array, out);
             }
         }
-        return std::make_shared<Array>(res_vec);
     }
 };
 
 class ConstExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> exp;
+    BaseAST* exp = nullptr;
     std::string ComputeConstVal(std::ostream& out) const override {
         return exp->ComputeConstVal(out);
     }
@@ -425,77 +496,54 @@ public:
 
 class FuncDefAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> func_type;
-    std::string ident;
-    std::unique_ptr<BaseAST> func_f_param_list_ast;
-    std::unique_ptr<BaseAST> block;
+    BaseAST* func_type = nullptr;
+    Symbol ident;
+    BaseAST* func_f_param_list_ast = nullptr;
+    BaseAST* block = nullptr;
     void Dump(std::ostream& out) const override {
         FuncType type = func_type->GetFuncTypeEnum();
         scope.enter_func(type, ident);
         func_f_param_list_ast->DumpInstructions();
-        const Signature current_sign = scope.register_signature(scope.current_func_ptr);
+        const Signature current_sign = scope.register_signature(ident, scope.current_func_ptr);
         scope.alloc_and_store_for_params(scope.current_func_ptr);
         block->Dump(out);  // Will structurize the function, without output yet
-        std::string end_block_name = scope.current_func_ptr->end_block_ptr->basic_block_name;
+        Symbol end_block_name = scope.current_func_ptr->end_block_ptr->basic_block_name;
         Operand end_block_op = Operand(end_block_name, OperandTypeEnum::BLOCK);
-        auto jump_ret_instr = std::make_unique<Instruction>(OpType::JUMP,
-                                                            end_block_op);
-        scope.current_func_ptr->end_current_block_by_instr(std::move(jump_ret_instr),
+        auto jump_ret_instr = ir_arena.make<Instruction>(OpType::JUMP,
+                                                         end_block_op);
+        scope.current_func_ptr->end_current_block_by_instr(jump_ret_instr,
                                                            false);
         // add jump to the entry block
-        std::string first_block_name = scope.current_func_ptr->basic_block_ptrs[0]->basic_block_name;
+        Symbol first_block_name = scope.current_func_ptr->basic_block_ptrs[0]->basic_block_name;
         Operand first_block_op = Operand(first_block_name, OperandTypeEnum::BLOCK);
-        auto entry_jump_instr = std::make_unique<Instruction>(OpType::JUMP,
-                                                              first_block_op);
-        scope.current_func_ptr->entry_block_ptr->ending_instruction = std::move(entry_jump_instr);
+        auto entry_jump_instr = ir_arena.make<Instruction>(OpType::JUMP,
+                                                           first_block_op);
+        scope.current_func_ptr->entry_block_ptr->ending_instruction = entry_jump_instr;
         // and ret instructions for the end block
         if (type == FuncType::INT) {
-            std::string temp_var_str = "%" + std::to_string(temp_var++);
+            Symbol temp_var_str = Symbol::temp(temp_var++);
             Operand temp_var_op = Operand(temp_var_str);
             if (!scope.current_func_ptr->ret_var_op.has_value()) {
                 throw std::invalid_argument("Return type is INT but the ret_var_op does not hold a value!");
             }
-            auto load_instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                            temp_var_op,
-                                                            scope.current_func_ptr->ret_var_op.value());
-            scope.current_func_ptr->end_block_ptr->instruction_lists.push_back(std::move(load_instr));
-
-            auto ret_instr = std::make_unique<Instruction>(OpType::RET,
-                                                           temp_var_op);
-            scope.current_func_ptr->end_block_ptr->ending_instruction = std::move(ret_instr);
+            auto load_instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                         temp_var_op,
+                                                         scope.current_func_ptr->ret_var_op.value());
+            scope.current_func_ptr->end_block_ptr->instruction_lists.push_back(load_instr);
+
+            auto ret_instr = ir_arena.make<Instruction>(OpType::RET,
+                                                        temp_var_op);
+            scope.current_func_ptr->end_block_ptr->ending_instruction = ret_instr;
         } else {
-            auto ret_instr = std::make_unique<Instruction>(OpType::RET);
-            scope.current_func_ptr->end_block_ptr->ending_instruction = std::move(ret_instr);
-        }
-
-        // Output
-
-        out << "fun";
-        out << " ";
-        out << "@" << ident;
-
-        out << "(";
-        if (!scope.current_func_ptr->param_list.empty()) {
-            auto& list = scope.current_func_ptr->param_list;
-            out << list[0];
-            for (auto i = 1; i < list.size(); i++) {
-                out << ", " << list[i];
-            }
+            auto ret_instr = ir_arena.make<Instruction>(OpType::RET);
+            scope.current_func_ptr->end_block_ptr->ending_instruction = ret_instr;
         }
-        out << ")";
-        if (type == FuncType::INT) {
-            out << ": ";
-            func_type->Dump(out);
-        }
-        out << " {" << std::endl;
 
-        out << *scope.current_func_ptr->entry_block_ptr << std::endl;
-        for (auto& block_ptr : scope.current_func_ptr->basic_block_ptrs) {
-            out << *block_ptr << std::endl;
+        for (auto& decl : scope.current_func_ptr->init_template_decls) {
+            program.append_global_decl(decl);
         }
-        out << *scope.current_func_ptr->end_block_ptr;
-
-        out << "}";
+        // Kept until the whole translation unit is parsed, so that it can be inlined into its callers
+        program.append_function(std::move(scope.current_func_ptr));
 
         scope.exit_func();
     }
@@ -503,7 +551,7 @@ public:
 
 class FuncFParamListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > func_f_param_list;
+    std::vector<BaseAST*> func_f_param_list;
     void DumpInstructions() const override {
         for (auto& param : func_f_param_list) {
             param->DumpInstructions();
@@ -514,11 +562,11 @@ public:
 class FuncFParamAST : public BaseAST {
 public:
     std::string btype;
-    std::string ident;
+    Symbol ident;
     bool is_pointer;
-    std::unique_ptr<BaseAST> array_dim_list_ast;
+    BaseAST* array_dim_list_ast = nullptr;
     void DumpInstructions() const override {
-        std::string temp_var_name = "%" + std::to_string(temp_var++);
+        Symbol temp_var_name = Symbol::temp(temp_var++);
         OperandType op_type;
         if (!is_pointer) {
             // INT IDENT
@@ -562,7 +610,7 @@ public:
 
 class BlockItemListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > block_item_list;
+    std::vector<BaseAST*> block_item_list;
     void Dump(std::ostream& out) const override {
         for (auto it = block_item_list.begin();
              it != block_item_list.end();
@@ -574,8 +622,8 @@ public:
 
 class BlockItemAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> decl;
-    std::unique_ptr<BaseAST> stmt;
+    BaseAST* decl = nullptr;
+    BaseAST* stmt = nullptr;
     void Dump(std::ostream& out) const override {
         if (decl != nullptr) {
             // BlockItem ::= Decl
@@ -591,7 +639,7 @@ public:
 
 class BlockAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> block_item_list;
+    BaseAST* block_item_list = nullptr;
     void Dump(std::ostream& out = std::cout) const override {
         block_item_list->Dump(out);
     }
@@ -610,13 +658,13 @@ enum class StmtType {
 
 class StmtAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> exp;
-    std::unique_ptr<BaseAST> l_val;
-    std::unique_ptr<BaseAST> block;
+    BaseAST* exp = nullptr;
+    BaseAST* l_val = nullptr;
+    BaseAST* block = nullptr;
     StmtType type;
-    std::unique_ptr<BaseAST> true_stmt;
-    std::unique_ptr<BaseAST> else_stmt;
-    std::unique_ptr<BaseAST> body_stmt;
+    BaseAST* true_stmt = nullptr;
+    BaseAST* else_stmt = nullptr;
+    BaseAST* body_stmt = nullptr;
     void DumpInstructions() const override {
         if (type == StmtType::ASSIGN) {
             // Stmt ::= LVal '=' Exp ';'
@@ -626,10 +674,10 @@ public:
             // store
             // Find the koopa var name according to l_val
             Operand l_val_op = l_val->DumpExp();
-            auto instr = std::make_unique<Instruction>(OpType::STORE,
-                                                       temp_var_op,
-                                                       l_val_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+            auto instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                    temp_var_op,
+                                                    l_val_op);
+            scope.current_func_ptr->append_instr_to_current_block(instr);
         } else if (type == StmtType::EXP) {
             // Stmt ::= [Exp] ";"
             if (exp != nullptr) {
@@ -641,84 +689,63 @@ public:
             block->Dump();
             scope.pop_scope();
         } else if (type == StmtType::IF) {
-            Operand temp_var_op = exp->DumpExp();
-            std::string true_block_name = scope.current_func_ptr->get_koopa_var_name("%true_block");
-            Operand true_block_op = Operand(true_block_name, OperandTypeEnum::BLOCK);
-            std::string end_if_block_name = scope.current_func_ptr->get_koopa_var_name("%end_if");
+            Symbol true_block_name = scope.current_func_ptr->get_koopa_var_name("%true_block");
+            Symbol end_if_block_name = scope.current_func_ptr->get_koopa_var_name("%end_if");
             Operand end_if_block_op = Operand(end_if_block_name, OperandTypeEnum::BLOCK);
 
             if (else_stmt != nullptr) {
                 // Stmt ::= "if" "(" Exp ")" Stmt "else" Stmt
-                std::string else_block_name = scope.current_func_ptr->get_koopa_var_name("%else_block");
-                Operand else_block_op = Operand(else_block_name, OperandTypeEnum::BLOCK);
-
-                auto br_instr = std::make_unique<Instruction>(OpType::BR,
-                                                           temp_var_op,
-                                                           true_block_op,
-                                                           else_block_op);
-                scope.current_func_ptr->end_current_block_by_instr(std::move(br_instr),
-                                                                   true,
-                                                                   true_block_name);
+                Symbol else_block_name = scope.current_func_ptr->get_koopa_var_name("%else_block");
+
+                exp->DumpCondition(true_block_name, else_block_name);
+                scope.current_func_ptr->new_basic_block(true_block_name);
 
                 scope.push_scope();
                 true_stmt->DumpInstructions();
                 scope.pop_scope();
-                auto jump_instr = std::make_unique<Instruction>(OpType::JUMP,
+                auto jump_instr = ir_arena.make<Instruction>(OpType::JUMP,
                                                            end_if_block_op);
-                scope.current_func_ptr->end_current_block_by_instr(std::move(jump_instr),
+                scope.current_func_ptr->end_current_block_by_instr(jump_instr,
                                                                    true,
                                                                    else_block_name);
 
                 scope.push_scope();
                 else_stmt->DumpInstructions();
                 scope.pop_scope();
-                auto jump_to_end_if_instr = std::make_unique<Instruction>(OpType::JUMP,
+                auto jump_to_end_if_instr = ir_arena.make<Instruction>(OpType::JUMP,
                                                            end_if_block_op);
-                scope.current_func_ptr->end_current_block_by_instr(std::move(jump_to_end_if_instr),
+                scope.current_func_ptr->end_current_block_by_instr(jump_to_end_if_instr,
                                                                    true,
                                                                    end_if_block_name);
             } else {
                 // Stmt ::= "if" "(" Exp ")" Stmt
-                auto br_instr = std::make_unique<Instruction>(OpType::BR,
-                                                           temp_var_op,
-                                                           true_block_op,
-                                                           end_if_block_op);
-                scope.current_func_ptr->end_current_block_by_instr(std::move(br_instr),
-                                                                   true,
-                                                                   true_block_name);
+                exp->DumpCondition(true_block_name, end_if_block_name);
+                scope.current_func_ptr->new_basic_block(true_block_name);
 
                 scope.push_scope();
                 true_stmt->DumpInstructions();
                 scope.pop_scope();
-                auto jump_instr = std::make_unique<Instruction>(OpType::JUMP,
+                auto jump_instr = ir_arena.make<Instruction>(OpType::JUMP,
                                                            end_if_block_op);
-                scope.current_func_ptr->end_current_block_by_instr(std::move(jump_instr),
+                scope.current_func_ptr->end_current_block_by_instr(jump_instr,
                                                                    true,
                                                                    end_if_block_name);
             }
         } else if (type == StmtType::WHILE) {
             // Stmt ::= "while" "(" Exp ")" Stmt
-            std::string while_entry_name = scope.current_func_ptr->get_koopa_var_name(WHILE_ENTRY_BASENAME);
-            std::string while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
-            std::string after_while_name = scope.current_func_ptr->get_koopa_var_name(END_WHILE_BASENAME);
+            Symbol while_entry_name = scope.current_func_ptr->get_koopa_var_name(WHILE_ENTRY_BASENAME);
+            Symbol while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
+            Symbol after_while_name = scope.current_func_ptr->get_koopa_var_name(END_WHILE_BASENAME);
 
             Operand while_entry_op = Operand(while_entry_name, OperandTypeEnum::BLOCK);
-            Operand while_body_op = Operand(while_body_name, OperandTypeEnum::BLOCK);
-            Operand after_while_op = Operand(after_while_name, OperandTypeEnum::BLOCK);
-            auto jump_to_entry_instr = std::make_unique<Instruction>(OpType::JUMP,
+            auto jump_to_entry_instr = ir_arena.make<Instruction>(OpType::JUMP,
                                                             while_entry_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_to_entry_instr),
+            scope.current_func_ptr->end_current_block_by_instr(jump_to_entry_instr,
                                                                true,
                                                                while_entry_name);
 
-            Operand exp_res_op = exp->DumpExp();
-            auto br_instr = std::make_unique<Instruction>(OpType::BR,
-                                                          exp_res_op,
-                                                          while_body_op,
-                                                          after_while_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(br_instr),
-                                                               true,
-                                                               while_body_name);
+            exp->DumpCondition(while_body_name, after_while_name);
+            scope.current_func_ptr->new_basic_block(while_body_name);
 
             auto loop_info = std::make_pair(while_entry_name, after_while_name);
             scope.push_scope();
@@ -727,29 +754,29 @@ public:
             scope.current_func_ptr->exit_loop();
             scope.pop_scope();
 
-            auto jump_to_entry_instr_copy = std::make_unique<Instruction>(OpType::JUMP,
+            auto jump_to_entry_instr_copy = ir_arena.make<Instruction>(OpType::JUMP,
                                                             while_entry_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_to_entry_instr_copy),
+            scope.current_func_ptr->end_current_block_by_instr(jump_to_entry_instr_copy,
                                                                true,
                                                                after_while_name);
         } else if (type == StmtType::BREAK) {
             // jump end_while
-            std::string end_while_name_of_this_loop = scope.current_func_ptr->get_current_loop_info().second;
+            Symbol end_while_name_of_this_loop = scope.current_func_ptr->get_current_loop_info().second;
             Operand end_while_op = Operand(end_while_name_of_this_loop, OperandTypeEnum::BLOCK);
-            auto jump_instr = std::make_unique<Instruction>(OpType::JUMP,
-                                                            end_while_op);
-            std::string new_while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_instr),
+            auto jump_instr = ir_arena.make<Instruction>(OpType::JUMP,
+                                                         end_while_op);
+            Symbol new_while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
+            scope.current_func_ptr->end_current_block_by_instr(jump_instr,
                                                                true,
                                                                new_while_body_name);
         } else if (type == StmtType::CONTINUE) {
             // jump while_entry
-            std::string while_entry_name_of_this_loop = scope.current_func_ptr->get_current_loop_info().first;
+            Symbol while_entry_name_of_this_loop = scope.current_func_ptr->get_current_loop_info().first;
             Operand while_entry_op = Operand(while_entry_name_of_this_loop, OperandTypeEnum::BLOCK);
-            auto jump_instr = std::make_unique<Instruction>(OpType::JUMP,
-                                                            while_entry_op);
-            std::string new_while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_instr),
+            auto jump_instr = ir_arena.make<Instruction>(OpType::JUMP,
+                                                         while_entry_op);
+            Symbol new_while_body_name = scope.current_func_ptr->get_koopa_var_name(WHILE_BODY_BASENAME);
+            scope.current_func_ptr->end_current_block_by_instr(jump_instr,
                                                                true,
                                                                new_while_body_name);
         } else if (type == StmtType::RET_EXP) {
@@ -759,17 +786,17 @@ public:
             if (exp != nullptr) {
                 exp_res = exp->DumpExp();
                 ret_reg = scope.current_func_ptr->ret_var_op.value();
-                auto store_ins = std::make_unique<Instruction>(OpType::STORE,
-                                                               exp_res,
-                                                               ret_reg);
-                scope.current_func_ptr->append_instr_to_current_block(std::move(store_ins));
+                auto store_ins = ir_arena.make<Instruction>(OpType::STORE,
+                                                            exp_res,
+                                                            ret_reg);
+                scope.current_func_ptr->append_instr_to_current_block(store_ins);
             }
-            std::string end_block_name = scope.current_func_ptr->end_block_ptr->basic_block_name;
+            Symbol end_block_name = scope.current_func_ptr->end_block_ptr->basic_block_name;
             Operand end_block_op = Operand(end_block_name, OperandTypeEnum::BLOCK);
-            auto jump_ins = std::make_unique<Instruction>(OpType::JUMP,
-                                                          end_block_op);
-            std::string temp_block_name = scope.current_func_ptr->get_koopa_var_name("%after_ret");
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_ins),
+            auto jump_ins = ir_arena.make<Instruction>(OpType::JUMP,
+                                                       end_block_op);
+            Symbol temp_block_name = scope.current_func_ptr->get_koopa_var_name("%after_ret");
+            scope.current_func_ptr->end_current_block_by_instr(jump_ins,
                                                                true,
                                                                temp_block_name);
         } else {
@@ -780,11 +807,14 @@ public:
 
 class ExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> l_or_exp;
+    BaseAST* l_or_exp = nullptr;
     Operand DumpExp() const override {
         Operand temp_var_op = l_or_exp->DumpExp();
         return temp_var_op;
     }
+    void DumpCondition(Symbol true_block_name, Symbol false_block_name) const override {
+        l_or_exp->DumpCondition(true_block_name, false_block_name);
+    }
     std::string ComputeConstVal(std::ostream& out) const override {
         return l_or_exp->ComputeConstVal(out);
     }
@@ -800,11 +830,11 @@ typedef uint32_t unary_op_t;
 
 class UnaryExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> primary_exp;
-    std::unique_ptr<BaseAST> unary_exp;
+    BaseAST* primary_exp = nullptr;
+    BaseAST* unary_exp = nullptr;
     unary_op_t unary_op;  // since once unary_exp is not nullptr, it must have been assigned
-    std::string ident;
-    std::unique_ptr<BaseAST> func_r_param_list_ast;
+    Symbol ident;
+    BaseAST* func_r_param_list_ast = nullptr;
     Operand DumpExp() const override {
         Operand ret_op;
         Operand zero = Operand(0);
@@ -812,26 +842,24 @@ public:
             ret_op = primary_exp->DumpExp();
         } else if (!ident.empty()) {
             auto op_list = func_r_param_list_ast->DumpRParams();
-            /* Since the func name belongs to the global scope,
-             * we can assume that it remains the same name in koopa.
-             */
-            FuncType func_type = scope.get_func_type_by_ident(ident);
-            Operand func = Operand("@" + ident);
+            const Signature& callee_sign = scope.get_signature_by_ident(ident);
+            FuncType func_type = callee_sign.func_type;
+            Operand func = Operand(callee_sign.koopa_ident.prefixed("@"));
             if (func_type == FuncType::INT) {
-                std::string temp_var_name = "%" + std::to_string(temp_var++);
+                Symbol temp_var_name = Symbol::temp(temp_var++);
                 ret_op = Operand(temp_var_name);
-                auto call_instr = std::make_unique<Instruction>(OpType::CALL,
-                                                                ret_op,
-                                                                func,
-                                                                op_list);
-                scope.current_func_ptr->append_instr_to_current_block(std::move(call_instr));
+                auto call_instr = ir_arena.make<Instruction>(OpType::CALL,
+                                                             ret_op,
+                                                             func,
+                                                             op_list);
+                scope.current_func_ptr->append_instr_to_current_block(call_instr);
             } else {
                 // VOID
                 // WARNING: Let ret_op be uninitialized.
-                auto call_instr = std::make_unique<Instruction>(OpType::CALL,
-                                                                func,
-                                                                op_list);
-                scope.current_func_ptr->append_instr_to_current_block(std::move(call_instr));
+                auto call_instr = ir_arena.make<Instruction>(OpType::CALL,
+                                                             func,
+                                                             op_list);
+                scope.current_func_ptr->append_instr_to_current_block(call_instr);
             }
         } else if (unary_exp != nullptr) {
             Operand unary_res = unary_exp->DumpExp();
@@ -840,25 +868,11 @@ public:
                     ret_op = unary_res;
                     break;
                 case UNARY_MINUS: {
-                    ret_op = Operand("%" + std::to_string(temp_var));
-
-                    auto instr = std::make_unique<Instruction>(OpType::SUB,
-                                                               ret_op,
-                                                               zero,
-                                                               unary_res);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-                    temp_var++;
+                    ret_op = scope.current_func_ptr->append_binary(OpType::SUB, zero, unary_res, temp_var);
                     break;
                 }
                 case UNARY_NEG: {
-                    ret_op = Operand("%" + std::to_string(temp_var));
-
-                    auto instr = std::make_unique<Instruction>(OpType::EQ,
-                                                               ret_op,
-                                                               unary_res,
-                                                               zero);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-                    temp_var++;
+                    ret_op = scope.current_func_ptr->append_binary(OpType::EQ, unary_res, zero, temp_var);
                     break;
                 }
                 default:
@@ -904,7 +918,7 @@ public:
 
 class FuncRParamListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > func_r_param_list;
+    std::vector<BaseAST*> func_r_param_list;
     std::vector<Operand> DumpRParams() const override {
         std::vector<Operand> ret_list;
         for (auto& exp : func_r_param_list) {
@@ -917,8 +931,8 @@ public:
 
 class LValAST : public BaseAST {
 public:
-    std::string ident;
-    std::unique_ptr<BaseAST> array_var_dim_list_ast;
+    Symbol ident;
+    BaseAST* array_var_dim_list_ast = nullptr;
     Operand DumpExp() const override {
         const Variable& var = scope.get_var_by_ident(ident);
         Operand ret_op;
@@ -936,71 +950,71 @@ public:
             // if it is an array, there must be at least one dim
             Operand base_op = Operand(var.koopa_var_name, var.type, true);
             Operand exp_op = exp_list[0]->DumpExp();
-            auto temp_var_str = "%" + std::to_string(temp_var++);
+            auto temp_var_str = Symbol::temp(temp_var++);
             Operand elem_op = Operand(temp_var_str, *(op_type.pointed_type), true);
-            auto instr = std::make_unique<Instruction>(OpType::GETELEMPTR,
-                                                       elem_op,
-                                                       base_op,
-                                                       exp_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+            auto instr = ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                    elem_op,
+                                                    base_op,
+                                                    exp_op);
+            scope.current_func_ptr->append_instr_to_current_block(instr);
             for (size_t i = 1; i < exp_list.size(); i++) {
                 base_op = elem_op;
                 exp_op = exp_list[i]->DumpExp();
-                temp_var_str = "%" + std::to_string(temp_var++);
+                temp_var_str = Symbol::temp(temp_var++);
                 elem_op = Operand(temp_var_str, *(base_op.type.pointed_type->pointed_type), true);
-                auto instr = std::make_unique<Instruction>(OpType::GETELEMPTR,
-                                                           elem_op,
-                                                           base_op,
-                                                           exp_op);
-                scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+                auto instr = ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                        elem_op,
+                                                        base_op,
+                                                        exp_op);
+                scope.current_func_ptr->append_instr_to_current_block(instr);
             }
             ret_op = elem_op;
         } else if (var.type.type_enum == OperandTypeEnum::POINTER) {
             OperandType op_type = var.type;
 
             Operand ptr_ptr = Operand(var.koopa_var_name, var.type, true);  // **[[i32, 3], 2] | ****i32
-            auto temp_var0_str = "%" + std::to_string(temp_var++);
+            auto temp_var0_str = Symbol::temp(temp_var++);
             Operand ptr_to_arr = Operand(temp_var0_str, *(op_type.pointed_type));  // *[[i32, 3], 2] | ***i32
-            auto load_instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                            ptr_to_arr,
-                                                            ptr_ptr);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(load_instr));
+            auto load_instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                         ptr_to_arr,
+                                                         ptr_ptr);
+            scope.current_func_ptr->append_instr_to_current_block(load_instr);
             if (array_var_dim_list_ast == nullptr) {
                 return ptr_to_arr;
             }
             auto& exp_list = array_var_dim_list_ast->GetVector();
             Operand exp_op = exp_list[0]->DumpExp();
-            auto temp_var_str = "%" + std::to_string(temp_var++);
+            auto temp_var_str = Symbol::temp(temp_var++);
             // We will consider the case for pointer's pointer's pointer, though it is not possible in the test case.
             Operand elem_op = Operand(temp_var_str, ptr_to_arr.type, true);  // getptr returns the same type, *[[i32, 3], 2] | ***i32
-            auto get_ptr_instr = std::make_unique<Instruction>(OpType::GETPTR,
-                                                               elem_op,
-                                                               ptr_to_arr,
-                                                               exp_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(get_ptr_instr));
+            auto get_ptr_instr = ir_arena.make<Instruction>(OpType::GETPTR,
+                                                            elem_op,
+                                                            ptr_to_arr,
+                                                            exp_op);
+            scope.current_func_ptr->append_instr_to_current_block(get_ptr_instr);
             for (size_t i = 1; i < exp_list.size(); i++) {
                 ptr_to_arr = elem_op;  // *[[i32, 3], 2] | ***i32
                 exp_op = exp_list[i]->DumpExp();
-                temp_var_str = "%" + std::to_string(temp_var++);
+                temp_var_str = Symbol::temp(temp_var++);
                 elem_op = Operand(temp_var_str, *(ptr_to_arr.type.pointed_type->pointed_type), true);  // *[i32, 3] | **i32
                 if (elem_op.type.pointed_type->type_enum == OperandTypeEnum::ARRAY ||
                 elem_op.type.pointed_type->type_enum == OperandTypeEnum::INT) {
-                    auto instr = std::make_unique<Instruction>(OpType::GETELEMPTR,
-                                                               elem_op,
-                                                               ptr_to_arr,
-                                                               exp_op);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+                    auto instr = ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                            elem_op,
+                                                            ptr_to_arr,
+                                                            exp_op);
+                    scope.current_func_ptr->append_instr_to_current_block(instr);
                 } else if (elem_op.type.pointed_type->type_enum == OperandTypeEnum::POINTER) {
-                    Operand temp_load_op = Operand("%" + std::to_string(temp_var++), elem_op.type);
-                    auto load_instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                                    temp_load_op,
-                                                                    ptr_to_arr);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(load_instr));
-                    auto getptr_instr = std::make_unique<Instruction>(OpType::GETPTR,
-                                                                      elem_op,
-                                                                      temp_load_op,
-                                                                      exp_op);
-                    scope.current_func_ptr->append_instr_to_current_block(std::move(getptr_instr));
+                    Operand temp_load_op = Operand(Symbol::temp(temp_var++), elem_op.type);
+                    auto load_instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                                 temp_load_op,
+                                                                 ptr_to_arr);
+                    scope.current_func_ptr->append_instr_to_current_block(load_instr);
+                    auto getptr_instr = ir_arena.make<Instruction>(OpType::GETPTR,
+                                                                   elem_op,
+                                                                   temp_load_op,
+                                                                   exp_op);
+                    scope.current_func_ptr->append_instr_to_current_block(getptr_instr);
                 }
             }
             ret_op = elem_op;
@@ -1032,17 +1046,17 @@ public:
 
 class ArrayVarDimListAST : public BaseAST {
 public:
-    std::vector<std::unique_ptr<BaseAST> > exp_list;
-    std::vector<std::unique_ptr<BaseAST> >& GetVector() override {
+    std::vector<BaseAST*> exp_list;
+    std::vector<BaseAST*>& GetVector() override {
         return exp_list;
     }
 };
 
 class PrimaryExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> exp;
-    std::unique_ptr<int> number;
-    std::unique_ptr<BaseAST> l_val;
+    BaseAST* exp = nullptr;
+    std::optional<int> number;
+    BaseAST* l_val = nullptr;
     // Notes: PrimaryExp ::= "(" Exp ")" | LVal | Number;
     Operand DumpExp() const override {
         Operand ret_op;
@@ -1052,27 +1066,27 @@ public:
             Operand ret_ptr_op = l_val->DumpExp();
             if (ret_ptr_op.type.type_enum != OperandTypeEnum::INT &&
             ret_ptr_op.type.pointed_type->type_enum == OperandTypeEnum::INT) {
-                auto temp_var_str = "%" + std::to_string(temp_var++);
+                auto temp_var_str = Symbol::temp(temp_var++);
                 ret_op = Operand(temp_var_str);  // type: INT
-                auto instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                           ret_op,
-                                                           ret_ptr_op);
-                scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
+                auto instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                        ret_op,
+                                                        ret_ptr_op);
+                scope.current_func_ptr->append_instr_to_current_block(instr);
             } else if (ret_ptr_op.type.type_enum != OperandTypeEnum::INT &&
             ret_ptr_op.type.pointed_type->type_enum == OperandTypeEnum::ARRAY) {
-                auto temp_var_str = "%" + std::to_string(temp_var++);
+                auto temp_var_str = Symbol::temp(temp_var++);
                 ret_op = Operand(temp_var_str, *(ret_ptr_op.type.pointed_type->pointed_type), true);
-                auto get_elem_instr = std::make_unique<Instruction>(OpType::GETELEMPTR,
-                                                                    ret_op,
-                                                                    ret_ptr_op,
-                                                                    Operand(0));
-                scope.current_func_ptr->append_instr_to_current_block(std::move(get_elem_instr));
+                auto get_elem_instr = ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                                 ret_op,
+                                                                 ret_ptr_op,
+                                                                 Operand(0));
+                scope.current_func_ptr->append_instr_to_current_block(get_elem_instr);
             } else if (ret_ptr_op.type.type_enum == OperandTypeEnum::INT) {
                 ret_op = ret_ptr_op;
             } else {
                 throw std::invalid_argument("Primary::DumpExp: Unrecognized type of ret_ptr_op!");
             }
-        } else if (number != nullptr) {
+        } else if (number.has_value()) {
             ret_op = Operand(*number);
         } else {
             throw std::invalid_argument("exp and number are both nullptr!");
@@ -1085,7 +1099,7 @@ public:
             ret_str = exp->ComputeConstVal(out);
         } else if (l_val != nullptr) {
             ret_str = l_val->ComputeConstVal(out);
-        } else if (number != nullptr) {
+        } else if (number.has_value()) {
             ret_str = std::to_string(*number);
         } else {
             throw std::invalid_argument("PrimaryExpAST: ComputeConstVal: exp and number are both nullptr!");
@@ -1096,8 +1110,8 @@ public:
 
 class MulExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> unary_exp;
-    std::unique_ptr<BaseAST> mul_exp;
+    BaseAST* unary_exp = nullptr;
+    BaseAST* mul_exp = nullptr;
     std::string op;
     Operand DumpExp() const override {
         if (!op.empty()) {
@@ -1105,8 +1119,6 @@ public:
             Operand lhs = mul_exp->DumpExp();
             Operand rhs = unary_exp->DumpExp();
 
-            std::string temp_var_str = "%" + std::to_string(temp_var);
-            Operand res = Operand(temp_var_str);
             OpType type;
             if (op == "*") {
                 type = OpType::MUL;
@@ -1119,14 +1131,7 @@ public:
                 std::cout << "In MulExpAST: invalid op: " << op << std::endl;
                 throw std::invalid_argument("invalid argument");
             }
-            auto instr = std::make_unique<Instruction>(type,
-                                                       res,
-                                                       lhs,
-                                                       rhs);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-
-            temp_var++;
-            return res;
+            return scope.current_func_ptr->append_binary(type, lhs, rhs, temp_var);
         } else {
             // MulExp ::= UnaryExp;
             Operand var_op = unary_exp->DumpExp();
@@ -1166,8 +1171,8 @@ public:
 
 class AddExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> add_exp;
-    std::unique_ptr<BaseAST> mul_exp;
+    BaseAST* add_exp = nullptr;
+    BaseAST* mul_exp = nullptr;
     std::string op;
     Operand DumpExp() const override {
         if (!op.empty()) {
@@ -1175,8 +1180,6 @@ public:
             Operand lhs = add_exp->DumpExp();
             Operand rhs = mul_exp->DumpExp();
 
-            std::string temp_var_str = "%" + std::to_string(temp_var);
-            Operand res = Operand(temp_var_str);
             OpType type;
             if (op == "+") {
                 type = OpType::ADD;
@@ -1187,14 +1190,7 @@ public:
                 std::cout << "In AddExpAST: invalid op: " << op << std::endl;
                 throw std::invalid_argument("invalid argument");
             }
-            auto instr = std::make_unique<Instruction>(type,
-                                                       res,
-                                                       lhs,
-                                                       rhs);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-
-            temp_var++;
-            return temp_var_str;
+            return scope.current_func_ptr->append_binary(type, lhs, rhs, temp_var);
         } else {
             // AddExp ::= MulExp;
             Operand var_op = mul_exp->DumpExp();
@@ -1232,8 +1228,8 @@ public:
 
 class RelExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> add_exp;
-    std::unique_ptr<BaseAST> rel_exp;
+    BaseAST* add_exp = nullptr;
+    BaseAST* rel_exp = nullptr;
     std::string rel_op;
     Operand DumpExp() const override {
         if (!rel_op.empty()) {
@@ -1241,8 +1237,6 @@ public:
             Operand lhs = rel_exp->DumpExp();
             Operand rhs = add_exp->DumpExp();
 
-            std::string temp_var_str = "%" + std::to_string(temp_var);
-            Operand res = Operand(temp_var_str);
             OpType type;
             if (rel_op == ">") {
                 type = OpType::GT;
@@ -1257,14 +1251,7 @@ public:
                 std::cout << "In RelExpAST: invalid rel_op: " << rel_op << std::endl;
                 throw std::invalid_argument("invalid argument");
             }
-            auto instr = std::make_unique<Instruction>(type,
-                                                       res,
-                                                       lhs,
-                                                       rhs);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-
-            temp_var++;
-            return res;
+            return scope.current_func_ptr->append_binary(type, lhs, rhs, temp_var);
         } else {
             // RelExp ::= AddExp;
             Operand var_op = add_exp->DumpExp();
@@ -1306,8 +1293,8 @@ public:
 
 class EqExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> rel_exp;
-    std::unique_ptr<BaseAST> eq_exp;
+    BaseAST* rel_exp = nullptr;
+    BaseAST* eq_exp = nullptr;
     std::string eq_op;
     Operand DumpExp() const override {
         if (eq_exp != nullptr) {
@@ -1315,8 +1302,6 @@ public:
             Operand lhs = eq_exp->DumpExp();
             Operand rhs = rel_exp->DumpExp();
 
-            std::string temp_var_str = "%" + std::to_string(temp_var);
-            Operand res = Operand(temp_var_str);
             OpType type;
             if (eq_op == "==") {
                 type = OpType::EQ;
@@ -1327,14 +1312,7 @@ public:
                 std::cout << "In EqExpAST: invalid eq_op: " << eq_op << std::endl;
                 throw std::invalid_argument("invalid argument");
             }
-            auto instr = std::make_unique<Instruction>(type,
-                                                       res,
-                                                       lhs,
-                                                       rhs);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(instr));
-
-            temp_var++;
-            return res;
+            return scope.current_func_ptr->append_binary(type, lhs, rhs, temp_var);
         } else {
             // EqExp ::= RelExp;
             Operand var_op = rel_exp->DumpExp();
@@ -1372,67 +1350,63 @@ public:
 
 class LAndExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> eq_exp;
-    std::unique_ptr<BaseAST> l_and_exp;
+    BaseAST* eq_exp = nullptr;
+    BaseAST* l_and_exp = nullptr;
     // we do not need an and_op since there is only one choice.
     Operand DumpExp() const override {
         if (l_and_exp != nullptr) {
             // LAndExp ::= LAndExp "&&" EqExp;
-            std::string end_and_block_name = scope.current_func_ptr->get_koopa_var_name(END_AND_BLOCK_BASENAME);
-            std::string and_true_block_name = scope.current_func_ptr->get_koopa_var_name(AND_TRUE_BLOCK_BASENAME);
+            Operand lhs = l_and_exp->DumpExp();
+            if (ConstantFolder::is_int(lhs)) {
+                // 0 && e ==> 0 without evaluating e, 1 && e ==> e != 0
+                if (ConstantFolder::is_int(lhs, 0)) {
+                    return Operand(0);
+                }
+                return scope.current_func_ptr->append_binary(OpType::NE, eq_exp->DumpExp(), Operand(0), temp_var);
+            }
+            Symbol end_and_block_name = scope.current_func_ptr->get_koopa_var_name(END_AND_BLOCK_BASENAME);
+            Symbol and_true_block_name = scope.current_func_ptr->get_koopa_var_name(AND_TRUE_BLOCK_BASENAME);
             Operand end_and_block_op = Operand(end_and_block_name, OperandTypeEnum::BLOCK);
             Operand and_true_block_op = Operand(and_true_block_name, OperandTypeEnum::BLOCK);
 
-            std::string result_ptr_str = "%and_" + std::to_string(temp_var++);
+            Symbol result_ptr_str = Symbol("%and").suffixed(temp_var++);
             Operand result_ptr_op = Operand(result_ptr_str, OperandTypeEnum::INT, true);
             scope.current_func_ptr->append_alloc_to_entry_block(result_ptr_op);
 
-            Operand lhs = l_and_exp->DumpExp();
-            std::string and_lhs_temp_var_str = "%" + std::to_string(temp_var++);
-            Operand and_lhs_temp_op = Operand(and_lhs_temp_var_str);
-            auto judge_lhs_instr = std::make_unique<Instruction>(OpType::NE,
-                                                                 and_lhs_temp_op,
-                                                                 lhs,
-                                                                 Operand(0));
-            scope.current_func_ptr->append_instr_to_current_block(std::move(judge_lhs_instr));
-            auto store_lhs_instr = std::make_unique<Instruction>(OpType::STORE,
-                                                                 and_lhs_temp_op,
-                                                                 result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(store_lhs_instr));
-            auto br_on_lhs_instr = std::make_unique<Instruction>(OpType::BR,
-                                                                 and_lhs_temp_op,
-                                                                 and_true_block_name,
-                                                                 end_and_block_name);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(br_on_lhs_instr),
+            Operand and_lhs_temp_op = scope.current_func_ptr->append_binary(OpType::NE, lhs, Operand(0), temp_var);
+            auto store_lhs_instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                              and_lhs_temp_op,
+                                                              result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(store_lhs_instr);
+            auto br_on_lhs_instr = ir_arena.make<Instruction>(OpType::BR,
+                                                              and_lhs_temp_op,
+                                                              and_true_block_name,
+                                                              end_and_block_name);
+            scope.current_func_ptr->end_current_block_by_instr(br_on_lhs_instr,
                                                                true,
                                                                and_true_block_name);
 
             // if lhs is true, begin eval rhs
             Operand rhs = eq_exp->DumpExp();
-            std::string and_rhs_temp_var_str = "%" + std::to_string(temp_var++);
-            Operand and_rhs_temp_op = Operand(and_rhs_temp_var_str);
-            auto judge_rhs_instr = std::make_unique<Instruction>(OpType::NE,
-                                                                 and_rhs_temp_op,
-                                                                 rhs,
-                                                                 Operand(0));
-            scope.current_func_ptr->append_instr_to_current_block(std::move(judge_rhs_instr));
-            auto store_rhs_instr = std::make_unique<Instruction>(OpType::STORE,
-                                                                 and_rhs_temp_op,
-                                                                 result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(store_rhs_instr));
-            auto jump_to_end_and = std::make_unique<Instruction>(OpType::JUMP,
-                                                                 end_and_block_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_to_end_and),
+            Operand and_rhs_temp_op = scope.current_func_ptr->append_binary(OpType::NE, rhs, Operand(0), temp_var);
+            auto store_rhs_instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                              and_rhs_temp_op,
+                                                              result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(store_rhs_instr);
+            auto jump_to_end_and = ir_arena.make<Instruction>(OpType::JUMP,
+                                                              end_and_block_op);
+            scope.current_func_ptr->end_current_block_by_instr(jump_to_end_and,
                                                                true,
                                                                end_and_block_name);
 
             // Load the result
-            std::string temp_var_str = "%" + std::to_string(temp_var++);
+            Symbol temp_var_str = Symbol::temp(temp_var++);
             Operand res = Operand(temp_var_str);
-            auto load_res_instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                                res,
-                                                                result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(load_res_instr));
+            auto load_res_instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                             res,
+                                                             result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(load_res_instr);
+            scope.current_func_ptr->mark_boolean(res);
 
             return res;
         } else {
@@ -1457,18 +1431,39 @@ public:
             return eq_exp->ComputeConstVal(out);
         }
     }
+    void DumpCondition(Symbol true_block_name, Symbol false_block_name) const override {
+        if (l_and_exp != nullptr) {
+            // LAndExp ::= LAndExp "&&" EqExp;
+            // the rhs is only reached when the lhs holds
+            Symbol and_true_block_name = scope.current_func_ptr->get_koopa_var_name(AND_TRUE_BLOCK_BASENAME);
+            l_and_exp->DumpCondition(and_true_block_name, false_block_name);
+            scope.current_func_ptr->new_basic_block(and_true_block_name);
+            eq_exp->DumpCondition(true_block_name, false_block_name);
+        } else {
+            // LAndExp ::= EqExp
+            eq_exp->DumpCondition(true_block_name, false_block_name);
+        }
+    }
 };
 
 class LOrExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> l_and_exp;
-    std::unique_ptr<BaseAST> l_or_exp;
+    BaseAST* l_and_exp = nullptr;
+    BaseAST* l_or_exp = nullptr;
     // we do not need an or_op since there is only one choice.
     Operand DumpExp() const override {
         if (l_or_exp != nullptr) {
             // LOrExp ::= LOrExp "||" LAndExp;
-            std::string end_or_block_name = scope.current_func_ptr->get_koopa_var_name(END_OR_BLOCK_BASENAME);
-            std::string or_false_block_name = scope.current_func_ptr->get_koopa_var_name(OR_FALSE_BLOCK_BASENAME);
+            Operand lhs = l_or_exp->DumpExp();
+            if (ConstantFolder::is_int(lhs)) {
+                // 1 || e ==> 1 without evaluating e, 0 || e ==> e != 0
+                if (!ConstantFolder::is_int(lhs, 0)) {
+                    return Operand(1);
+                }
+                return scope.current_func_ptr->append_binary(OpType::NE, l_and_exp->DumpExp(), Operand(0), temp_var);
+            }
+            Symbol end_or_block_name = scope.current_func_ptr->get_koopa_var_name(END_OR_BLOCK_BASENAME);
+            Symbol or_false_block_name = scope.current_func_ptr->get_koopa_var_name(OR_FALSE_BLOCK_BASENAME);
             Operand end_or_block_op = Operand(end_or_block_name, OperandTypeEnum::BLOCK);
             Operand or_false_block_op = Operand(or_false_block_name, OperandTypeEnum::BLOCK);
 
@@ -1476,56 +1471,44 @@ public:
             // if (lhs == 0) {
             //   result = rhs != 0;
             // }
-            std::string result_ptr_str = "%or_" + std::to_string(temp_var++);
+            Symbol result_ptr_str = Symbol("%or").suffixed(temp_var++);
             Operand result_ptr_op = Operand(result_ptr_str, OperandTypeEnum::INT, true);
             scope.current_func_ptr->append_alloc_to_entry_block(result_ptr_op);
 
-            Operand lhs = l_or_exp->DumpExp();
-            std::string or_lhs_temp_var_str = "%" + std::to_string(temp_var++);
-            Operand or_lhs_temp_op = Operand(or_lhs_temp_var_str);
-            auto judge_lhs_instr = std::make_unique<Instruction>(OpType::NE,
-                                                                 or_lhs_temp_op,
-                                                                 lhs,
-                                                                 Operand(0));
-            scope.current_func_ptr->append_instr_to_current_block(std::move(judge_lhs_instr));
-            auto store_lhs_instr = std::make_unique<Instruction>(OpType::STORE,
-                                                                 or_lhs_temp_op,
-                                                                 result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(store_lhs_instr));
-            auto br_on_lhs_instr = std::make_unique<Instruction>(OpType::BR,
+            Operand or_lhs_temp_op = scope.current_func_ptr->append_binary(OpType::NE, lhs, Operand(0), temp_var);
+            auto store_lhs_instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                              or_lhs_temp_op,
+                                                              result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(store_lhs_instr);
+            auto br_on_lhs_instr = ir_arena.make<Instruction>(OpType::BR,
                                                                    or_lhs_temp_op,
                                                                    end_or_block_op,
                                                                    or_false_block_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(br_on_lhs_instr),
+            scope.current_func_ptr->end_current_block_by_instr(br_on_lhs_instr,
                                                                true,
                                                                or_false_block_name);
 
             // if lhs is false, begin eval rhs
             Operand rhs = l_and_exp->DumpExp();
-            std::string or_rhs_temp_var_str = "%" + std::to_string(temp_var++);
-            Operand or_rhs_temp_op = Operand(or_rhs_temp_var_str);
-            auto judge_rhs_instr = std::make_unique<Instruction>(OpType::NE,
-                                                                 or_rhs_temp_op,
-                                                                 rhs,
-                                                                 Operand(0));
-            scope.current_func_ptr->append_instr_to_current_block(std::move(judge_rhs_instr));
-            auto store_rhs_instr = std::make_unique<Instruction>(OpType::STORE,
-                                                                 or_rhs_temp_op,
-                                                                 result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(store_rhs_instr));
-            auto jump_to_end_or = std::make_unique<Instruction>(OpType::JUMP,
-                                                                end_or_block_op);
-            scope.current_func_ptr->end_current_block_by_instr(std::move(jump_to_end_or),
+            Operand or_rhs_temp_op = scope.current_func_ptr->append_binary(OpType::NE, rhs, Operand(0), temp_var);
+            auto store_rhs_instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                              or_rhs_temp_op,
+                                                              result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(store_rhs_instr);
+            auto jump_to_end_or = ir_arena.make<Instruction>(OpType::JUMP,
+                                                             end_or_block_op);
+            scope.current_func_ptr->end_current_block_by_instr(jump_to_end_or,
                                                                true,
                                                                end_or_block_name);
 
             // Load the result
-            std::string temp_var_str = "%" + std::to_string(temp_var++);
+            Symbol temp_var_str = Symbol::temp(temp_var++);
             Operand res = Operand(temp_var_str);
-            auto load_res_instr = std::make_unique<Instruction>(OpType::LOAD,
-                                                                res,
-                                                                result_ptr_op);
-            scope.current_func_ptr->append_instr_to_current_block(std::move(load_res_instr));
+            auto load_res_instr = ir_arena.make<Instruction>(OpType::LOAD,
+                                                             res,
+                                                             result_ptr_op);
+            scope.current_func_ptr->append_instr_to_current_block(load_res_instr);
+            scope.current_func_ptr->mark_boolean(res);
 
             return res;
         } else {
@@ -1550,6 +1533,19 @@ public:
             return l_and_exp->ComputeConstVal(out);
         }
     }
+    void DumpCondition(Symbol true_block_name, Symbol false_block_name) const override {
+        if (l_or_exp != nullptr) {
+            // LOrExp ::= LOrExp "||" LAndExp;
+            // the rhs is only reached when the lhs does not hold
+            Symbol or_false_block_name = scope.current_func_ptr->get_koopa_var_name(OR_FALSE_BLOCK_BASENAME);
+            l_or_exp->DumpCondition(true_block_name, or_false_block_name);
+            scope.current_func_ptr->new_basic_block(or_false_block_name);
+            l_and_exp->DumpCondition(true_block_name, false_block_name);
+        } else {
+            // LOrExp ::= LAndExp;
+            l_and_exp->DumpCondition(true_block_name, false_block_name);
+        }
+    }
 };
 
 
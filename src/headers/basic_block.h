@@ -8,24 +8,34 @@
 
 class BasicBlock {
 public:
-    std::string basic_block_name;
-    std::vector<std::unique_ptr<Instruction> > instruction_lists;
-    std::unique_ptr<Instruction> ending_instruction;  // must be among br, jump, ret
+    Symbol basic_block_name;
+    std::vector<Instruction*> instruction_lists;
+    Instruction* ending_instruction = nullptr;  // must be among br, jump, ret
+    std::vector<Operand> params;  // bound by the arguments of the jumps to this block
 
     bool unreachable;
 
-    BasicBlock(std::string name, bool _unreachable = false): basic_block_name(name),
+    BasicBlock(Symbol name, bool _unreachable = false): basic_block_name(name),
                                                              unreachable(_unreachable) { }
 
-    friend std::ostream& operator<<(std::ostream& out, const BasicBlock& block) {
+    friend OutputWriter& operator<<(OutputWriter& out, const BasicBlock& block) {
         if (block.instruction_lists.empty() && block.ending_instruction == nullptr) {
             return out;
         }
         if (!block.instruction_lists.empty() && block.ending_instruction == nullptr) {
             throw std::invalid_argument("BasicBlock: Trying to output a basic block without ending instruction: " +
-                                        block.basic_block_name);
+                                        block.basic_block_name.str());
         }
-        out << block.basic_block_name << ":" << std::endl;
+        out << block.basic_block_name;
+        if (!block.params.empty()) {
+            // %while_entry_0(%5: i32, %6: i32):
+            out << "(";
+            for (size_t i = 0; i < block.params.size(); i++) {
+                out << (i == 0 ? "" : ", ") << block.params[i] << ": " << to_string(block.params[i].type);
+            }
+            out << ")";
+        }
+        out << ":" << '\n';
         for (auto& instr_ptr : block.instruction_lists) {
             out << *instr_ptr;
         }
@@ -0,0 +1,222 @@
+#ifndef COMPILER_CFG_H
+#define COMPILER_CFG_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "function.h"
+
+// A header and the blocks reaching one of its back edges without passing it.
+class NaturalLoop {
+public:
+    size_t header;
+    std::vector<size_t> body;  // in reverse postorder, the header first
+};
+
+// The blocks of a function reachable from its entry, with their edges and dominator tree.
+// Blocks are numbered in reverse postorder, so the entry is block 0 and, except along back edges,
+// a block comes after its predecessors.
+class ControlFlowGraph {
+public:
+    std::vector<BasicBlock*> blocks;
+    std::unordered_map<Symbol, size_t> block_index;
+    std::vector<std::vector<size_t> > successors;  // an edge for each target of a terminator
+    std::vector<std::vector<size_t> > predecessors;
+    std::vector<size_t> idom;  // the immediate dominator, the entry being its own
+    std::vector<std::vector<size_t> > dom_children;
+
+    ControlFlowGraph(const Function& func) {
+        std::unordered_map<Symbol, BasicBlock*> block_by_name;
+        for (auto block_ptr : func.get_blocks()) {
+            block_by_name.emplace(block_ptr->basic_block_name, block_ptr);
+        }
+
+        // iterative depth-first search: (block, the number of its successors visited so far)
+        std::vector<BasicBlock*> postorder;
+        std::unordered_set<BasicBlock*> visited;
+        std::vector<std::pair<BasicBlock*, size_t> > stack;
+        stack.emplace_back(func.entry_block_ptr, 0);
+        visited.insert(func.entry_block_ptr);
+        while (!stack.empty()) {
+            auto& [block_ptr, next] = stack.back();
+            std::vector<Symbol> succ_names = get_successor_names(*block_ptr);
+            if (next == succ_names.size()) {
+                postorder.push_back(block_ptr);
+                stack.pop_back();
+                continue;
+            }
+            BasicBlock* succ = block_by_name.at(succ_names[next++]);
+            if (visited.insert(succ).second) {
+                stack.emplace_back(succ, 0);
+            }
+        }
+        blocks.assign(postorder.rbegin(), postorder.rend());
+
+        for (size_t i = 0; i < blocks.size(); i++) {
+            block_index.emplace(blocks[i]->basic_block_name, i);
+        }
+        successors.resize(blocks.size());
+        predecessors.resize(blocks.size());
+        for (size_t i = 0; i < blocks.size(); i++) {
+            for (auto& succ_name : get_successor_names(*blocks[i])) {
+                size_t succ = block_index.at(succ_name);
+                successors[i].push_back(succ);
+                predecessors[succ].push_back(i);
+            }
+        }
+        compute_dominators();
+    }
+
+    // the names of the blocks a block may continue at
+    static std::vector<Symbol> get_successor_names(const BasicBlock& block) {
+        const auto& ending = block.ending_instruction;
+        if (ending == nullptr) {
+            return {};
+        }
+        switch (ending->op_type) {
+            case OpType::BR:
+                return {std::get<Symbol>(ending->t1->assoc_val), std::get<Symbol>(ending->t2->assoc_val)};
+            case OpType::JUMP:
+                return {std::get<Symbol>(ending->t0->assoc_val)};
+            default:
+                return {};
+        }
+    }
+
+    // Drops the blocks that cannot be reached from the entry; the end block is only emptied.
+    static void remove_unreachable_blocks(Function& func) {
+        ControlFlowGraph cfg(func);
+        auto& block_ptrs = func.basic_block_ptrs;
+        block_ptrs.erase(std::remove_if(block_ptrs.begin(), block_ptrs.end(), [&cfg](auto& block_ptr) {
+            return !cfg.contains(block_ptr->basic_block_name);
+        }), block_ptrs.end());
+        if (!cfg.contains(func.end_block_ptr->basic_block_name)) {
+            func.end_block_ptr->instruction_lists.clear();
+            func.end_block_ptr->ending_instruction = nullptr;
+        }
+    }
+
+    bool contains(Symbol block_name) const {
+        return block_index.find(block_name) != block_index.end();
+    }
+
+    // from a block to one dominating it
+    bool is_back_edge(size_t from, size_t to) const {
+        return dominates(to, from);
+    }
+
+    // the loops, inner ones before the loops containing them
+    std::vector<NaturalLoop> find_loops() const {
+        std::vector<NaturalLoop> loops;
+        for (size_t h = 0; h < blocks.size(); h++) {
+            std::vector<bool> in_loop(blocks.size(), false);
+            std::vector<size_t> worklist;
+            bool is_header = false;
+            in_loop[h] = true;
+            for (auto pred : predecessors[h]) {
+                if (is_back_edge(pred, h)) {
+                    is_header = true;
+                    if (!in_loop[pred]) {
+                        in_loop[pred] = true;
+                        worklist.push_back(pred);
+                    }
+                }
+            }
+            if (!is_header) {
+                continue;
+            }
+            while (!worklist.empty()) {
+                size_t b = worklist.back();
+                worklist.pop_back();
+                for (auto pred : predecessors[b]) {
+                    if (!in_loop[pred]) {
+                        in_loop[pred] = true;
+                        worklist.push_back(pred);
+                    }
+                }
+            }
+            NaturalLoop loop;
+            loop.header = h;
+            for (size_t b = h; b < blocks.size(); b++) {
+                if (in_loop[b]) {
+                    loop.body.push_back(b);
+                }
+            }
+            loops.push_back(loop);
+        }
+        std::stable_sort(loops.begin(), loops.end(), [](const NaturalLoop& a, const NaturalLoop& b) {
+            return a.body.size() < b.body.size();
+        });
+        return loops;
+    }
+
+    bool dominates(size_t a, size_t b) const {
+        while (b != a && b != 0) {
+            b = idom[b];
+        }
+        return b == a;
+    }
+
+    // DF(b): the blocks where the dominance of b ends, i.e. b dominates one of their predecessors
+    // but not themselves strictly.
+    std::vector<std::vector<size_t> > get_dominance_frontiers() const {
+        std::vector<std::vector<size_t> > frontiers(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (predecessors[b].size() < 2) {
+                continue;
+            }
+            for (auto pred : predecessors[b]) {
+                for (size_t runner = pred; runner != idom[b]; runner = idom[runner]) {
+                    if (std::find(frontiers[runner].begin(), frontiers[runner].end(), b) == frontiers[runner].end()) {
+                        frontiers[runner].push_back(b);
+                    }
+                }
+            }
+        }
+        return frontiers;
+    }
+
+private:
+    // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+    void compute_dominators() {
+        const size_t undefined = blocks.size();
+        idom.assign(blocks.size(), undefined);
+        idom[0] = 0;
+        auto intersect = [this](size_t a, size_t b) {
+            while (a != b) {
+                while (a > b) {
+                    a = idom[a];
+                }
+                while (b > a) {
+                    b = idom[b];
+                }
+            }
+            return a;
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t b = 1; b < blocks.size(); b++) {
+                size_t new_idom = undefined;
+                for (auto pred : predecessors[b]) {
+                    if (idom[pred] == undefined) {
+                        continue;
+                    }
+                    new_idom = new_idom == undefined ? pred : intersect(pred, new_idom);
+                }
+                if (idom[b] != new_idom) {
+                    idom[b] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+        dom_children.resize(blocks.size());
+        for (size_t b = 1; b < blocks.size(); b++) {
+            dom_children[idom[b]].push_back(b);
+        }
+    }
+};
+#endif //COMPILER_CFG_H
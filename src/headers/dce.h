@@ -0,0 +1,317 @@
+#ifndef COMPILER_DCE_H
+#define COMPILER_DCE_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "cfg.h"
+#include "function.h"
+
+/* Removes what the function never needs:
+ *   - the blocks nothing jumps to, e.g. %after_ret after a return or the rest of a loop body
+ *     after a break,
+ *   - the instructions without side effects whose values are never used, and the params no
+ *     such instruction needs,
+ *   - the stores to local allocs that are never read, i.e. whose address (or the address of an
+ *     element) is only ever stored to,
+ * and cleans up the control flow: a jump to an empty block that only jumps on goes to its
+ * target directly, and a block jumped to from a single block is merged into it.
+ */
+class DeadCodeElimination {
+public:
+    DeadCodeElimination(Function& _func): func(_func) { }
+
+    void run() {
+        ControlFlowGraph::remove_unreachable_blocks(func);
+        thread_jumps();
+        ControlFlowGraph::remove_unreachable_blocks(func);
+        merge_blocks();
+        remove_dead_instructions();
+    }
+
+private:
+    Function& func;
+
+    template <typename F>
+    void for_each_instr(F f) {
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                f(*instr_ptr);
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                f(*block_ptr->ending_instruction);
+            }
+        }
+    }
+
+    static bool is_jump_without_args(const Instruction& instr) {
+        return instr.op_type == OpType::JUMP && (!instr.param_list.has_value() || instr.param_list->empty());
+    }
+
+    std::unordered_map<Symbol, BasicBlock*> get_blocks_by_name() {
+        std::unordered_map<Symbol, BasicBlock*> block_by_name;
+        for (auto block_ptr : func.get_blocks()) {
+            block_by_name.emplace(block_ptr->basic_block_name, block_ptr);
+        }
+        return block_by_name;
+    }
+
+    // A block holding nothing but a jump can be skipped: the values it passes on are defined in
+    // blocks dominating it, hence dominating the blocks jumping to it too.
+    void thread_jumps() {
+        auto block_by_name = get_blocks_by_name();
+        auto get_forwarding_jump = [this, &block_by_name](const Operand& target) -> Instruction* {
+            BasicBlock* block_ptr = block_by_name.at(target.get_name());
+            if (block_ptr == func.entry_block_ptr || !block_ptr->params.empty()
+                || !block_ptr->instruction_lists.empty() || block_ptr->ending_instruction == nullptr
+                || block_ptr->ending_instruction->op_type != OpType::JUMP) {
+                return nullptr;
+            }
+            return block_ptr->ending_instruction;
+        };
+        for (auto block_ptr : func.get_blocks()) {
+            auto& ending = block_ptr->ending_instruction;
+            if (ending == nullptr) {
+                continue;
+            }
+            if (ending->op_type == OpType::JUMP) {
+                // the visited blocks stop a loop of empty blocks, as in "while (1);"
+                std::unordered_set<Symbol> visited{block_ptr->basic_block_name};
+                Instruction* next;
+                while (visited.insert(ending->t0->get_name()).second
+                       && (next = get_forwarding_jump(ending->t0.value())) != nullptr) {
+                    ending = ir_arena.make<Instruction>(*next);
+                }
+            } else if (ending->op_type == OpType::BR) {
+                // a branch passes no arguments, so it can only skip the jumps without them
+                for (auto target : {&ending->t1, &ending->t2}) {
+                    std::unordered_set<Symbol> visited{block_ptr->basic_block_name};
+                    Instruction* next;
+                    while (visited.insert(target->value().get_name()).second
+                           && (next = get_forwarding_jump(target->value())) != nullptr
+                           && is_jump_without_args(*next)) {
+                        *target = next->t0;
+                    }
+                }
+                if (ending->t1->assoc_val == ending->t2->assoc_val) {
+                    ending = ir_arena.make<Instruction>(OpType::JUMP, ending->t1.value());
+                }
+            }
+        }
+    }
+
+    // a jump to a block with no other predecessor is replaced by the block itself
+    void merge_blocks() {
+        auto block_by_name = get_blocks_by_name();
+        ControlFlowGraph cfg(func);
+        std::unordered_map<Symbol, Operand> replaced;  // the params of the merged blocks
+        std::unordered_set<BasicBlock*> merged;
+        for (auto block_ptr : cfg.blocks) {
+            if (merged.count(block_ptr)) {
+                continue;
+            }
+            while (block_ptr->ending_instruction != nullptr
+                   && block_ptr->ending_instruction->op_type == OpType::JUMP) {
+                const Instruction& jump = *block_ptr->ending_instruction;
+                BasicBlock* next = block_by_name.at(jump.t0->get_name());
+                if (next == block_ptr || next == func.entry_block_ptr
+                    || cfg.predecessors[cfg.block_index.at(next->basic_block_name)].size() != 1) {
+                    break;
+                }
+                for (size_t i = 0; i < next->params.size(); i++) {
+                    replaced.emplace(next->params[i].get_name(), jump.param_list.value()[i]);
+                }
+                for (auto& instr_ptr : next->instruction_lists) {
+                    block_ptr->instruction_lists.push_back(instr_ptr);
+                }
+                block_ptr->ending_instruction = next->ending_instruction;
+                next->ending_instruction = nullptr;
+                next->instruction_lists.clear();
+                next->params.clear();
+                merged.insert(next);
+            }
+        }
+        if (merged.empty()) {
+            return;
+        }
+        auto& block_ptrs = func.basic_block_ptrs;
+        block_ptrs.erase(std::remove_if(block_ptrs.begin(), block_ptrs.end(), [&merged](auto& block_ptr) {
+            return merged.count(block_ptr) > 0;
+        }), block_ptrs.end());
+        // the end block is left empty, so it is not printed
+
+        // an argument may be the param of another merged block
+        auto resolve_replaced = [&replaced](Operand op) {
+            while (op.is_name()) {
+                auto it = replaced.find(op.get_name());
+                if (it == replaced.end()) {
+                    break;
+                }
+                op = it->second;
+            }
+            return op;
+        };
+        for_each_instr([&resolve_replaced](Instruction& instr) {
+            instr.for_each_operand([&resolve_replaced](Operand& op) {
+                op = resolve_replaced(op);
+            });
+        });
+    }
+
+    // the local allocs whose address, directly or through getelemptr/getptr, is only stored to
+    std::unordered_set<Symbol> find_write_only_allocs() {
+        std::unordered_set<Symbol> write_only;
+        for (auto& instr_ptr : func.entry_block_ptr->instruction_lists) {
+            if (instr_ptr->op_type == OpType::ALLOC) {
+                write_only.insert(instr_ptr->t0->get_name());
+            }
+        }
+        std::unordered_map<Symbol, Instruction*> pointer_defs;
+        for_each_instr([&pointer_defs](Instruction& instr) {
+            if (instr.op_type == OpType::GETELEMPTR || instr.op_type == OpType::GETPTR) {
+                pointer_defs.emplace(instr.t0->get_name(), &instr);
+            }
+        });
+        auto get_root = [&write_only, &pointer_defs](Symbol name) -> std::optional<Symbol> {
+            while (!write_only.count(name)) {
+                auto it = pointer_defs.find(name);
+                if (it == pointer_defs.end() || !it->second->t1->is_name()) {
+                    return std::nullopt;
+                }
+                name = it->second->t1->get_name();
+            }
+            return name;
+        };
+        std::unordered_set<Symbol> escaping;
+        for_each_instr([&get_root, &escaping](Instruction& instr) {
+            bool is_address_use = instr.op_type == OpType::STORE || instr.op_type == OpType::GETELEMPTR
+                                  || instr.op_type == OpType::GETPTR;
+            bool defines = instr.op_type == OpType::ALLOC || instr.op_type == OpType::GETELEMPTR
+                           || instr.op_type == OpType::GETPTR;
+            instr.for_each_operand([&](Operand& op) {
+                if (!op.is_name() || (defines && &op == &instr.t0.value())
+                    || (is_address_use && &op == &instr.t1.value())) {
+                    return;
+                }
+                auto root = get_root(op.get_name());
+                if (root.has_value()) {
+                    escaping.insert(root.value());
+                }
+            });
+        });
+        for (auto& name : escaping) {
+            write_only.erase(name);
+        }
+        // only the stores of the write-only allocs are dropped, the other derived pointers stay
+        std::unordered_set<Symbol> write_only_pointers = write_only;
+        for (auto& [name, instr] : pointer_defs) {
+            auto root = get_root(name);
+            if (root.has_value() && write_only.count(root.value())) {
+                write_only_pointers.insert(name);
+            }
+        }
+        return write_only_pointers;
+    }
+
+    static bool has_side_effects(const Instruction& instr) {
+        switch (instr.op_type) {
+            case OpType::BR:
+            case OpType::JUMP:
+            case OpType::RET:
+            case OpType::CALL:
+            case OpType::STORE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // mark and sweep: a value is live when an instruction with side effects or another live
+    // value uses it, the argument of a jump being used by the param it binds
+    void remove_dead_instructions() {
+        std::unordered_set<Symbol> write_only_pointers = find_write_only_allocs();
+        auto is_dead_store = [&write_only_pointers](const Instruction& instr) {
+            return instr.op_type == OpType::STORE && instr.t1->is_name()
+                   && write_only_pointers.count(instr.t1->get_name());
+        };
+
+        std::unordered_map<Symbol, Instruction*> defs;
+        std::unordered_map<Symbol, std::pair<BasicBlock*, size_t> > params;
+        std::unordered_map<Symbol, std::vector<Instruction*> > jumps;
+        for (auto block_ptr : func.get_blocks()) {
+            for (size_t i = 0; i < block_ptr->params.size(); i++) {
+                params.emplace(block_ptr->params[i].get_name(), std::make_pair(block_ptr, i));
+            }
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                if (!has_side_effects(*instr_ptr)) {
+                    defs.emplace(instr_ptr->t0->get_name(), instr_ptr);
+                }
+            }
+            const auto& ending = block_ptr->ending_instruction;
+            if (ending != nullptr && ending->op_type == OpType::JUMP) {
+                jumps[ending->t0->get_name()].push_back(ending);
+            }
+        }
+
+        std::unordered_set<Symbol> live;
+        std::vector<Symbol> worklist;
+        auto mark_live = [&defs, &params, &live, &worklist](const Operand& op) {
+            if (op.is_name() && (defs.count(op.get_name()) || params.count(op.get_name()))
+                && live.insert(op.get_name()).second) {
+                worklist.push_back(op.get_name());
+            }
+        };
+        for_each_instr([&is_dead_store, &mark_live](Instruction& instr) {
+            if (!has_side_effects(instr) || is_dead_store(instr)) {
+                return;
+            }
+            if (instr.op_type == OpType::JUMP) {
+                return;  // the arguments are live with their params
+            }
+            instr.for_each_operand(mark_live);
+        });
+        while (!worklist.empty()) {
+            Symbol name = worklist.back();
+            worklist.pop_back();
+            auto def_it = defs.find(name);
+            if (def_it != defs.end()) {
+                Instruction& def = *def_it->second;
+                for (auto op : {&def.t1, &def.t2}) {
+                    if (op->has_value()) {
+                        mark_live(op->value());
+                    }
+                }
+                continue;
+            }
+            auto [block_ptr, idx] = params.at(name);
+            for (auto jump : jumps[block_ptr->basic_block_name]) {
+                mark_live(jump->param_list.value()[idx]);
+            }
+        }
+
+        for (auto block_ptr : func.get_blocks()) {
+            for (size_t i = block_ptr->params.size(); i-- > 0;) {
+                if (live.count(block_ptr->params[i].get_name())) {
+                    continue;
+                }
+                block_ptr->params.erase(block_ptr->params.begin() + i);
+                for (auto jump : jumps[block_ptr->basic_block_name]) {
+                    jump->param_list->erase(jump->param_list->begin() + i);
+                }
+            }
+            auto& instrs = block_ptr->instruction_lists;
+            instrs.erase(std::remove_if(instrs.begin(), instrs.end(), [&](auto& instr_ptr) {
+                if (has_side_effects(*instr_ptr)) {
+                    return is_dead_store(*instr_ptr);
+                }
+                return !live.count(instr_ptr->t0->get_name());
+            }), instrs.end());
+        }
+    }
+};
+
+#endif //COMPILER_DCE_H
@@ -0,0 +1,169 @@
+#ifndef COMPILER_FOLD_H
+#define COMPILER_FOLD_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "instruction.h"
+
+class ConstantFolder {
+public:
+    static bool is_compare(OpType op_type) {
+        switch (op_type) {
+            case OpType::EQ:
+            case OpType::NE:
+            case OpType::GT:
+            case OpType::GE:
+            case OpType::LT:
+            case OpType::LE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // lhs op rhs with 32-bit wraparound, or nullopt when the result is left to the target
+    // (division by 0 and INT32_MIN / -1).
+    static std::optional<int> fold(OpType op_type, int lhs, int rhs) {
+        int64_t l = lhs, r = rhs;
+        switch (op_type) {
+            case OpType::ADD:
+                return wrap(l + r);
+            case OpType::SUB:
+                return wrap(l - r);
+            case OpType::MUL:
+                return wrap(l * r);
+            case OpType::DIV:
+                if (r == 0 || (l == INT32_MIN && r == -1)) {
+                    return std::nullopt;
+                }
+                return int(l / r);
+            case OpType::MOD:
+                if (r == 0 || (l == INT32_MIN && r == -1)) {
+                    return std::nullopt;
+                }
+                return int(l % r);
+            case OpType::EQ:
+                return l == r;
+            case OpType::NE:
+                return l != r;
+            case OpType::GT:
+                return l > r;
+            case OpType::GE:
+                return l >= r;
+            case OpType::LT:
+                return l < r;
+            case OpType::LE:
+                return l <= r;
+            case OpType::AND:
+                return int(l & r);
+            case OpType::OR:
+                return int(l | r);
+            case OpType::XOR:
+                return int(l ^ r);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    /* The operand lhs op rhs is equal to without computing anything, e.g.
+     *     x + 0, x * 1, x / 1  ==>  x
+     *     x * 0, x % 1, x - x  ==>  0
+     *     x <= x               ==>  1
+     * Both sides have been evaluated already, so dropping one loses no side effect.
+     */
+    static std::optional<Operand> simplify(OpType op_type, const Operand& lhs, const Operand& rhs) {
+        if (is_int(lhs) && is_int(rhs)) {
+            auto folded = fold(op_type, std::get<int>(lhs.assoc_val), std::get<int>(rhs.assoc_val));
+            if (folded.has_value()) {
+                return Operand(folded.value());
+            }
+            return std::nullopt;
+        }
+        if (is_int(lhs) && is_commutative(op_type)) {
+            return simplify(op_type, rhs, lhs);
+        }
+        bool same = lhs.assoc_val == rhs.assoc_val;
+        switch (op_type) {
+            case OpType::ADD:
+                if (is_int(rhs, 0)) {
+                    return lhs;
+                }
+                break;
+            case OpType::SUB:
+                if (is_int(rhs, 0)) {
+                    return lhs;
+                }
+                if (same) {
+                    return Operand(0);
+                }
+                break;
+            case OpType::MUL:
+                if (is_int(rhs, 1)) {
+                    return lhs;
+                }
+                if (is_int(rhs, 0)) {
+                    return Operand(0);
+                }
+                break;
+            case OpType::DIV:
+                if (is_int(rhs, 1)) {
+                    return lhs;
+                }
+                break;
+            case OpType::MOD:
+                if (is_int(rhs, 1) || is_int(rhs, -1)) {
+                    return Operand(0);
+                }
+                break;
+            case OpType::EQ:
+            case OpType::GE:
+            case OpType::LE:
+                if (same) {
+                    return Operand(1);
+                }
+                break;
+            case OpType::NE:
+            case OpType::GT:
+            case OpType::LT:
+                if (same) {
+                    return Operand(0);
+                }
+                break;
+            default:
+                break;
+        }
+        return std::nullopt;
+    }
+
+    static bool is_int(const Operand& op) {
+        return std::holds_alternative<int>(op.assoc_val);
+    }
+
+    static bool is_int(const Operand& op, int val) {
+        return is_int(op) && std::get<int>(op.assoc_val) == val;
+    }
+
+    static bool is_commutative(OpType op_type) {
+        switch (op_type) {
+            case OpType::ADD:
+            case OpType::MUL:
+            case OpType::EQ:
+            case OpType::NE:
+            case OpType::AND:
+            case OpType::OR:
+            case OpType::XOR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+private:
+    static int wrap(int64_t val) {
+        return int(uint32_t(val));
+    }
+};
+
+#endif //COMPILER_FOLD_H
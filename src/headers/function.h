@@ -2,11 +2,23 @@
 #define COMPILER_FUNCTION_H
 
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 
+#include "array.h"
 #include "basic_block.h"
+#include "fold.h"
+#include "global_decl.h"
 #include "instruction.h"
 
+#define INIT_LOOP_BASENAME          "%init_loop"
+#define END_INIT_LOOP_BASENAME      "%end_init_loop"
+#define INIT_INDEX_BASENAME         "%init_idx"
+// local arrays of at most this many elements are initialized by one store per element
+#define INIT_ARRAY_ELEMENTWISE_SIZE 32
+// elements handled by one iteration of an initialization loop
+#define INIT_ARRAY_UNROLL           16
+
 
 enum class FuncType {
     VOID,
@@ -15,11 +27,11 @@ enum class FuncType {
 
 class FParam {
 public:
-    std::string koopa_var_name;
+    Symbol koopa_var_name;
     OperandType type;
-    FParam(std::string _name, OperandTypeEnum _type_enum): koopa_var_name(_name), type(_type_enum) { }
-    FParam(std::string _name, OperandType _type): koopa_var_name(_name), type(_type) { }
-    friend std::ostream& operator<<(std::ostream& out, const FParam& param) {
+    FParam(Symbol _name, OperandTypeEnum _type_enum): koopa_var_name(_name), type(_type_enum) { }
+    FParam(Symbol _name, OperandType _type): koopa_var_name(_name), type(_type) { }
+    friend OutputWriter& operator<<(OutputWriter& out, const FParam& param) {
         out << param.koopa_var_name << ": ";
         out << to_string(param.type);
         return out;
@@ -29,18 +41,20 @@ public:
 class Signature {
 public:
     FuncType func_type;
-    std::string ident;
+    Symbol ident;
+    Symbol koopa_ident;  // the name in the IR, without the @: ident, unless that is taken by a global of the compiler
     std::vector<OperandType> param_types;
 
-    Signature(FuncType _type, std::string _ident, std::vector<OperandType> _param_types): func_type(_type),
+    Signature(FuncType _type, Symbol _ident, std::vector<OperandType> _param_types): func_type(_type),
                                                                                               ident(_ident),
+                                                                                              koopa_ident(_ident),
                                                                                               param_types(_param_types) { }
 
-    friend std::ostream& operator<<(std::ostream& out, const Signature& signature) {
-        out << "@" << signature.ident << "(";
+    friend OutputWriter& operator<<(OutputWriter& out, const Signature& signature) {
+        out << "@" << signature.koopa_ident << "(";
         if (!signature.param_types.empty()) {
             out << to_string(signature.param_types[0]);
-            for (auto i = 1; i < signature.param_types.size(); i++) {
+            for (size_t i = 1; i < signature.param_types.size(); i++) {
                 out << ", " << to_string(signature.param_types[i]);
             }
         }
@@ -55,53 +69,78 @@ public:
 class Function {
 public:
     FuncType func_type;
-    std::string ident;
+    Symbol ident;
     std::vector<FParam> param_list;
-    std::vector<std::string> original_param_ident_list;
+    std::vector<Symbol> original_param_ident_list;
     std::optional<Operand> ret_var_op;
 
-    Function(FuncType _type, std::string _ident): func_type(_type), ident(_ident) {
+    Function(FuncType _type, Symbol _ident): func_type(_type), ident(_ident) {
         // entry block
-        std::string entry_name = get_koopa_var_name("%entry");
-        entry_block_ptr = std::make_unique<BasicBlock>(entry_name);
-        std::string ret_var_name = get_koopa_var_name("%ret");
+        Symbol entry_name = get_koopa_var_name("%entry");
+        entry_block_ptr = ir_arena.make<BasicBlock>(entry_name);
+        Symbol ret_var_name = get_koopa_var_name("%ret");
         ret_var_op = Operand(ret_var_name, OperandTypeEnum::INT, true);
         if (func_type == FuncType::INT) {
-            auto alloc_ret = std::make_unique<Instruction>(OpType::ALLOC,
-                                                           ret_var_op.value());
-            entry_block_ptr->instruction_lists.push_back(std::move(alloc_ret));
+            auto alloc_ret = ir_arena.make<Instruction>(OpType::ALLOC,
+                                                        ret_var_op.value());
+            entry_block_ptr->instruction_lists.push_back(alloc_ret);
         }
 
         // will assign current_block_ptr
         new_basic_block();
 
         // end block
-        std::string end_block_name = get_koopa_var_name("%end");
-        end_block_ptr = std::make_unique<BasicBlock>(end_block_name);
+        Symbol end_block_name = get_koopa_var_name("%end");
+        end_block_ptr = ir_arena.make<BasicBlock>(end_block_name);
     }
 
-    std::unordered_map<std::string, size_t> koopa_var_count_map;
+    std::unordered_map<Symbol, size_t> koopa_var_count_map;
+    // the idents of the globals and the functions defined before this one, numbered from _1 here;
+    // the globals this function adds (the templates of its array initializers) are reserved in it too
+    std::unordered_set<Symbol>* reserved_idents = nullptr;
 
-    std::string get_koopa_var_name(std::string name) {
+    Symbol get_koopa_var_name(Symbol name) {
         /* 1. This method only return the name, excluding the leading @ sign.
          * Though the koopa_var_name stored into the symbol table should include the @ sign
          *     because that is the whole name.
          * 2. This method will also serve for the name of the basic block, in case the name collides with the vars.
          *    In this case, the leading % is included.
          */
+        size_t count;
         auto pair_it = koopa_var_count_map.find(name);
         if (pair_it == koopa_var_count_map.end()) {
-            koopa_var_count_map.emplace(name, 0);
+            count = reserved_idents != nullptr && reserved_idents->count(name) > 0 ? 1 : 0;
             // To prevent another symbol named "{name}_0" (so that it will be "{name}_0_0") instead
-            return name + "_0";
+            pair_it = koopa_var_count_map.emplace(name, count).first;
         } else {
-            pair_it->second++;
-            return name + "_" + std::to_string(pair_it->second);
+            count = pair_it->second + 1;
+        }
+        Symbol koopa_var_name = name.suffixed(count);
+        // nor may it be a reserved global, e.g. a global x_0 for the local x
+        while (reserved_idents != nullptr && reserved_idents->count(koopa_var_name) > 0) {
+            koopa_var_name = name.suffixed(++count);
+        }
+        pair_it->second = count;
+        return koopa_var_name;
+    }
+
+    // The global holding the initial values of the local array koopa_var_name, e.g. @main_a_0_init:
+    //     the locals all end in _{count} and cannot take it, and it is reserved from the globals
+    Symbol get_init_template_name(Symbol koopa_var_name) {
+        std::string prefix = ident.str() + "_" + koopa_var_name.str().substr(1);
+        Symbol name = prefix + "_init";
+        for (size_t count = 0; reserved_idents->count(name) > 0; count++) {
+            name = prefix + "_" + std::to_string(count) + "_init";
         }
+        reserved_idents->insert(name);
+        return name.prefixed("@");
     }
 
-    std::vector<std::pair<std::string, std::string> > loop_infos;
-    void enter_loop(std::pair<std::string, std::string> loop_info) {
+    std::unordered_set<Symbol> boolean_temps;  // temps known to be 0 or 1
+    std::unordered_map<Symbol, Operand> negations;  // %r -> x for %r = eq x, 0
+
+    std::vector<std::pair<Symbol, Symbol> > loop_infos;
+    void enter_loop(std::pair<Symbol, Symbol> loop_info) {
         loop_infos.push_back(loop_info);
     }
 
@@ -109,20 +148,31 @@ public:
         loop_infos.pop_back();
     }
 
-    std::pair<std::string, std::string> get_current_loop_info() {
+    std::pair<Symbol, Symbol> get_current_loop_info() {
         if (loop_infos.empty()) {
             throw std::invalid_argument("Trying to access loop_info while there is none!");
         }
         return loop_infos.back();
     }
 
-    std::vector<std::unique_ptr<BasicBlock> > basic_block_ptrs;
+    std::vector<BasicBlock*> basic_block_ptrs;
     // entry block is used to alloc all vars
-    std::unique_ptr<BasicBlock> entry_block_ptr;
-    std::unique_ptr<BasicBlock> current_block_ptr;
-    std::unique_ptr<BasicBlock> end_block_ptr;
-    void new_basic_block(std::string name = "") {
-        if (name.empty()) {
+    BasicBlock* entry_block_ptr = nullptr;
+    BasicBlock* current_block_ptr = nullptr;
+    BasicBlock* end_block_ptr = nullptr;
+    // entry, the other blocks and end, in the order they are printed
+    std::vector<BasicBlock*> get_blocks() const {
+        std::vector<BasicBlock*> blocks;
+        blocks.push_back(entry_block_ptr);
+        for (auto& block_ptr : basic_block_ptrs) {
+            blocks.push_back(block_ptr);
+        }
+        blocks.push_back(end_block_ptr);
+        return blocks;
+    }
+
+    void new_basic_block(Symbol name = Symbol()) {
+        if (name == Symbol()) {
             name = get_koopa_var_name("%basic_block");
         }
         if (current_block_ptr != nullptr && current_block_ptr->ending_instruction == nullptr) {
@@ -130,67 +180,158 @@ public:
                     "In Function::new_basic_block: trying to end a basic block without ending_instruction!");
         }
         if (current_block_ptr != nullptr) {
-            basic_block_ptrs.push_back(std::move(current_block_ptr));
+            basic_block_ptrs.push_back(current_block_ptr);
+        }
+        current_block_ptr = ir_arena.make<BasicBlock>(name);
+    }
+
+    void append_instr_to_current_block(Instruction* instr) {
+        current_block_ptr->instruction_lists.push_back(instr);
+    }
+
+    /* Appends res = lhs op rhs and returns res, unless the result is known without computing it:
+     * constant operands are folded and identities such as x + 0 are simplified (see
+     * ConstantFolder). Comparisons are remembered as booleans, so that for a boolean b
+     *     b != 0   ==>  b
+     *     !!b      ==>  b      (!b being b == 0)
+     */
+    Operand append_binary(OpType op_type, Operand lhs, Operand rhs, int& temp_var) {
+        auto simplified = ConstantFolder::simplify(op_type, lhs, rhs);
+        if (simplified.has_value()) {
+            return simplified.value();
+        }
+        if (is_boolean(lhs) && ConstantFolder::is_int(rhs, 0)) {
+            if (op_type == OpType::NE) {
+                return lhs;
+            }
+            auto it = negations.find(std::get<Symbol>(lhs.assoc_val));
+            if (op_type == OpType::EQ && it != negations.end() && is_boolean(it->second)) {
+                return it->second;
+            }
+        }
+        Operand res = Operand(Symbol::temp(temp_var++));
+        append_instr_to_current_block(ir_arena.make<Instruction>(op_type, res, lhs, rhs));
+        if (ConstantFolder::is_compare(op_type)) {
+            mark_boolean(res);
         }
-        current_block_ptr = std::make_unique<BasicBlock>(name);
+        if (op_type == OpType::EQ && ConstantFolder::is_int(rhs, 0)) {
+            negations.emplace(std::get<Symbol>(res.assoc_val), lhs);
+        }
+        return res;
+    }
+
+    // e.g. the result of a && b, which is always 0 or 1
+    void mark_boolean(const Operand& op) {
+        boolean_temps.insert(std::get<Symbol>(op.assoc_val));
     }
 
-    void append_instr_to_current_block(std::unique_ptr<Instruction> instr) {
-        current_block_ptr->instruction_lists.push_back(std::move(instr));
+    bool is_boolean(const Operand& op) const {
+        if (ConstantFolder::is_int(op)) {
+            return ConstantFolder::is_int(op, 0) || ConstantFolder::is_int(op, 1);
+        }
+        return boolean_temps.count(std::get<Symbol>(op.assoc_val)) > 0;
     }
 
-    void end_current_block_by_instr(std::unique_ptr<Instruction> instr,
+    void end_current_block_by_instr(Instruction* instr,
                                     bool create_new_block,
-                                    std::string new_block_name = "") {
+                                    Symbol new_block_name = Symbol()) {
         if (current_block_ptr->ending_instruction != nullptr) {
             throw std::invalid_argument("Trying to end a block already ended!");
         }
-        current_block_ptr->ending_instruction = std::move(instr);
+        current_block_ptr->ending_instruction = instr;
         if (create_new_block) {
             new_basic_block(new_block_name);
         } else {
-            basic_block_ptrs.push_back(std::move(current_block_ptr));
+            basic_block_ptrs.push_back(current_block_ptr);
             current_block_ptr = nullptr;
         }
     }
 
     void append_alloc_to_entry_block(Operand op) {
-        auto instr = std::make_unique<Instruction>(OpType::ALLOC,
-                                                   op);
-        entry_block_ptr->instruction_lists.push_back(std::move(instr));
+        auto instr = ir_arena.make<Instruction>(OpType::ALLOC,
+                                                op);
+        entry_block_ptr->instruction_lists.push_back(instr);
     }
 
-    void append_init_array(std::string koopa_var_name, OperandType op_type, std::shared_ptr<Array> arr_ptr,
+    // read-only copies of the initializers of local arrays, to be declared as globals
+    std::vector<GlobalDecl> init_template_decls;
+
+    /* Larger arrays are not initialized element by element:
+     * 1. mostly zeros: a loop storing zeros, then a store for each nonzero element;
+     * 2. otherwise: a loop copying the initializer from a global template.
+     * Both loops handle INIT_ARRAY_UNROLL elements per iteration, the rest is stored directly.
+     */
+    void append_init_array(Symbol koopa_var_name, OperandType op_type, std::shared_ptr<Array> arr_ptr,
                            int& temp_var) {
-        switch(op_type.type_enum) {
-            case OperandTypeEnum::INT: {
-                switch(arr_ptr->contained_val.index()) {
-                    case 0: {
-                        auto val = arr_ptr->get_int();
-                        auto instr = std::make_unique<Instruction>(OpType::STORE,
-                                                                   Operand(val),
-                                                                   Operand(koopa_var_name, op_type, true));
-                        current_block_ptr->instruction_lists.push_back(std::move(instr));
-                        break;
+        const Array& arr = *arr_ptr;
+        if (arr.size() <= INIT_ARRAY_ELEMENTWISE_SIZE) {
+            size_t next_index = 0;
+            append_init_array_elementwise(koopa_var_name, op_type, arr, next_index, temp_var);
+            return;
+        }
+        bool is_sparse = arr.nonzero_num() * 2 <= arr.size();
+
+        Operand base_op = get_first_elem_ptr(Operand(koopa_var_name, op_type, true), op_type, temp_var);
+        std::optional<Operand> template_base_op;
+        if (!is_sparse) {
+            Symbol template_name = get_init_template_name(koopa_var_name);
+            OperandType template_type = OperandType(arr.size(), OperandType(OperandTypeEnum::INT));
+            std::vector<int32_t> template_values;
+            for (size_t i = 0; i < arr.size(); i++) {
+                template_values.push_back(arr.get(i));
+            }
+            auto template_init = std::make_shared<Array>(template_type);
+            template_init->assign(template_values);
+            init_template_decls.emplace_back(template_name, template_type, template_init);
+            template_base_op = get_first_elem_ptr(Operand(template_name, template_type, true),
+                                                  template_type,
+                                                  temp_var);
+        }
+
+        size_t loop_size = arr.size() / INIT_ARRAY_UNROLL * INIT_ARRAY_UNROLL;
+        append_init_loop(base_op, template_base_op, loop_size, temp_var);
+        if (is_sparse) {
+            // the nonzeros, whether or not the Array itself is stored sparse (see ARRAY_SPARSE_RATIO)
+            if (arr.is_sparse) {
+                for (auto& [i, val] : arr.sparse_values) {
+                    if (i < loop_size) {
+                        append_store_to_elem(Operand(val), base_op, int(i), temp_var);
                     }
-                    default: {
-                        auto error = "Unhandled type of operand: " + std::to_string(arr_ptr->contained_val.index());
-                        throw std::invalid_argument(error);
+                }
+            } else {
+                for (size_t i = 0; i < loop_size; i++) {
+                    if (arr.get(i) != 0) {
+                        append_store_to_elem(Operand(arr.get(i)), base_op, int(i), temp_var);
                     }
                 }
+            }
+        }
+        for (size_t i = loop_size; i < arr.size(); i++) {
+            append_store_to_elem(Operand(arr.get(i)), base_op, int(i), temp_var);
+        }
+    }
+
+    // next_index: the index (in the flattened array) of the element to store next
+    void append_init_array_elementwise(Symbol koopa_var_name, OperandType op_type, const Array& arr,
+                                       size_t& next_index, int& temp_var) {
+        switch(op_type.type_enum) {
+            case OperandTypeEnum::INT: {
+                auto instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                        Operand(arr.get(next_index++)),
+                                                        Operand(koopa_var_name, op_type, true));
+                current_block_ptr->instruction_lists.push_back(instr);
                 break;
             }
             case OperandTypeEnum::ARRAY: {
                 for (size_t i = 0; i < op_type.array_len; i++) {
-                    auto temp_var_str = "%" + std::to_string(temp_var++);
+                    auto temp_var_str = Symbol::temp(temp_var++);
                     Operand elemptr_op = Operand(temp_var_str, *(op_type.pointed_type), true);
-                    auto instr = std::make_unique<Instruction>(OpType::GETELEMPTR,
-                                                               elemptr_op,
-                                                               Operand(koopa_var_name, op_type, true),
-                                                               int(i));
-                    current_block_ptr->instruction_lists.push_back(std::move(instr));
-                    auto sub_arr = arr_ptr->get_sub_arr();
-                    append_init_array(temp_var_str, *(op_type.pointed_type), sub_arr[i], temp_var);
+                    auto instr = ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                            elemptr_op,
+                                                            Operand(koopa_var_name, op_type, true),
+                                                            int(i));
+                    current_block_ptr->instruction_lists.push_back(instr);
+                    append_init_array_elementwise(temp_var_str, *(op_type.pointed_type), arr, next_index, temp_var);
                 }
                 break;
             }
@@ -199,6 +340,125 @@ public:
             }
         }
     }
+
+    // *i32 to the first element, by a getelemptr for each dimension
+    Operand get_first_elem_ptr(Operand array_ptr_op, OperandType op_type, int& temp_var) {
+        while (op_type.type_enum == OperandTypeEnum::ARRAY) {
+            op_type = *(op_type.pointed_type);
+            Operand elemptr_op = Operand(Symbol::temp(temp_var++), op_type, true);
+            append_instr_to_current_block(ir_arena.make<Instruction>(OpType::GETELEMPTR,
+                                                                     elemptr_op,
+                                                                     array_ptr_op,
+                                                                     Operand(0)));
+            array_ptr_op = elemptr_op;
+        }
+        return array_ptr_op;
+    }
+
+    void append_store_to_elem(Operand value_op, Operand ptr_op, Operand index_op, int& temp_var) {
+        Operand elem_ptr_op = Operand(Symbol::temp(temp_var++), OperandTypeEnum::INT, true);
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::GETPTR, elem_ptr_op, ptr_op, index_op));
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::STORE, value_op, elem_ptr_op));
+    }
+
+    /* Zeros (or copies from the template) the first loop_size elements of base, with loop_size > 0:
+     *   store 0, %init_idx_0
+     *   jump %init_loop_0
+     * %init_loop_0:
+     *   %1 = load %init_idx_0
+     *   %2 = getptr base, %1
+     *   store 0, getptr %2, 0 ... store 0, getptr %2, INIT_ARRAY_UNROLL - 1
+     *   %3 = add %1, INIT_ARRAY_UNROLL
+     *   store %3, %init_idx_0
+     *   %4 = lt %3, loop_size
+     *   br %4, %init_loop_0, %end_init_loop_0
+     */
+    void append_init_loop(Operand base_op, std::optional<Operand> template_base_op, size_t loop_size,
+                          int& temp_var) {
+        if (loop_size == 0) {
+            return;
+        }
+        Operand index_alloc_op = Operand(get_koopa_var_name(INIT_INDEX_BASENAME), OperandTypeEnum::INT, true);
+        append_alloc_to_entry_block(index_alloc_op);
+        Symbol loop_name = get_koopa_var_name(INIT_LOOP_BASENAME);
+        Symbol end_loop_name = get_koopa_var_name(END_INIT_LOOP_BASENAME);
+        Operand loop_op = Operand(loop_name, OperandTypeEnum::BLOCK);
+        Operand end_loop_op = Operand(end_loop_name, OperandTypeEnum::BLOCK);
+
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::STORE, Operand(0), index_alloc_op));
+        end_current_block_by_instr(ir_arena.make<Instruction>(OpType::JUMP, loop_op), true, loop_name);
+
+        Operand index_op = Operand(Symbol::temp(temp_var++));
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::LOAD, index_op, index_alloc_op));
+        Operand dst_op = Operand(Symbol::temp(temp_var++), OperandTypeEnum::INT, true);
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::GETPTR, dst_op, base_op, index_op));
+        std::optional<Operand> src_op;
+        if (template_base_op.has_value()) {
+            src_op = Operand(Symbol::temp(temp_var++), OperandTypeEnum::INT, true);
+            append_instr_to_current_block(ir_arena.make<Instruction>(OpType::GETPTR,
+                                                                     src_op.value(),
+                                                                     template_base_op.value(),
+                                                                     index_op));
+        }
+        for (int i = 0; i < INIT_ARRAY_UNROLL; i++) {
+            Operand value_op = Operand(0);
+            if (src_op.has_value()) {
+                Operand src_elem_ptr_op = Operand(Symbol::temp(temp_var++), OperandTypeEnum::INT, true);
+                append_instr_to_current_block(ir_arena.make<Instruction>(OpType::GETPTR,
+                                                                         src_elem_ptr_op,
+                                                                         src_op.value(),
+                                                                         Operand(i)));
+                value_op = Operand(Symbol::temp(temp_var++));
+                append_instr_to_current_block(ir_arena.make<Instruction>(OpType::LOAD,
+                                                                         value_op,
+                                                                         src_elem_ptr_op));
+            }
+            append_store_to_elem(value_op, dst_op, Operand(i), temp_var);
+        }
+        Operand next_index_op = Operand(Symbol::temp(temp_var++));
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::ADD,
+                                                                 next_index_op,
+                                                                 index_op,
+                                                                 Operand(INIT_ARRAY_UNROLL)));
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::STORE, next_index_op, index_alloc_op));
+        Operand cond_op = Operand(Symbol::temp(temp_var++));
+        append_instr_to_current_block(ir_arena.make<Instruction>(OpType::LT,
+                                                                 cond_op,
+                                                                 next_index_op,
+                                                                 Operand(int(loop_size))));
+        end_current_block_by_instr(ir_arena.make<Instruction>(OpType::BR, cond_op, loop_op, end_loop_op),
+                                   true,
+                                   end_loop_name);
+    }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const Function& func) {
+        out << "fun";
+        out << " ";
+        out << "@" << func.ident;
+
+        out << "(";
+        if (!func.param_list.empty()) {
+            auto& list = func.param_list;
+            out << list[0];
+            for (size_t i = 1; i < list.size(); i++) {
+                out << ", " << list[i];
+            }
+        }
+        out << ")";
+        if (func.func_type == FuncType::INT) {
+            out << ": i32";
+        }
+        out << " {" << '\n';
+
+        out << *func.entry_block_ptr << '\n';
+        for (auto& block_ptr : func.basic_block_ptrs) {
+            out << *block_ptr << '\n';
+        }
+        out << *func.end_block_ptr;
+
+        out << "}";
+        return out;
+    }
 };
 
 #endif //COMPILER_FUNCTION_H
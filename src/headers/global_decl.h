@@ -0,0 +1,31 @@
+#ifndef COMPILER_GLOBAL_DECL_H
+#define COMPILER_GLOBAL_DECL_H
+
+#include <memory>
+#include <string>
+
+#include "array.h"
+#include "instruction.h"
+
+// e.g. global @a = alloc [i32, 2], {1, 2}
+class GlobalDecl {
+public:
+    Symbol koopa_var_name;
+    OperandType type;  // the type allocated, not the pointer to it
+    std::shared_ptr<Array> init;  // zeroinit when nullptr
+
+    GlobalDecl(Symbol _koopa_var_name, OperandType _type, std::shared_ptr<Array> _init = nullptr):
+            koopa_var_name(_koopa_var_name), type(_type), init(_init) { }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const GlobalDecl& decl) {
+        out << "global " << decl.koopa_var_name << " = alloc " << to_string(decl.type) << ", ";
+        if (decl.init != nullptr) {
+            out << *decl.init;
+        } else {
+            out << "zeroinit";
+        }
+        return out;
+    }
+};
+
+#endif //COMPILER_GLOBAL_DECL_H
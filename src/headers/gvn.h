@@ -0,0 +1,157 @@
+#ifndef COMPILER_GVN_H
+#define COMPILER_GVN_H
+
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "cfg.h"
+#include "fold.h"
+#include "function.h"
+
+/* Dominator-based value numbering: walking the dominator tree, a pure computation (arithmetic,
+ * a comparison, getelemptr or getptr) already done in a dominating block, with the same
+ * operands, is not done again and its value is used instead, e.g. in
+ *     a[i][j] = a[i][j] + x;
+ * the address of a[i][j] is computed once.
+ * Memory is only followed inside a block: a load from an address already loaded from or stored
+ * to gets that value, until a store to any address or a call, which may write anywhere.
+ */
+class GlobalValueNumbering {
+public:
+    GlobalValueNumbering(Function& _func): func(_func) { }
+
+    void run() {
+        ControlFlowGraph cfg(func);
+        visit(cfg, 0);
+    }
+
+private:
+    Function& func;
+    // an operand as part of an expression: its name, or its value
+    using Key = std::variant<int, Symbol>;
+
+    // e.g. add %1, %2, the same as add %2, %1
+    class Expression {
+    public:
+        OpType op_type;
+        Key lhs;
+        Key rhs;
+
+        bool operator==(const Expression& other) const {
+            return op_type == other.op_type && lhs == other.lhs && rhs == other.rhs;
+        }
+    };
+
+    class ExpressionHash {
+    public:
+        size_t operator()(const Expression& expr) const {
+            size_t h = std::hash<Key>()(expr.lhs);
+            h = h * 31 + std::hash<Key>()(expr.rhs);
+            return h * 31 + size_t(expr.op_type);
+        }
+    };
+
+    std::unordered_map<Expression, Operand, ExpressionHash> available;  // the expressions computed in the dominators
+    std::unordered_map<Symbol, Operand> replaced;  // the values computed again -> the first ones
+
+    static std::optional<Expression> get_expression(const Instruction& instr) {
+        switch (instr.op_type) {
+            case OpType::GETELEMPTR:
+            case OpType::GETPTR:
+            case OpType::ADD:
+            case OpType::SUB:
+            case OpType::MUL:
+            case OpType::DIV:
+            case OpType::MOD:
+            case OpType::EQ:
+            case OpType::NE:
+            case OpType::GT:
+            case OpType::GE:
+            case OpType::LT:
+            case OpType::LE:
+            case OpType::AND:
+            case OpType::OR:
+            case OpType::XOR:
+                break;
+            default:
+                return std::nullopt;
+        }
+        Key lhs = instr.t1->assoc_val, rhs = instr.t2->assoc_val;
+        if (ConstantFolder::is_commutative(instr.op_type) && rhs < lhs) {
+            std::swap(lhs, rhs);
+        }
+        return Expression{instr.op_type, lhs, rhs};
+    }
+
+    Operand resolve(const Operand& op) const {
+        if (std::holds_alternative<Symbol>(op.assoc_val)) {
+            auto it = replaced.find(std::get<Symbol>(op.assoc_val));
+            if (it != replaced.end()) {
+                return it->second;
+            }
+        }
+        return op;
+    }
+
+    void resolve_operands(Instruction& instr) const {
+        for (auto op : {&instr.t0, &instr.t1, &instr.t2}) {
+            if (op->has_value()) {
+                *op = resolve(op->value());
+            }
+        }
+        if (instr.param_list.has_value()) {
+            for (auto& param : instr.param_list.value()) {
+                param = resolve(param);
+            }
+        }
+    }
+
+    // every use is dominated by its definition, so it is resolved after the definition is visited
+    void visit(const ControlFlowGraph& cfg, size_t b) {
+        BasicBlock* block_ptr = cfg.blocks[b];
+        std::vector<Expression> added;
+        std::unordered_map<Symbol, Operand> memory;  // address -> the value last loaded or stored
+
+        std::vector<Instruction*> instrs;
+        for (auto& instr_ptr : block_ptr->instruction_lists) {
+            resolve_operands(*instr_ptr);
+            auto expr = get_expression(*instr_ptr);
+            if (expr.has_value()) {
+                auto it = available.find(expr.value());
+                if (it != available.end()) {
+                    replaced.emplace(std::get<Symbol>(instr_ptr->t0->assoc_val), it->second);
+                    continue;
+                }
+                available.emplace(expr.value(), instr_ptr->t0.value());
+                added.push_back(expr.value());
+            } else if (instr_ptr->op_type == OpType::LOAD) {
+                Symbol address = std::get<Symbol>(instr_ptr->t1->assoc_val);
+                auto it = memory.find(address);
+                if (it != memory.end()) {
+                    replaced.emplace(std::get<Symbol>(instr_ptr->t0->assoc_val), it->second);
+                    continue;
+                }
+                memory.emplace(address, instr_ptr->t0.value());
+            } else if (instr_ptr->op_type == OpType::STORE) {
+                memory.clear();
+                memory.emplace(std::get<Symbol>(instr_ptr->t1->assoc_val), instr_ptr->t0.value());
+            } else if (instr_ptr->op_type == OpType::CALL) {
+                memory.clear();
+            }
+            instrs.push_back(instr_ptr);
+        }
+        block_ptr->instruction_lists = std::move(instrs);
+        resolve_operands(*block_ptr->ending_instruction);
+
+        for (auto child : cfg.dom_children[b]) {
+            visit(cfg, child);
+        }
+        for (auto& expr : added) {
+            available.erase(expr);
+        }
+    }
+};
+
+#endif //COMPILER_GVN_H
@@ -0,0 +1,250 @@
+#ifndef COMPILER_INLINER_H
+#define COMPILER_INLINER_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "function.h"
+#include "program.h"
+
+#define INLINE_BLOCK_BASENAME           "%inline"
+// a callee of at most this many instructions is inlined at every call site
+#define INLINE_SMALL_FUNC_SIZE          40
+// a callee with a single call site is inlined up to this size
+#define INLINE_SINGLE_CALL_FUNC_SIZE    1000
+// no inlining into a caller that would grow beyond this
+#define INLINE_CALLER_SIZE_LIMIT        4000
+
+// Replaces calls by a copy of the callee's body:
+//     %r = call @f(%a)                 jump %inline_0_entry_0
+//     ...                 ==>        %inline_0_entry_0: ... (the callee, its params replaced by %a)
+//                                    %inline_0_end_0:
+//                                      %r = load %5          (the callee's %ret, now a local of the caller)
+//                                      jump %inline_0_after
+//                                    %inline_0_after:
+//                                      ...
+// The allocs of the callee move into the caller's entry block. Every value of the callee gets a
+// fresh temp name, every block the prefix of this call site.
+class Inliner {
+public:
+    Inliner(Program& _program, int& _temp_var): program(_program), temp_var(_temp_var) { }
+
+    void run() {
+        std::vector<Function*> funcs = program.get_functions();
+        for (auto func_ptr : funcs) {
+            for (auto& callee_ident : get_callees(*func_ptr)) {
+                call_site_count[callee_ident]++;
+            }
+        }
+        // callees are defined before their callers, so each callee is final by the time it is inlined
+        for (auto func_ptr : funcs) {
+            inline_calls_in(*func_ptr);
+        }
+        // functions no longer called; a caller comes after its callees, so go backwards
+        std::unordered_set<const Function*> dead_funcs;
+        for (auto it = funcs.rbegin(); it != funcs.rend(); it++) {
+            if ((*it)->ident != "main" && call_site_count[(*it)->ident] == 0) {
+                for (auto& callee_ident : get_callees(**it)) {
+                    call_site_count[callee_ident]--;
+                }
+                dead_funcs.insert(*it);
+            }
+        }
+        program.remove_functions(dead_funcs);
+    }
+
+private:
+    Program& program;
+    int& temp_var;
+    std::unordered_map<Symbol, size_t> call_site_count;
+
+    // "call @f(...)" keeps the callee in t0, "%r = call @f(...)" in t1
+    static Symbol get_callee_ident(const Instruction& instr) {
+        const Operand& func = instr.t1.has_value() ? instr.t1.value() : instr.t0.value();
+        return std::string_view(std::get<Symbol>(func.assoc_val).str()).substr(1);
+    }
+
+    static std::vector<Symbol> get_callees(const Function& func) {
+        std::vector<Symbol> callees;
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                if (instr_ptr->op_type == OpType::CALL) {
+                    callees.push_back(get_callee_ident(*instr_ptr));
+                }
+            }
+        }
+        return callees;
+    }
+
+    // the cost model: instructions other than allocs
+    static size_t get_size(const Function& func) {
+        size_t size = 0;
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                size += instr_ptr->op_type != OpType::ALLOC;
+            }
+            size += block_ptr->ending_instruction != nullptr;
+        }
+        return size;
+    }
+
+    bool should_inline(const Function& caller, const Function& callee) {
+        if (&caller == &callee || callee.ident == "main") {
+            return false;
+        }
+        size_t ret_num = 0;
+        for (auto block_ptr : callee.get_blocks()) {
+            ret_num += block_ptr->ending_instruction != nullptr
+                       && block_ptr->ending_instruction->op_type == OpType::RET;
+        }
+        std::vector<Symbol> callees = get_callees(callee);
+        bool is_recursive = std::find(callees.begin(), callees.end(), callee.ident) != callees.end();
+        if (ret_num != 1 || is_recursive) {
+            return false;
+        }
+        size_t callee_size = get_size(callee);
+        if (get_size(caller) + callee_size > INLINE_CALLER_SIZE_LIMIT) {
+            return false;
+        }
+        return callee_size <= INLINE_SMALL_FUNC_SIZE
+               || (call_site_count[callee.ident] == 1 && callee_size <= INLINE_SINGLE_CALL_FUNC_SIZE);
+    }
+
+    void inline_calls_in(Function& caller) {
+        // the blocks of an inlined body are scanned as well, for the calls it brings along
+        for (size_t i = 0; i < caller.basic_block_ptrs.size(); i++) {
+            auto& instrs = caller.basic_block_ptrs[i]->instruction_lists;
+            for (size_t j = 0; j < instrs.size(); j++) {
+                if (instrs[j]->op_type != OpType::CALL) {
+                    continue;
+                }
+                Function* callee_ptr = program.get_function_by_ident(get_callee_ident(*instrs[j]));
+                if (callee_ptr != nullptr && should_inline(caller, *callee_ptr)) {
+                    inline_call(caller, i, j, *callee_ptr);
+                    break;  // the rest of the block has moved to the block after the body
+                }
+            }
+        }
+    }
+
+    void inline_call(Function& caller, size_t block_idx, size_t instr_idx, const Function& callee) {
+        BasicBlock& call_block = *caller.basic_block_ptrs[block_idx];
+        Instruction call = *call_block.instruction_lists[instr_idx];
+        Symbol prefix = caller.get_koopa_var_name(INLINE_BLOCK_BASENAME);
+        std::vector<BasicBlock*> callee_blocks = callee.get_blocks();
+
+        std::unordered_map<Symbol, Operand> rename_map;
+        for (size_t i = 0; i < callee.param_list.size(); i++) {
+            rename_map[callee.param_list[i].koopa_var_name] = call.param_list.value()[i];
+        }
+        for (auto block_ptr : callee_blocks) {
+            Symbol block_name = prefix.str() + "_" + block_ptr->basic_block_name.str().substr(1);
+            rename_map[block_ptr->basic_block_name] = Operand(block_name, OperandTypeEnum::BLOCK);
+        }
+        std::optional<Operand> ret_val;
+        for (auto block_ptr : callee_blocks) {
+            if (block_ptr->ending_instruction != nullptr && block_ptr->ending_instruction->op_type == OpType::RET) {
+                ret_val = block_ptr->ending_instruction->t0;
+            }
+        }
+        bool ret_val_is_result = false;
+        for (auto block_ptr : callee_blocks) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                if (!instr_ptr->get_result().has_value()) {
+                    continue;
+                }
+                Operand renamed = instr_ptr->t0.value();
+                Symbol name = std::get<Symbol>(renamed.assoc_val);
+                bool is_ret_val = ret_val.has_value() && ret_val->assoc_val == renamed.assoc_val;
+                if (is_ret_val && call.t1.has_value()) {
+                    // the value returned becomes the result of the call
+                    renamed.assoc_val = std::get<Symbol>(call.t0.value().assoc_val);
+                    ret_val_is_result = true;
+                } else {
+                    renamed.assoc_val = Symbol::temp(temp_var++);
+                }
+                rename_map[name] = renamed;
+            }
+        }
+        auto rename = [&rename_map](std::optional<Operand>& op) {
+            if (op.has_value() && std::holds_alternative<Symbol>(op->assoc_val)) {
+                auto it = rename_map.find(std::get<Symbol>(op->assoc_val));
+                if (it != rename_map.end()) {
+                    op = it->second;
+                }
+            }
+        };
+        auto clone_instr = [&rename](const Instruction& instr) {
+            auto clone = ir_arena.make<Instruction>(instr);
+            rename(clone->t0);
+            rename(clone->t1);
+            rename(clone->t2);
+            if (clone->param_list.has_value()) {
+                for (auto& param : clone->param_list.value()) {
+                    std::optional<Operand> renamed = param;
+                    rename(renamed);
+                    param = renamed.value();
+                }
+            }
+            return clone;
+        };
+
+        // the rest of the call block continues after the inlined body
+        Symbol after_block_name = prefix.str() + "_after";
+        auto after_block = ir_arena.make<BasicBlock>(after_block_name);
+        for (size_t j = instr_idx + 1; j < call_block.instruction_lists.size(); j++) {
+            after_block->instruction_lists.push_back(call_block.instruction_lists[j]);
+        }
+        after_block->ending_instruction = call_block.ending_instruction;
+        call_block.instruction_lists.resize(instr_idx);
+        Operand body_entry_op = rename_map.at(callee.entry_block_ptr->basic_block_name);
+        call_block.ending_instruction = ir_arena.make<Instruction>(OpType::JUMP, body_entry_op);
+
+        std::vector<BasicBlock*> body_blocks;
+        for (auto block_ptr : callee_blocks) {
+            auto clone = ir_arena.make<BasicBlock>(
+                    std::get<Symbol>(rename_map.at(block_ptr->basic_block_name).assoc_val),
+                    block_ptr->unreachable);
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                if (instr_ptr->op_type == OpType::ALLOC) {
+                    caller.entry_block_ptr->instruction_lists.push_back(clone_instr(*instr_ptr));
+                } else {
+                    clone->instruction_lists.push_back(clone_instr(*instr_ptr));
+                }
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                if (block_ptr->ending_instruction->op_type == OpType::RET) {
+                    if (call.t1.has_value() && !ret_val_is_result) {
+                        // e.g. the callee returns a param or a constant: %r = add value, 0
+                        std::optional<Operand> ret_op = ret_val;
+                        rename(ret_op);
+                        clone->instruction_lists.push_back(ir_arena.make<Instruction>(OpType::ADD,
+                                                                                      call.t0.value(),
+                                                                                      ret_op.value(),
+                                                                                      Operand(0)));
+                    }
+                    clone->ending_instruction = ir_arena.make<Instruction>(
+                            OpType::JUMP, Operand(after_block_name, OperandTypeEnum::BLOCK));
+                } else {
+                    clone->ending_instruction = clone_instr(*block_ptr->ending_instruction);
+                }
+            }
+            body_blocks.push_back(clone);
+        }
+        body_blocks.push_back(after_block);
+
+        call_site_count[callee.ident]--;
+        for (auto& callee_ident : get_callees(callee)) {
+            call_site_count[callee_ident]++;
+        }
+        caller.basic_block_ptrs.insert(caller.basic_block_ptrs.begin() + block_idx + 1,
+                                       std::make_move_iterator(body_blocks.begin()),
+                                       std::make_move_iterator(body_blocks.end()));
+    }
+};
+
+#endif //COMPILER_INLINER_H
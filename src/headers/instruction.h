@@ -10,6 +10,10 @@
 #include <optional>
 #include <algorithm>
 
+#include "arena.h"
+#include "output_writer.h"
+#include "symbol.h"
+
 enum class OpType {
     GETELEMPTR,
     GETPTR,
@@ -45,9 +49,9 @@ enum class OperandTypeEnum {
 
 class OperandType {
 public:
-    OperandTypeEnum type_enum;
+    OperandTypeEnum type_enum = OperandTypeEnum::INT;
     std::shared_ptr<OperandType> pointed_type;
-    size_t array_len;
+    size_t array_len = 0;
 
     OperandType() { }
 
@@ -119,19 +123,20 @@ public:
 
 class Operand {
 public:
-    std::variant<int, std::string> assoc_val;  // could be the name of temp var, or the int val
+    std::variant<int, Symbol> assoc_val;  // could be the name of temp var, or the int val
     OperandType type;
     Operand() {
-        assoc_val = "uninitialized";
+        static const Symbol uninitialized("uninitialized");
+        assoc_val = uninitialized;
     }
     Operand(int val): assoc_val(val) {
         type = OperandTypeEnum::INT;
     }
-    Operand(std::string val, OperandTypeEnum _type_enum = OperandTypeEnum::INT): assoc_val(val), type(_type_enum) { }
+    Operand(Symbol val, OperandTypeEnum _type_enum = OperandTypeEnum::INT): assoc_val(val), type(_type_enum) { }
 
-//    Operand(std::string val, OperandType _type): assoc_val(val), type(_type) { }
+//    Operand(Symbol val, OperandType _type): assoc_val(val), type(_type) { }
 
-    Operand(std::string val, OperandType _type, bool is_the_pointer_of_type = false): assoc_val(val) {
+    Operand(Symbol val, OperandType _type, bool is_the_pointer_of_type = false): assoc_val(val) {
         if (is_the_pointer_of_type) {
             type = OperandType(OperandTypeEnum::POINTER, _type);
         } else {
@@ -139,21 +144,25 @@ public:
         }
     }
 
-    friend std::ostream& operator<<(std::ostream& out, const Operand& op) {
-        size_t idx = op.assoc_val.index();
-        std::string val;
-        if (idx == 0) {
-            // int
-            val = std::to_string(std::get<int>(op.assoc_val));
+    // a temp or a named value, rather than an int
+    bool is_name() const {
+        return std::holds_alternative<Symbol>(assoc_val);
+    }
+
+    Symbol get_name() const {
+        return std::get<Symbol>(assoc_val);
+    }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const Operand& op) {
+        if (std::holds_alternative<int>(op.assoc_val)) {
+            out << std::get<int>(op.assoc_val);
         } else {
-            // std::string
-            val = std::get<std::string>(op.assoc_val);
+            out << std::get<Symbol>(op.assoc_val);
         }
-        out << val;
         return out;
     }
 
-    friend std::ostream& operator<<(std::ostream& out, const std::optional<Operand>& op) {
+    friend OutputWriter& operator<<(OutputWriter& out, const std::optional<Operand>& op) {
         if (!op.has_value()) {
             throw std::invalid_argument("Operand: Trying to output a nullopt!");
         }
@@ -191,7 +200,41 @@ public:
         assert(type == OpType::CALL);
     }
 
-    friend std::ostream& operator<<(std::ostream& out, const Instruction& instr) {
+    // the value the instruction defines, if any: the result in t0, or the address for an alloc
+    std::optional<Symbol> get_result() const {
+        switch (op_type) {
+            case OpType::CALL:
+                // "call @f(...)" keeps the callee in t0
+                if (t1.has_value()) {
+                    return std::get<Symbol>(t0->assoc_val);
+                }
+                return std::nullopt;
+            case OpType::BR:
+            case OpType::JUMP:
+            case OpType::RET:
+            case OpType::STORE:
+                return std::nullopt;
+            default:
+                return std::get<Symbol>(t0->assoc_val);
+        }
+    }
+
+    // calls f on every operand the instruction reads or writes, the arguments included
+    template <typename F>
+    void for_each_operand(F f) {
+        for (auto op : {&t0, &t1, &t2}) {
+            if (op->has_value()) {
+                f(op->value());
+            }
+        }
+        if (param_list.has_value()) {
+            for (auto& param : param_list.value()) {
+                f(param);
+            }
+        }
+    }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const Instruction& instr) {
         out << "  ";
         switch(instr.op_type) {
             case OpType::GETELEMPTR: {
@@ -208,6 +251,15 @@ public:
             }
             case OpType::JUMP: {
                 out << "jump " << instr.t0;
+                if (instr.param_list.has_value() && !instr.param_list->empty()) {
+                    // the arguments of the target block
+                    auto& args = instr.param_list.value();
+                    out << "(" << args[0];
+                    for (size_t i = 1; i < args.size(); i++) {
+                        out << ", " << args[i];
+                    }
+                    out << ")";
+                }
                 break;
             }
             case OpType::RET: {
@@ -228,7 +280,7 @@ public:
                 auto& param_list_unwrapped = instr.param_list.value();
                 if (!param_list_unwrapped.empty()) {
                     out << param_list_unwrapped[0];
-                    for (auto i = 1; i < param_list_unwrapped.size(); i++) {
+                    for (size_t i = 1; i < param_list_unwrapped.size(); i++) {
                         out << ", " << param_list_unwrapped[i];
                     }
                 }
@@ -306,9 +358,13 @@ public:
             default:
                 throw std::invalid_argument("Invalid OpType!");
         }
-        out << std::endl;
+        out << '\n';
         return out;
     }
 };
 
+// owns the instructions and basic blocks of every function, which are pointed to by plain pointers:
+// an instruction dropped by a pass is simply no longer pointed to
+inline Arena ir_arena;
+
 #endif //COMPILER_INSTRUCTION_H
@@ -0,0 +1,304 @@
+#ifndef COMPILER_LICM_H
+#define COMPILER_LICM_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cfg.h"
+#include "function.h"
+
+#define PREHEADER_BASENAME          "%preheader"
+
+/* Loop-invariant code motion. Every natural loop (see NaturalLoop) gets a preheader, the
+ * only block outside it jumping to the header, and the instructions of the loop computing the
+ * same value on every iteration are moved there:
+ *   - arithmetic, comparisons, getelemptr and getptr whose operands are defined outside the
+ *     loop (or moved out already), division only by a constant other than 0 and -1 since the
+ *     instruction may now run when the loop body does not;
+ *   - loads from an address nothing in the loop may store to. A scalar (an alloc or a global
+ *     loaded directly) can only be stored to by its name, while an array element may be stored
+ *     to through any pointer into the same array, or through a pointer parameter unless the array
+ *     is local. A call to a function other than those of the runtime not writing memory may store
+ *     to any global, and to a local array passed to it. Elements are only loaded early from the
+ *     header, which runs whenever the preheader does.
+ * Inner loops are visited first, so what leaves an inner loop may leave the outer one too.
+ */
+class LoopInvariantCodeMotion {
+public:
+    LoopInvariantCodeMotion(Function& _func, int& _temp_var): func(_func), temp_var(_temp_var) { }
+
+    void run() {
+        insert_preheaders();
+        ControlFlowGraph cfg(func);
+        collect_defs();
+        for (auto& loop : cfg.find_loops()) {
+            hoist(cfg, loop);
+        }
+        remove_empty_preheaders();
+    }
+
+private:
+    // a preheader inserted in front of a header, and the jumps redirected to it
+    class InsertedPreheader {
+    public:
+        BasicBlock* preheader;
+        Symbol header_name;
+        std::vector<Instruction*> redirected;
+    };
+
+    enum class AddressRoot {
+        LOCAL,  // an alloc of this function
+        GLOBAL,
+        UNKNOWN,  // a pointer parameter, or a pointer loaded from where one is kept
+    };
+
+    Function& func;
+    int& temp_var;
+    std::vector<InsertedPreheader> inserted_preheaders;
+    std::unordered_set<Symbol> allocs;
+    std::unordered_map<Symbol, Instruction*> pointer_defs;  // getelemptr and getptr results
+
+    // the targets of a jump or a branch going to one block go to another
+    static void retarget(Instruction& ending, Symbol from, Symbol to) {
+        std::vector<std::optional<Operand>*> targets = {&ending.t0};
+        if (ending.op_type == OpType::BR) {
+            targets = {&ending.t1, &ending.t2};
+        }
+        for (auto target : targets) {
+            if (target->value().get_name() == from) {
+                *target = Operand(to, OperandTypeEnum::BLOCK);
+            }
+        }
+    }
+
+    void insert_preheaders() {
+        ControlFlowGraph cfg(func);
+        for (size_t h = 0; h < cfg.blocks.size(); h++) {
+            std::vector<size_t> outside_preds;
+            bool is_header = false;
+            for (auto pred : cfg.predecessors[h]) {
+                if (cfg.is_back_edge(pred, h)) {
+                    is_header = true;
+                } else {
+                    outside_preds.push_back(pred);
+                }
+            }
+            if (!is_header) {
+                continue;
+            }
+            BasicBlock* header = cfg.blocks[h];
+            if (outside_preds.size() == 1
+                && cfg.blocks[outside_preds[0]]->ending_instruction->op_type == OpType::JUMP) {
+                continue;  // the only way in is a jump, the block it ends is the preheader
+            }
+
+            Symbol preheader_name = func.get_koopa_var_name(PREHEADER_BASENAME);
+            auto preheader = ir_arena.make<BasicBlock>(preheader_name);
+            std::vector<Operand> args;
+            for (auto& param : header->params) {
+                preheader->params.emplace_back(Symbol::temp(temp_var++), param.type);
+                args.push_back(preheader->params.back());
+            }
+            preheader->ending_instruction = ir_arena.make<Instruction>(OpType::JUMP,
+                                                                       Operand(header->basic_block_name,
+                                                                                  OperandTypeEnum::BLOCK));
+            preheader->ending_instruction->param_list = args;
+
+            InsertedPreheader inserted{preheader, header->basic_block_name, {}};
+            for (auto pred : outside_preds) {
+                Instruction* ending = cfg.blocks[pred]->ending_instruction;
+                retarget(*ending, header->basic_block_name, preheader_name);
+                if (std::find(inserted.redirected.begin(), inserted.redirected.end(), ending)
+                    == inserted.redirected.end()) {
+                    inserted.redirected.push_back(ending);
+                }
+            }
+            inserted_preheaders.push_back(inserted);
+
+            // printed right before the header
+            auto& block_ptrs = func.basic_block_ptrs;
+            auto it = std::find_if(block_ptrs.begin(), block_ptrs.end(), [header](auto& block_ptr) {
+                return block_ptr == header;
+            });
+            block_ptrs.insert(it, preheader);
+        }
+    }
+
+    // the preheaders nothing was moved to are taken out again
+    void remove_empty_preheaders() {
+        std::unordered_set<BasicBlock*> removed;
+        for (auto& inserted : inserted_preheaders) {
+            if (!inserted.preheader->instruction_lists.empty()) {
+                continue;
+            }
+            for (auto ending : inserted.redirected) {
+                retarget(*ending, inserted.preheader->basic_block_name, inserted.header_name);
+            }
+            removed.insert(inserted.preheader);
+        }
+        auto& block_ptrs = func.basic_block_ptrs;
+        block_ptrs.erase(std::remove_if(block_ptrs.begin(), block_ptrs.end(), [&removed](auto& block_ptr) {
+            return removed.count(block_ptr) > 0;
+        }), block_ptrs.end());
+    }
+
+    void collect_defs() {
+        for (auto& instr_ptr : func.entry_block_ptr->instruction_lists) {
+            if (instr_ptr->op_type == OpType::ALLOC) {
+                allocs.insert(instr_ptr->t0->get_name());
+            }
+        }
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                if (instr_ptr->op_type == OpType::GETELEMPTR || instr_ptr->op_type == OpType::GETPTR) {
+                    pointer_defs.emplace(instr_ptr->t0->get_name(), instr_ptr);
+                }
+            }
+        }
+    }
+
+    // the alloc, global or other pointer an address is computed from
+    std::pair<Symbol, AddressRoot> get_root(Symbol name) const {
+        while (pointer_defs.count(name) && pointer_defs.at(name)->t1->is_name()) {
+            name = pointer_defs.at(name)->t1->get_name();
+        }
+        if (allocs.count(name)) {
+            return {name, AddressRoot::LOCAL};
+        }
+        return {name, name.front() == '@' ? AddressRoot::GLOBAL : AddressRoot::UNKNOWN};
+    }
+
+    static bool may_alias(const std::pair<Symbol, AddressRoot>& a, const std::pair<Symbol, AddressRoot>& b) {
+        if (a.first == b.first) {
+            return true;
+        }
+        if (a.second == AddressRoot::LOCAL || b.second == AddressRoot::LOCAL) {
+            return false;
+        }
+        return a.second == AddressRoot::UNKNOWN || b.second == AddressRoot::UNKNOWN;
+    }
+
+    static bool may_write_memory(Symbol callee) {
+        static const std::unordered_set<Symbol> read_only_runtime = {
+                "@getint", "@getch", "@putint", "@putch", "@putarray", "@starttime", "@stoptime",
+        };
+        return !read_only_runtime.count(callee);
+    }
+
+    static bool is_hoistable_arithmetic(const Instruction& instr) {
+        switch (instr.op_type) {
+            case OpType::DIV:
+            case OpType::MOD:
+                return !instr.t2->is_name() && std::get<int>(instr.t2->assoc_val) != 0
+                       && std::get<int>(instr.t2->assoc_val) != -1;
+            case OpType::GETELEMPTR:
+            case OpType::GETPTR:
+            case OpType::ADD:
+            case OpType::SUB:
+            case OpType::MUL:
+            case OpType::EQ:
+            case OpType::NE:
+            case OpType::GT:
+            case OpType::GE:
+            case OpType::LT:
+            case OpType::LE:
+            case OpType::AND:
+            case OpType::OR:
+            case OpType::XOR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void hoist(const ControlFlowGraph& cfg, const NaturalLoop& loop) {
+        BasicBlock* header = cfg.blocks[loop.header];
+        BasicBlock* preheader = nullptr;
+        for (auto pred : cfg.predecessors[loop.header]) {
+            if (!cfg.is_back_edge(pred, loop.header)) {
+                preheader = cfg.blocks[pred];
+            }
+        }
+
+        std::unordered_set<Symbol> loop_defs;
+        std::vector<std::pair<Symbol, AddressRoot> > stored_roots;
+        std::unordered_set<Symbol> stored_names;
+        std::unordered_set<Symbol> passed_roots;  // the local arrays passed to calls writing memory
+        bool calls_writing_memory = false;
+        for (auto b : loop.body) {
+            for (auto& param : cfg.blocks[b]->params) {
+                loop_defs.insert(param.get_name());
+            }
+            for (auto& instr_ptr : cfg.blocks[b]->instruction_lists) {
+                const Instruction& instr = *instr_ptr;
+                if (instr.op_type == OpType::STORE) {
+                    stored_names.insert(instr.t1->get_name());
+                    stored_roots.push_back(get_root(instr.t1->get_name()));
+                } else if (instr.op_type == OpType::CALL) {
+                    const Operand& callee = instr.t1.has_value() ? instr.t1.value() : instr.t0.value();
+                    if (may_write_memory(callee.get_name())) {
+                        calls_writing_memory = true;
+                        for (auto& arg : instr.param_list.value_or(std::vector<Operand>())) {
+                            if (arg.is_name()) {
+                                passed_roots.insert(get_root(arg.get_name()).first);
+                            }
+                        }
+                    }
+                }
+                if (instr.t0.has_value() && instr.op_type != OpType::STORE && instr.t0->is_name()) {
+                    loop_defs.insert(instr.t0->get_name());
+                }
+            }
+        }
+
+        auto is_invariant = [&loop_defs](const std::optional<Operand>& op) {
+            return !op.has_value() || !op->is_name() || !loop_defs.count(op->get_name());
+        };
+        auto is_invariant_load = [&](const Instruction& instr, BasicBlock* block_ptr) {
+            Symbol address = instr.t1->get_name();
+            auto root = get_root(address);
+            if (address == root.first && root.second != AddressRoot::UNKNOWN) {
+                // a scalar, which has no other name
+                return !stored_names.count(address) && !(root.second == AddressRoot::GLOBAL && calls_writing_memory);
+            }
+            if (block_ptr != header) {
+                return false;
+            }
+            for (auto& stored_root : stored_roots) {
+                if (may_alias(root, stored_root)) {
+                    return false;
+                }
+            }
+            if (root.second == AddressRoot::LOCAL) {
+                return !passed_roots.count(root.first);
+            }
+            return !calls_writing_memory;
+        };
+
+        for (auto b : loop.body) {
+            BasicBlock* block_ptr = cfg.blocks[b];
+            std::vector<Instruction*> instrs;
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                const Instruction& instr = *instr_ptr;
+                bool hoistable = false;
+                if (is_hoistable_arithmetic(instr)) {
+                    hoistable = is_invariant(instr.t1) && is_invariant(instr.t2);
+                } else if (instr.op_type == OpType::LOAD) {
+                    hoistable = is_invariant(instr.t1) && is_invariant_load(instr, block_ptr);
+                }
+                if (hoistable) {
+                    loop_defs.erase(instr.t0->get_name());
+                    preheader->instruction_lists.push_back(instr_ptr);
+                } else {
+                    instrs.push_back(instr_ptr);
+                }
+            }
+            block_ptr->instruction_lists = std::move(instrs);
+        }
+    }
+};
+
+#endif //COMPILER_LICM_H
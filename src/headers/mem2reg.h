@@ -0,0 +1,417 @@
+#ifndef COMPILER_MEM2REG_H
+#define COMPILER_MEM2REG_H
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cfg.h"
+#include "function.h"
+
+#define SPLIT_BLOCK_BASENAME        "%split"
+
+// Promotes the scalar allocs that are only loaded from and stored to into SSA values, with
+// block parameters where different values of a variable meet:
+//     @x_0 = alloc i32                      ...
+//     store 0, @x_0                         jump %while_entry_0(0)
+//     jump %while_entry_0        ==>      %while_entry_0(%7: i32):
+//   %while_entry_0:                         %2 = lt %7, 10
+//     %1 = load @x_0                        ...
+//     %2 = lt %1, 10
+// Parameters are placed at the iterated dominance frontiers of the stores, then the loads are
+// renamed along the dominator tree. A variable read before any store reads 0.
+// Parameters that turn out to be unused, or bound to the same value on every edge, are removed.
+class Mem2Reg {
+public:
+    Mem2Reg(Function& _func, int& _temp_var): func(_func), temp_var(_temp_var) { }
+
+    void run() {
+        ControlFlowGraph::remove_unreachable_blocks(func);
+        find_promotable_allocs();
+        if (var_names.empty()) {
+            return;
+        }
+        split_critical_edges();
+        ControlFlowGraph cfg(func);
+        place_params(cfg);
+        var_stacks.assign(var_names.size(), {Operand(0)});
+        rename(cfg, 0);
+        remove_promoted_allocs();
+        remove_trivial_params();
+        remove_dead_params();
+        remove_bare_split_blocks();
+    }
+
+private:
+    Function& func;
+    int& temp_var;
+    std::vector<Symbol> var_names;
+    std::unordered_map<Symbol, size_t> var_index;
+    std::unordered_map<BasicBlock*, std::vector<size_t> > block_param_vars;  // the variable of each param
+    std::vector<std::vector<Operand> > var_stacks;  // the current value of each variable
+    std::unordered_map<Symbol, Operand> load_values;  // load result -> the value loaded
+    std::unordered_set<Symbol> split_block_names;
+
+    std::optional<size_t> get_var(const std::optional<Operand>& op) const {
+        if (!op.has_value() || !std::holds_alternative<Symbol>(op->assoc_val)) {
+            return std::nullopt;
+        }
+        auto it = var_index.find(std::get<Symbol>(op->assoc_val));
+        if (it == var_index.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    template <typename F>
+    void for_each_instr(F f) {
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                f(*instr_ptr);
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                f(*block_ptr->ending_instruction);
+            }
+        }
+    }
+
+    // i32 allocs whose address is only ever the source of a load or the destination of a store
+    void find_promotable_allocs() {
+        for (auto& instr_ptr : func.entry_block_ptr->instruction_lists) {
+            const Operand& alloc = instr_ptr->t0.value();
+            if (instr_ptr->op_type == OpType::ALLOC && alloc.type.pointed_type->type_enum == OperandTypeEnum::INT) {
+                var_index.emplace(std::get<Symbol>(alloc.assoc_val), var_names.size());
+                var_names.push_back(std::get<Symbol>(alloc.assoc_val));
+            }
+        }
+        std::unordered_set<Symbol> escaping;
+        for_each_instr([this, &escaping](Instruction& instr) {
+            if (instr.op_type == OpType::ALLOC) {
+                return;
+            }
+            instr.for_each_operand([this, &instr, &escaping](Operand& op) {
+                if (!get_var(op).has_value()) {
+                    return;
+                }
+                bool is_address = (instr.op_type == OpType::LOAD || instr.op_type == OpType::STORE)
+                                  && &op == &instr.t1.value();
+                if (!is_address) {
+                    escaping.insert(std::get<Symbol>(op.assoc_val));
+                }
+            });
+        });
+        if (escaping.empty()) {
+            return;
+        }
+        std::vector<Symbol> promotable;
+        for (auto& name : var_names) {
+            if (!escaping.count(name)) {
+                promotable.push_back(name);
+            }
+        }
+        var_names = promotable;
+        var_index.clear();
+        for (size_t i = 0; i < var_names.size(); i++) {
+            var_index.emplace(var_names[i], i);
+        }
+    }
+
+    // A block with several predecessors reached by a branch gets a block of its own on that
+    // edge, where the jump can carry the arguments (a br never does).
+    void split_critical_edges() {
+        std::unordered_map<Symbol, size_t> pred_num;
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& succ_name : ControlFlowGraph::get_successor_names(*block_ptr)) {
+                pred_num[succ_name]++;
+            }
+        }
+        auto& block_ptrs = func.basic_block_ptrs;
+        for (size_t i = 0; i < block_ptrs.size(); i++) {
+            Instruction* ending = block_ptrs[i]->ending_instruction;
+            if (ending == nullptr || ending->op_type != OpType::BR) {
+                continue;
+            }
+            for (auto target : {&ending->t1, &ending->t2}) {
+                if (pred_num[std::get<Symbol>((*target)->assoc_val)] < 2) {
+                    continue;
+                }
+                Symbol split_name = func.get_koopa_var_name(SPLIT_BLOCK_BASENAME);
+                auto split_block = ir_arena.make<BasicBlock>(split_name);
+                split_block->ending_instruction = ir_arena.make<Instruction>(OpType::JUMP, target->value());
+                *target = Operand(split_name, OperandTypeEnum::BLOCK);
+                split_block_names.insert(split_name);
+                block_ptrs.insert(block_ptrs.begin() + i + 1, split_block);
+            }
+        }
+    }
+
+    void place_params(const ControlFlowGraph& cfg) {
+        std::vector<std::vector<size_t> > def_blocks(var_names.size());
+        std::vector<bool> is_live_across_blocks(var_names.size(), false);
+        for (size_t b = 0; b < cfg.blocks.size(); b++) {
+            std::vector<bool> stored(var_names.size(), false);
+            for (auto& instr_ptr : cfg.blocks[b]->instruction_lists) {
+                if (instr_ptr->op_type == OpType::STORE) {
+                    auto var = get_var(instr_ptr->t1);
+                    if (var.has_value() && !stored[var.value()]) {
+                        stored[var.value()] = true;
+                        def_blocks[var.value()].push_back(b);
+                    }
+                } else if (instr_ptr->op_type == OpType::LOAD) {
+                    auto var = get_var(instr_ptr->t1);
+                    if (var.has_value() && !stored[var.value()]) {
+                        is_live_across_blocks[var.value()] = true;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<size_t> > frontiers = cfg.get_dominance_frontiers();
+        for (size_t var = 0; var < var_names.size(); var++) {
+            if (!is_live_across_blocks[var]) {
+                continue;  // every load follows a store in its own block
+            }
+            std::vector<bool> has_param(cfg.blocks.size(), false);
+            std::vector<size_t> worklist = def_blocks[var];
+            while (!worklist.empty()) {
+                size_t b = worklist.back();
+                worklist.pop_back();
+                for (auto frontier : frontiers[b]) {
+                    if (has_param[frontier]) {
+                        continue;
+                    }
+                    has_param[frontier] = true;
+                    BasicBlock* block_ptr = cfg.blocks[frontier];
+                    block_ptr->params.emplace_back(Symbol::temp(temp_var++));
+                    block_param_vars[block_ptr].push_back(var);
+                    worklist.push_back(frontier);
+                }
+            }
+        }
+    }
+
+    Operand resolve(const Operand& op) const {
+        if (std::holds_alternative<Symbol>(op.assoc_val)) {
+            auto it = load_values.find(std::get<Symbol>(op.assoc_val));
+            if (it != load_values.end()) {
+                return it->second;
+            }
+        }
+        return op;
+    }
+
+    void rename(const ControlFlowGraph& cfg, size_t b) {
+        BasicBlock* block_ptr = cfg.blocks[b];
+        std::vector<size_t> pushed;
+        auto& param_vars = block_param_vars[block_ptr];
+        for (size_t i = 0; i < param_vars.size(); i++) {
+            var_stacks[param_vars[i]].push_back(block_ptr->params[i]);
+            pushed.push_back(param_vars[i]);
+        }
+
+        std::vector<Instruction*> instrs;
+        for (auto& instr_ptr : block_ptr->instruction_lists) {
+            instr_ptr->for_each_operand([this](Operand& op) {
+                op = resolve(op);
+            });
+            auto var = get_var(instr_ptr->t1);
+            if (instr_ptr->op_type == OpType::LOAD && var.has_value()) {
+                load_values[std::get<Symbol>(instr_ptr->t0->assoc_val)] = var_stacks[var.value()].back();
+            } else if (instr_ptr->op_type == OpType::STORE && var.has_value()) {
+                var_stacks[var.value()].push_back(instr_ptr->t0.value());
+                pushed.push_back(var.value());
+            } else {
+                instrs.push_back(instr_ptr);
+            }
+        }
+        block_ptr->instruction_lists = std::move(instrs);
+
+        Instruction& ending = *block_ptr->ending_instruction;
+        ending.for_each_operand([this](Operand& op) {
+            op = resolve(op);
+        });
+        for (auto succ : cfg.successors[b]) {
+            auto& succ_param_vars = block_param_vars[cfg.blocks[succ]];
+            if (succ_param_vars.empty()) {
+                continue;
+            }
+            if (ending.op_type != OpType::JUMP) {
+                throw std::invalid_argument("Mem2Reg: a branch to a block with parameters!");
+            }
+            std::vector<Operand> args;
+            for (auto var : succ_param_vars) {
+                args.push_back(var_stacks[var].back());
+            }
+            ending.param_list = args;
+        }
+
+        for (auto child : cfg.dom_children[b]) {
+            rename(cfg, child);
+        }
+        for (auto var : pushed) {
+            var_stacks[var].pop_back();
+        }
+    }
+
+    void remove_promoted_allocs() {
+        auto& instrs = func.entry_block_ptr->instruction_lists;
+        instrs.erase(std::remove_if(instrs.begin(), instrs.end(), [this](auto& instr_ptr) {
+            return instr_ptr->op_type == OpType::ALLOC && get_var(instr_ptr->t0).has_value();
+        }), instrs.end());
+    }
+
+    // the jumps to each block, with the block they come from
+    std::unordered_map<Symbol, std::vector<Instruction*> > get_jumps_to_blocks() {
+        std::unordered_map<Symbol, std::vector<Instruction*> > jumps;
+        for (auto block_ptr : func.get_blocks()) {
+            Instruction* ending = block_ptr->ending_instruction;
+            if (ending != nullptr && ending->op_type == OpType::JUMP) {
+                jumps[std::get<Symbol>(ending->t0->assoc_val)].push_back(ending);
+            }
+        }
+        return jumps;
+    }
+
+    static void remove_param(BasicBlock& block, size_t idx, std::vector<Instruction*>& jumps) {
+        block.params.erase(block.params.begin() + idx);
+        for (auto jump : jumps) {
+            jump->param_list->erase(jump->param_list->begin() + idx);
+        }
+    }
+
+    // a param bound to one value on every edge (apart from itself) is that value
+    void remove_trivial_params() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            auto jumps = get_jumps_to_blocks();
+            std::unordered_map<Symbol, Operand> replaced;
+            for (auto block_ptr : func.get_blocks()) {
+                auto& block_jumps = jumps[block_ptr->basic_block_name];
+                for (size_t i = block_ptr->params.size(); i-- > 0;) {
+                    const Operand& param = block_ptr->params[i];
+                    std::optional<Operand> unique_value;
+                    bool is_trivial = true;
+                    for (auto jump : block_jumps) {
+                        const Operand& arg = jump->param_list.value()[i];
+                        if (arg.assoc_val == param.assoc_val) {
+                            continue;
+                        }
+                        if (unique_value.has_value() && unique_value->assoc_val != arg.assoc_val) {
+                            is_trivial = false;
+                            break;
+                        }
+                        unique_value = arg;
+                    }
+                    if (!is_trivial) {
+                        continue;
+                    }
+                    replaced.emplace(std::get<Symbol>(param.assoc_val), unique_value.value_or(Operand(0)));
+                    remove_param(*block_ptr, i, block_jumps);
+                    changed = true;
+                }
+            }
+            if (replaced.empty()) {
+                continue;
+            }
+            // a replacement may itself be replaced in the same round
+            auto resolve_replaced = [&replaced](Operand op) {
+                while (std::holds_alternative<Symbol>(op.assoc_val)) {
+                    auto it = replaced.find(std::get<Symbol>(op.assoc_val));
+                    if (it == replaced.end()) {
+                        break;
+                    }
+                    op = it->second;
+                }
+                return op;
+            };
+            for_each_instr([&resolve_replaced](Instruction& instr) {
+                instr.for_each_operand([&resolve_replaced](Operand& op) {
+                    op = resolve_replaced(op);
+                });
+            });
+        }
+    }
+
+    // a param is live when an instruction other than a jump uses it, or it is the argument
+    // of a live param
+    void remove_dead_params() {
+        std::unordered_map<Symbol, std::pair<BasicBlock*, size_t> > params;
+        for (auto block_ptr : func.get_blocks()) {
+            for (size_t i = 0; i < block_ptr->params.size(); i++) {
+                params.emplace(std::get<Symbol>(block_ptr->params[i].assoc_val), std::make_pair(block_ptr, i));
+            }
+        }
+        if (params.empty()) {
+            return;
+        }
+        std::unordered_set<Symbol> live;
+        std::vector<Symbol> worklist;
+        auto mark_live = [&params, &live, &worklist](const std::optional<Operand>& op) {
+            if (op.has_value() && std::holds_alternative<Symbol>(op->assoc_val)) {
+                Symbol name = std::get<Symbol>(op->assoc_val);
+                if (params.count(name) && live.insert(name).second) {
+                    worklist.push_back(name);
+                }
+            }
+        };
+        for_each_instr([&mark_live](Instruction& instr) {
+            mark_live(instr.t0);
+            mark_live(instr.t1);
+            mark_live(instr.t2);
+            if (instr.op_type != OpType::JUMP && instr.param_list.has_value()) {
+                for (auto& param : instr.param_list.value()) {
+                    mark_live(param);
+                }
+            }
+        });
+        auto jumps = get_jumps_to_blocks();
+        while (!worklist.empty()) {
+            auto [block_ptr, idx] = params.at(worklist.back());
+            worklist.pop_back();
+            for (auto jump : jumps[block_ptr->basic_block_name]) {
+                mark_live(jump->param_list.value()[idx]);
+            }
+        }
+        for (auto block_ptr : func.get_blocks()) {
+            for (size_t i = block_ptr->params.size(); i-- > 0;) {
+                if (!live.count(std::get<Symbol>(block_ptr->params[i].assoc_val))) {
+                    remove_param(*block_ptr, i, jumps[block_ptr->basic_block_name]);
+                }
+            }
+        }
+    }
+
+    // split blocks left with nothing to pass: the branch goes to the target again
+    void remove_bare_split_blocks() {
+        std::unordered_map<Symbol, Operand> targets;
+        auto& block_ptrs = func.basic_block_ptrs;
+        for (auto& block_ptr : block_ptrs) {
+            const auto& ending = block_ptr->ending_instruction;
+            if (split_block_names.count(block_ptr->basic_block_name)
+                && (!ending->param_list.has_value() || ending->param_list->empty())) {
+                targets.emplace(block_ptr->basic_block_name, ending->t0.value());
+            }
+        }
+        for (auto block_ptr : func.get_blocks()) {
+            Instruction* ending = block_ptr->ending_instruction;
+            if (ending == nullptr || ending->op_type != OpType::BR) {
+                continue;
+            }
+            for (auto target : {&ending->t1, &ending->t2}) {
+                auto it = targets.find(std::get<Symbol>((*target)->assoc_val));
+                if (it != targets.end()) {
+                    *target = it->second;
+                }
+            }
+        }
+        block_ptrs.erase(std::remove_if(block_ptrs.begin(), block_ptrs.end(), [&targets](auto& block_ptr) {
+            return targets.count(block_ptr->basic_block_name) > 0;
+        }), block_ptrs.end());
+    }
+};
+
+#endif //COMPILER_MEM2REG_H
@@ -0,0 +1,93 @@
+#ifndef COMPILER_OUTPUT_WRITER_H
+#define COMPILER_OUTPUT_WRITER_H
+
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// bytes formatted before they are handed to the stream
+#define OUTPUT_WRITER_BUFFER_SIZE   (1 << 16)
+
+
+/* The text output of the compiler, Koopa IR and RISC-V alike. Everything is formatted into one
+ * buffer, integers by std::to_chars, and written to the stream a buffer at a time: lines end
+ * with '\n' and are never flushed one by one, nor go through the locale of the stream.
+ * What is left in the buffer is written out by flush(), or when the writer is destroyed.
+ */
+class OutputWriter {
+public:
+    OutputWriter(std::ostream& _out): out(_out), buffer(OUTPUT_WRITER_BUFFER_SIZE) { }
+
+    OutputWriter(const OutputWriter&) = delete;
+
+    ~OutputWriter() {
+        flush();
+    }
+
+    OutputWriter& operator<<(std::string_view text) {
+        if (text.size() > buffer.size() - size) {
+            flush();
+            if (text.size() > buffer.size()) {
+                out.write(text.data(), std::streamsize(text.size()));
+                return *this;
+            }
+        }
+        std::memcpy(buffer.data() + size, text.data(), text.size());
+        size += text.size();
+        return *this;
+    }
+
+    OutputWriter& operator<<(const char* text) {
+        return *this << std::string_view(text);
+    }
+
+    OutputWriter& operator<<(const std::string& text) {
+        return *this << std::string_view(text);
+    }
+
+    OutputWriter& operator<<(char c) {
+        if (size == buffer.size()) {
+            flush();
+        }
+        buffer[size++] = c;
+        return *this;
+    }
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char>
+                                                     && !std::is_same_v<T, bool> > >
+    OutputWriter& operator<<(T value) {
+        // enough for any 64-bit integer and its sign
+        if (buffer.size() - size < 24) {
+            flush();
+        }
+        size = std::to_chars(buffer.data() + size, buffer.data() + buffer.size(), value).ptr - buffer.data();
+        return *this;
+    }
+
+    // text followed by spaces up to width, as std::setw(width) with std::left
+    OutputWriter& pad(std::string_view text, size_t width) {
+        *this << text;
+        for (size_t i = text.size(); i < width; i++) {
+            *this << ' ';
+        }
+        return *this;
+    }
+
+    void flush() {
+        if (size > 0) {
+            out.write(buffer.data(), std::streamsize(size));
+            size = 0;
+        }
+    }
+
+private:
+    std::ostream& out;
+    std::vector<char> buffer;
+    size_t size = 0;
+};
+
+#endif //COMPILER_OUTPUT_WRITER_H
@@ -0,0 +1,104 @@
+#ifndef COMPILER_PROGRAM_H
+#define COMPILER_PROGRAM_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "function.h"
+#include "global_decl.h"
+
+// A global declaration or a function, in the order of the source.
+class ProgramItem {
+public:
+    std::optional<GlobalDecl> global_decl;
+    std::unique_ptr<Function> func_ptr;
+};
+
+// The whole translation unit, kept so that functions can be transformed across each other
+// before anything is printed.
+class Program {
+public:
+    std::vector<ProgramItem> items;
+    std::unordered_map<Symbol, int> scalar_global_inits;  // e.g. "@x" -> 5 for "int x = 5;"
+    std::unordered_map<Symbol, Function*> function_by_ident;
+
+    void append_global_decl(GlobalDecl decl) {
+        ProgramItem item;
+        item.global_decl = std::move(decl);
+        items.push_back(std::move(item));
+    }
+
+    void append_function(std::unique_ptr<Function> func_ptr) {
+        function_by_ident[func_ptr->ident] = func_ptr.get();
+        ProgramItem item;
+        item.func_ptr = std::move(func_ptr);
+        items.push_back(std::move(item));
+    }
+
+    // in the order of definition, so every callee comes before its callers (except itself)
+    std::vector<Function*> get_functions() {
+        std::vector<Function*> funcs;
+        for (auto& item : items) {
+            if (item.func_ptr != nullptr) {
+                funcs.push_back(item.func_ptr.get());
+            }
+        }
+        return funcs;
+    }
+
+    Function* get_function_by_ident(Symbol ident) {
+        auto it = function_by_ident.find(ident);
+        return it == function_by_ident.end() ? nullptr : it->second;
+    }
+
+    // in one pass, keeping the order of the rest
+    void remove_functions(const std::unordered_set<const Function*>& func_ptrs) {
+        if (func_ptrs.empty()) {
+            return;
+        }
+        for (auto func_ptr : func_ptrs) {
+            function_by_ident.erase(func_ptr->ident);
+        }
+        items.erase(std::remove_if(items.begin(), items.end(), [&](const ProgramItem& item) {
+            return item.func_ptr != nullptr && func_ptrs.count(item.func_ptr.get()) > 0;
+        }), items.end());
+    }
+
+    void clear_items() {
+        items.clear();
+        function_by_ident.clear();
+    }
+
+    // the scalar globals no function stores to, which keep their initial values throughout
+    std::unordered_map<Symbol, int> get_constant_globals() {
+        std::unordered_map<Symbol, int> constant_globals = scalar_global_inits;
+        for (auto func_ptr : get_functions()) {
+            for (auto block_ptr : func_ptr->get_blocks()) {
+                for (auto& instr_ptr : block_ptr->instruction_lists) {
+                    if (instr_ptr->op_type == OpType::STORE) {
+                        constant_globals.erase(std::get<Symbol>(instr_ptr->t1->assoc_val));
+                    }
+                }
+            }
+        }
+        return constant_globals;
+    }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const Program& program) {
+        for (auto& item : program.items) {
+            if (item.func_ptr != nullptr) {
+                out << *item.func_ptr << '\n';
+            } else {
+                out << item.global_decl.value();
+            }
+            out << '\n';
+        }
+        return out;
+    }
+};
+
+#endif //COMPILER_PROGRAM_H
@@ -0,0 +1,78 @@
+#ifndef COMPILER_BRANCH_RELAX_H
+#define COMPILER_BRANCH_RELAX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "machine_instr.h"
+
+#define DUMMY_JUMP_BLOCK_BASENAME "dummy_jump_block"
+#define BRANCH_RANGE 4096  // B-type offsets are 13-bit signed
+
+// An upper bound of the bytes the assembler emits for the instruction.
+size_t estimate_instr_size(const MachineInstr& instr) {
+    switch (instr.opcode) {
+        case MachineOpcode::DIRECTIVE:
+        case MachineOpcode::LABEL:
+            return 0;
+        case MachineOpcode::LI:
+            return within_12(instr.imm) ? 4 : 8;  // lui + addi
+        case MachineOpcode::LA:
+        case MachineOpcode::CALL:
+        case MachineOpcode::TAIL:
+            return 8;  // auipc + addi / jalr
+        default:
+            return 4;
+    }
+}
+
+// A conditional branch reaches only +-4KiB, so in long functions a branch whose target may be
+// further away is turned into an inverted branch over a j, which reaches +-1MiB:
+//     bCC a, b, far        ==>     b!CC a, b, dummy_jump_blockN
+//                                  j    far
+//                                dummy_jump_blockN:
+// Sizes are overestimated, hence so are the distances. Rewriting a branch makes the code
+// longer, so repeat until nothing changes.
+void relax_branches(MachineInstrBuffer& buf, size_t& dummy_jump_block_cnt) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<size_t> addr(buf.instrs.size());
+        std::unordered_map<std::string, size_t> label_addr;
+        size_t pc = 0;
+        for (size_t i = 0; i < buf.instrs.size(); i++) {
+            addr[i] = pc;
+            if (buf.instrs[i].opcode == MachineOpcode::LABEL) {
+                label_addr[buf.instrs[i].symbol] = pc;
+            }
+            pc += estimate_instr_size(buf.instrs[i]);
+        }
+
+        std::vector<MachineInstr> relaxed;
+        for (size_t i = 0; i < buf.instrs.size(); i++) {
+            MachineInstr& instr = buf.instrs[i];
+            MachineInstrFormat format = instr.format();
+            bool is_cond_branch = format == MachineInstrFormat::REG_SYMBOL_BRANCH
+                                  || format == MachineInstrFormat::REG_REG_SYMBOL_BRANCH;
+            auto it = label_addr.find(instr.symbol);
+            if (!is_cond_branch || it == label_addr.end()) {
+                relaxed.push_back(instr);
+                continue;
+            }
+            long dist = long(it->second) - long(addr[i]);
+            if (dist >= -BRANCH_RANGE && dist < BRANCH_RANGE) {
+                relaxed.push_back(instr);
+                continue;
+            }
+            std::string skip_label = DUMMY_JUMP_BLOCK_BASENAME + std::to_string(dummy_jump_block_cnt++);
+            relaxed.emplace_back(invert_branch_opcode(instr.opcode), "", instr.rs1, instr.rs2, 0, skip_label);
+            relaxed.emplace_back(MachineOpcode::J, "", "", "", 0, instr.symbol);
+            relaxed.emplace_back(MachineOpcode::LABEL, "", "", "", 0, skip_label);
+            changed = true;
+        }
+        buf.instrs = std::move(relaxed);
+    }
+}
+
+#endif //COMPILER_BRANCH_RELAX_H
@@ -0,0 +1,120 @@
+#ifndef COMPILER_DATA_DIRECTIVE_H
+#define COMPILER_DATA_DIRECTIVE_H
+
+#include <cstdint>
+#include <unordered_set>
+
+#include "koopa.h"
+#include "headers/output_writer.h"
+
+// Prints the words of a global initializer, run-length encoded:
+//     0, 0, 0, 0       ==>   .zero 16
+//     7, 7, 7          ==>   .fill 3, 4, 7
+//     5                ==>   .word 5
+class DataDirectiveWriter {
+public:
+    DataDirectiveWriter(OutputWriter& _out): out(_out) { }
+
+    void append_word(int32_t value, size_t count = 1) {
+        if (count == 0) {
+            return;
+        }
+        if (run_count != 0 && run_value != value) {
+            flush();
+        }
+        run_value = value;
+        run_count += count;
+    }
+
+    void append_zero_bytes(size_t bytes) {
+        append_word(0, bytes / 4);
+    }
+
+    void flush() {
+        if (run_count == 0) {
+            return;
+        }
+        if (run_value == 0) {
+            out << "  .zero " << run_count * 4 << '\n';
+        } else if (run_count == 1) {
+            out << "  .word " << run_value << '\n';
+        } else {
+            out << "  .fill " << run_count << ", 4, " << run_value << '\n';
+        }
+        run_count = 0;
+    }
+
+private:
+    OutputWriter& out;
+    int32_t run_value = 0;
+    size_t run_count = 0;
+};
+
+// whether an initializer is zero everywhere, so that its global can go to .bss
+bool is_zero_initializer(const koopa_raw_value_t& init) {
+    switch (init->kind.tag) {
+        case KOOPA_RVT_ZERO_INIT:
+            return true;
+        case KOOPA_RVT_INTEGER:
+            return init->kind.data.integer.value == 0;
+        case KOOPA_RVT_AGGREGATE: {
+            auto& elems = init->kind.data.aggregate.elems;
+            for (size_t i = 0; i < elems.len; i++) {
+                if (!is_zero_initializer(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// whether the memory behind a pointer is only ever read: every user loads from it, derives another
+// pointer that is only ever read, or passes it to a block param that is only ever read (e.g. the
+// pointer a strength-reduced loop steps through); visited breaks the cycles through the loops
+bool is_read_only_pointer(const koopa_raw_value_t& ptr, std::unordered_set<koopa_raw_value_t>& visited) {
+    if (!visited.insert(ptr).second) {
+        return true;
+    }
+    for (size_t i = 0; i < ptr->used_by.len; i++) {
+        auto user = reinterpret_cast<koopa_raw_value_t>(ptr->used_by.buffer[i]);
+        switch (user->kind.tag) {
+            case KOOPA_RVT_LOAD:
+                break;
+            case KOOPA_RVT_GET_PTR:
+                if (user->kind.data.get_ptr.src != ptr || !is_read_only_pointer(user, visited)) {
+                    return false;
+                }
+                break;
+            case KOOPA_RVT_GET_ELEM_PTR:
+                if (user->kind.data.get_elem_ptr.src != ptr || !is_read_only_pointer(user, visited)) {
+                    return false;
+                }
+                break;
+            case KOOPA_RVT_JUMP: {
+                auto& args = user->kind.data.jump.args;
+                auto& params = user->kind.data.jump.target->params;
+                for (size_t j = 0; j < args.len; j++) {
+                    if (args.buffer[j] == ptr
+                        && !is_read_only_pointer(reinterpret_cast<koopa_raw_value_t>(params.buffer[j]), visited)) {
+                        return false;
+                    }
+                }
+                break;
+            }
+            default:
+                // stored to, stored somewhere or passed to a function
+                return false;
+        }
+    }
+    return true;
+}
+
+bool is_read_only_pointer(const koopa_raw_value_t& ptr) {
+    std::unordered_set<koopa_raw_value_t> visited;
+    return is_read_only_pointer(ptr, visited);
+}
+
+#endif //COMPILER_DATA_DIRECTIVE_H
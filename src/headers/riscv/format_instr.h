@@ -1,23 +1,33 @@
 #ifndef COMPILER_FORMAT_INSTR_H
 #define COMPILER_FORMAT_INSTR_H
 
-#include <iostream>
 #include <optional>
-#include <iomanip>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <utility>
+
+#include "headers/output_writer.h"
 
 #define INSTR_WIDTH 5
 
-void format_instr(std::ostream& out, const std::string& op_name, const std::string& t0,
-                  std::optional<std::string> t1 = std::nullopt,
-                  std::optional<std::string> t2 = std::nullopt) {
-    out << "  " << std::left << std::setw(INSTR_WIDTH) << op_name << " " << t0;
+// "  op_name " with op_name padded to INSTR_WIDTH, for the operands to follow
+OutputWriter& begin_instr(OutputWriter& out, std::string_view op_name) {
+    out << "  ";
+    return out.pad(op_name, INSTR_WIDTH) << ' ';
+}
+
+void format_instr(OutputWriter& out, std::string_view op_name, std::string_view t0,
+                  std::optional<std::string_view> t1 = std::nullopt,
+                  std::optional<std::string_view> t2 = std::nullopt) {
+    begin_instr(out, op_name) << t0;
     if (t1.has_value()) {
         out << ", " << t1.value();
     }
     if (t2.has_value()) {
         out << ", " << t2.value();
     }
-    out << std::endl;
+    out << '\n';
 }
 
 inline bool within_12(int x) {
@@ -28,8 +38,12 @@ inline bool is_positive_and_power_of_2(int x) {
     return (x > 0) && ((x & (x - 1)) == 0);
 }
 
-inline int log_2(int x) {
-    // WARNING: Use this only if you check is_positive_and_power_of_2.
+inline bool is_power_of_2(uint32_t x) {
+    return (x != 0) && ((x & (x - 1)) == 0);
+}
+
+inline int log_2(uint32_t x) {
+    // floor(log2(x)), exact when is_power_of_2(x)
     int res = 0;
     while (x > 1) {
         x = x >> 1;
@@ -38,97 +52,40 @@ inline int log_2(int x) {
     return res;
 }
 
-class InstructionPrinter {
-public:
-    std::ostream& out;
-    std::string reg;
-    InstructionPrinter(std::ostream& _out, std::string _reg): out(_out), reg(_reg) { }
-
-    void load_addr(std::string dst, std::string symbol) {
-        format_instr(out, "la", dst, symbol);
-    }
-
-    void load_word(std::string dst, std::string base_reg, int offset) {
-        if (within_12(offset)) {
-            format_instr(out, "lw", dst, std::to_string(offset) + "(" + base_reg + ")");
-        } else {
-            addi(reg, base_reg, offset);
-            format_instr(out, "lw", dst, "0(" + reg + ")");
-        }
-    }
-
-    void store_word(std::string src, std::string base_reg, int offset) {
-        if (within_12(offset)) {
-            format_instr(out, "sw", src, std::to_string(offset) + "(" + base_reg + ")");
-        } else {
-            addi(reg, base_reg, offset);
-            format_instr(out, "sw", src, "0(" + reg + ")");
-        }
-    }
-
-    void load_imm(std::string dst, int imm) {
-        format_instr(out, "li", dst, std::to_string(imm));
-    }
-
-    void addi(std::string dst, std::string src, int imm) {
-        if (within_12(imm)) {
-            format_instr(out, "addi", dst, src, std::to_string(imm));
-        } else {
-            load_imm(reg, imm);
-            format_instr(out, "add", dst, src, reg);
-        }
-    }
-
-    void slli(std::string dst, std::string src, int imm) {
-        format_instr(out, "slli", dst, src, std::to_string(imm));
-    }
-
-    void mul_imm(std::string dst, std::string src, int imm) {
-        if (is_positive_and_power_of_2(imm)) {
-            // use slli
-            slli(dst, src, log_2(imm));
-        } else {
-            // use mul
-            load_imm(reg, imm);
-            format_instr(out, "mul", dst, src, reg);
-        }
-    }
-
-    void mv(std::string dst, std::string src) {
-        if (dst != src) {
-            format_instr(out, "mv", dst, src);
-        }
-    }
 
-    void print_func_header(std::string func_name, size_t stack_frame_size, bool is_leaf_func) {
-        std::string name = func_name.substr(1);
-        out << "  .text" << std::endl;
-        out << "  .globl " << name << std::endl;
-        out << name << ":" << std::endl;
-
-        int offset = int(stack_frame_size);
-        // sp is callee-saved!
-        if (offset != 0) {
-            addi("sp", "sp", -offset);
-            if (!is_leaf_func) {
-                store_word("ra", "sp", offset - 4);
-            }
+// Magic number M and shift s such that for every 32-bit signed n,
+// n / d == (mulh(n, M) [+ n if d > 0 and M < 0] [- n if d < 0 and M > 0]) >> s, plus 1 if that is negative.
+// Valid for 2 <= |d|. See Hacker's Delight, 10-1.
+std::pair<int, int> signed_div_magic(int d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? -uint32_t(d) : uint32_t(d);
+    uint32_t t = two31 + (uint32_t(d) >> 31);
+    uint32_t anc = t - 1 - t % ad;  // |nc|
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
         }
-    }
-
-    void print_func_epilogue(size_t stack_frame_size, bool is_leaf_func) {
-        // sp is callee-saved!
-        int offset = int(stack_frame_size);
-        if (offset != 0) {
-            if (!is_leaf_func) {
-                load_word("ra", "sp", offset - 4);
-            }
-            addi("sp", "sp", offset);
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
         }
-        out << "  ret" << std::endl;
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    int magic = int(q2 + 1);
+    if (d < 0) {
+        magic = -magic;
     }
-};
-
-
+    return {magic, p - 32};
+}
 
 #endif //COMPILER_FORMAT_INSTR_H
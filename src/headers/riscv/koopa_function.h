@@ -1,10 +1,16 @@
 #ifndef COMPILER_KOOPA_FUNCTION_H
 #define COMPILER_KOOPA_FUNCTION_H
 
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "koopa.h"
+#include "liveness.h"
 #include "value.h"
 
 class KoopaFunction {
@@ -31,6 +37,221 @@ public:
         }
     }
 
+    // Orders the blocks reachable from the entry so that a block is followed by one of its
+    // successors whenever that successor has not been placed yet, which lets a jump or one side
+    // of a branch fall through. Unreachable blocks are not emitted at all.
+    void layout_basic_blocks() {
+        std::unordered_set<koopa_raw_basic_block_t> reachable;
+        std::vector<koopa_raw_basic_block_t> stack;
+        if (!koopa_basic_blocks.empty()) {
+            stack.push_back(koopa_basic_blocks.front());
+            reachable.insert(koopa_basic_blocks.front());
+        }
+        while (!stack.empty()) {
+            koopa_raw_basic_block_t bb = stack.back();
+            stack.pop_back();
+            for (auto& succ : get_block_successors(bb)) {
+                if (reachable.insert(succ).second) {
+                    stack.push_back(succ);
+                }
+            }
+        }
+
+        std::vector<koopa_raw_basic_block_t> layout;
+        std::unordered_set<koopa_raw_basic_block_t> placed;
+        for (auto& chain_head : koopa_basic_blocks) {
+            koopa_raw_basic_block_t bb = chain_head;
+            while (bb != nullptr && reachable.count(bb) && !placed.count(bb)) {
+                layout.push_back(bb);
+                placed.insert(bb);
+                koopa_raw_basic_block_t next = nullptr;
+                for (auto& succ : get_block_successors(bb)) {
+                    if (!placed.count(succ)) {
+                        next = succ;
+                        break;
+                    }
+                }
+                bb = next;
+            }
+        }
+        koopa_basic_blocks = layout;
+        for (size_t i = 0; i < koopa_basic_blocks.size(); i++) {
+            layout_index[koopa_basic_blocks[i]] = i;
+        }
+    }
+
+    std::unordered_map<koopa_raw_basic_block_t, size_t> layout_index;
+    koopa_raw_basic_block_t current_block = nullptr;  // the block being emitted
+
+    koopa_raw_basic_block_t get_next_block_in_layout(koopa_raw_basic_block_t bb) {
+        size_t idx = layout_index.at(bb);
+        return idx + 1 < koopa_basic_blocks.size() ? koopa_basic_blocks[idx + 1] : nullptr;
+    }
+
+    // Values that are not materialized because their only user computes them itself:
+    // compares fused into a branch and pointers folded into an address.
+    std::unordered_set<koopa_raw_value_t> inlined_values;
+
+    // A comparison used only by the branch ending its own block is not materialized:
+    // the branch compares the operands itself (blt/bge/beq/bne).
+    void find_fused_compares() {
+        for (auto& bb : koopa_basic_blocks) {
+            if (bb->insts.len < 2) {
+                continue;
+            }
+            auto terminator = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+            if (terminator->kind.tag != KOOPA_RVT_BRANCH) {
+                continue;
+            }
+            koopa_raw_value_t cond = terminator->kind.data.branch.cond;
+            if (cond->kind.tag != KOOPA_RVT_BINARY || !is_compare_op(cond->kind.data.binary.op)
+                || cond->used_by.len != 1) {
+                continue;
+            }
+            for (size_t j = 0; j + 1 < bb->insts.len; j++) {
+                if (reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]) == cond) {
+                    inlined_values.insert(cond);
+                    break;
+                }
+            }
+        }
+    }
+
+    // A getelemptr/getptr used only as the address of a load or store, or as the source of another
+    // getelemptr/getptr, in its own block is folded into that user. A whole chain such as
+    // a[i][j][k] then becomes one scaled-add sequence with the constant indices in the offset.
+    void find_folded_pointers() {
+        for (auto& bb : koopa_basic_blocks) {
+            std::unordered_set<koopa_raw_value_t> block_insts;
+            for (size_t j = 0; j < bb->insts.len; j++) {
+                block_insts.insert(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+            }
+            for (auto& ptr : block_insts) {
+                if ((ptr->kind.tag != KOOPA_RVT_GET_PTR && ptr->kind.tag != KOOPA_RVT_GET_ELEM_PTR)
+                    || ptr->used_by.len != 1) {
+                    continue;
+                }
+                auto user = reinterpret_cast<koopa_raw_value_t>(ptr->used_by.buffer[0]);
+                if (!block_insts.count(user)) {
+                    continue;
+                }
+                const auto& kind = user->kind;
+                bool is_address = false;
+                switch (kind.tag) {
+                    case KOOPA_RVT_LOAD:
+                        is_address = true;
+                        break;
+                    case KOOPA_RVT_STORE:
+                        is_address = kind.data.store.value != ptr;
+                        break;
+                    case KOOPA_RVT_GET_PTR:
+                        is_address = kind.data.get_ptr.index != ptr;
+                        break;
+                    case KOOPA_RVT_GET_ELEM_PTR:
+                        is_address = kind.data.get_elem_ptr.index != ptr;
+                        break;
+                    default:
+                        break;
+                }
+                if (is_address) {
+                    inlined_values.insert(ptr);
+                }
+            }
+        }
+    }
+
+    // A call is in tail position when the function returns its result right after it:
+    //     %r = call @f(...)         %r = call @f(...)
+    //     ret %r                    jump %end(%r)           %end(%x: i32):
+    //                                                         ret %x
+    // or, for void, when a bare ret (directly or behind a jump) follows. Such a call is lowered
+    // to a jump after the frame is torn down, so its arguments have to fit into registers and
+    // must not point into the frame. The instructions after it are never reached.
+    std::unordered_set<koopa_raw_value_t> tail_calls;
+    std::unordered_set<koopa_raw_value_t> after_tail_calls;
+    bool has_self_tail_call = false;
+
+    void find_tail_calls() {
+        bool has_local_array = false;
+        for (auto& value_ptr : koopa_value_ptrs) {
+            if (value_ptr->kind.tag == KOOPA_RVT_ALLOC && value_ptr->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
+                has_local_array = true;
+            }
+        }
+        auto get_inst = [](koopa_raw_basic_block_t bb, size_t idx) {
+            return reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[idx]);
+        };
+        // whether bb returns its only parameter, or returns nothing when it has none
+        auto is_return_block = [&get_inst](koopa_raw_basic_block_t bb) {
+            if (bb->insts.len != 1 || get_inst(bb, 0)->kind.tag != KOOPA_RVT_RETURN) {
+                return false;
+            }
+            koopa_raw_value_t ret_value = get_inst(bb, 0)->kind.data.ret.value;
+            if (bb->params.len == 0) {
+                return ret_value == nullptr;
+            }
+            return bb->params.len == 1 && ret_value == reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[0]);
+        };
+
+        for (auto& bb : koopa_basic_blocks) {
+            for (size_t j = 0; j < bb->insts.len; j++) {
+                koopa_raw_value_t call = get_inst(bb, j);
+                if (call->kind.tag != KOOPA_RVT_CALL || call->kind.data.call.args.len > 8) {
+                    continue;
+                }
+                bool escapes_frame = false;
+                for (size_t i = 0; i < call->kind.data.call.args.len; i++) {
+                    auto arg = reinterpret_cast<koopa_raw_value_t>(call->kind.data.call.args.buffer[i]);
+                    escapes_frame |= has_local_array && arg->ty->tag == KOOPA_RTT_POINTER;
+                }
+                if (escapes_frame) {
+                    continue;
+                }
+                bool result_used = call->used_by.len > 0;
+                size_t rest = bb->insts.len - j - 1;
+                bool is_tail = false;
+                if (rest == 1 && get_inst(bb, j + 1)->kind.tag == KOOPA_RVT_RETURN) {
+                    koopa_raw_value_t ret_value = get_inst(bb, j + 1)->kind.data.ret.value;
+                    is_tail = ret_value == nullptr ? !result_used : ret_value == call && call->used_by.len == 1;
+                } else if (rest == 1 && get_inst(bb, j + 1)->kind.tag == KOOPA_RVT_JUMP) {
+                    const koopa_raw_jump_t& jump = get_inst(bb, j + 1)->kind.data.jump;
+                    if (jump.args.len == 0) {
+                        is_tail = !result_used && is_return_block(jump.target);
+                    } else {
+                        is_tail = jump.args.len == 1 && reinterpret_cast<koopa_raw_value_t>(jump.args.buffer[0]) == call
+                                  && call->used_by.len == 1 && is_return_block(jump.target);
+                    }
+                }
+                if (!is_tail) {
+                    continue;
+                }
+                tail_calls.insert(call);
+                has_self_tail_call |= call->kind.data.call.callee == koopa_func_ptr;
+                for (size_t k = j + 1; k < bb->insts.len; k++) {
+                    after_tail_calls.insert(get_inst(bb, k));
+                }
+            }
+        }
+    }
+
+    bool is_tail_call(koopa_raw_value_t val_ptr) {
+        return tail_calls.count(val_ptr) > 0;
+    }
+
+    // where a self tail call jumps to: right after the prologue, before the arguments are moved
+    std::string get_tail_recursion_label() {
+        return std::string(koopa_func_ptr->name).substr(1) + "_tail_recursion";
+    }
+
+    bool is_fused_compare(koopa_raw_value_t val_ptr) {
+        return val_ptr->kind.tag == KOOPA_RVT_BINARY && inlined_values.count(val_ptr) > 0;
+    }
+
+    bool is_folded_pointer(koopa_raw_value_t val_ptr) {
+        return (val_ptr->kind.tag == KOOPA_RVT_GET_PTR || val_ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+               && inlined_values.count(val_ptr) > 0;
+    }
+
     std::optional<size_t> arg_num_max;
     size_t local_vars_size;  // temp_var_space_size
     // map the local_var to its index in the func, so that we can calculate the offset later
@@ -46,17 +267,65 @@ public:
         return !arg_num_max.has_value();
     }
 
+    // registers assigned by the RegisterAllocator; the other values live in local_var_map
+    std::unordered_map<koopa_raw_value_t, std::string> reg_map;
+    std::vector<std::string> callee_saved_regs;
+
+    std::optional<std::string> get_reg(koopa_raw_value_t val_ptr) {
+        auto it = reg_map.find(val_ptr);
+        if (it == reg_map.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    size_t get_extra_arg_size() {
+        return arg_num_max.value_or(0) > 8 ? 4 * (arg_num_max.value() - 8) : 0;
+    }
+
+    // Stack frame, from sp upwards:
+    //   outgoing arguments beyond the eighth | local variables | callee-saved registers | ra
     std::optional<size_t> stack_frame_size;
     size_t get_stack_frame_size() {
-        if (stack_frame_size.has_value()) {
-            return stack_frame_size.value();
-        } else {
-            size_t ra = is_leaf_function() ? 0 : 4;
-            size_t extra_arg_num = arg_num_max.value_or(0) > 8 ? 4 * (arg_num_max.value() - 8) : 0;
-            size_t offset = ra + local_vars_size + extra_arg_num;
-            size_t offset_aligned = ((offset + 15) / 16) * 16;
-            stack_frame_size = offset_aligned;
-            return stack_frame_size.value();
+        if (!stack_frame_size.has_value()) {
+            stack_frame_size = get_stack_frame_size(local_vars_size);
+        }
+        return stack_frame_size.value();
+    }
+
+    size_t get_stack_frame_size(size_t _local_vars_size) {
+        size_t ra = is_leaf_function() ? 0 : 4;
+        size_t offset = ra + 4 * callee_saved_regs.size() + _local_vars_size + get_extra_arg_size();
+        return ((offset + 15) / 16) * 16;
+    }
+
+    // the size local variables would take if every spilled value had a slot of its own
+    size_t unshared_local_vars_size = 0;
+
+    // Spilled values share a slot when their live intervals do not overlap: a linear scan over
+    // the intervals in order of their start, releasing the slots of the expired ones.
+    void assign_spill_slots(std::vector<LiveInterval> spilled) {
+        std::sort(spilled.begin(), spilled.end(), [](const LiveInterval& a, const LiveInterval& b) {
+            return a.start < b.start;
+        });
+        std::multimap<size_t, size_t> active;  // end -> slot offset
+        std::vector<size_t> free_slots;
+        for (auto& interval : spilled) {
+            while (!active.empty() && active.begin()->first < interval.start) {
+                free_slots.push_back(active.begin()->second);
+                active.erase(active.begin());
+            }
+            size_t slot;
+            if (free_slots.empty()) {
+                slot = local_vars_size;
+                local_vars_size += 4;
+            } else {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            local_var_map.emplace(interval.value, slot);
+            active.emplace(interval.end, slot);
+            unshared_local_vars_size += 4;
         }
     }
 
@@ -64,22 +333,14 @@ public:
         auto it = local_var_map.find(val_ptr);
         if (it == local_var_map.end()) {
             // Not in the local stack frame
-            // This is possibly because the value is not used.
-            // So we did not allocate stack space for this instruction.
+            // This is possibly because the value is not used, or it lives in a register.
             return std::nullopt;
         }
         size_t local_var_offset = it->second;
         bool is_pointer = val_ptr->ty->tag == KOOPA_RTT_POINTER;
         // if the instruction is alloc, we directly store the value in this space of stack
         is_pointer = (val_ptr->kind.tag != KOOPA_RVT_ALLOC) && is_pointer;
-        if (is_leaf_function()) {
-            // a leaf function does not have the ra field
-            return LocalVariable(get_stack_frame_size() - local_vars_size + local_var_offset,
-                                 is_pointer);
-        } else {
-            return LocalVariable(get_stack_frame_size() - local_vars_size - 4 + local_var_offset,
-                                 is_pointer);
-        }
+        return LocalVariable(get_extra_arg_size() + local_var_offset, is_pointer);
     }
 
     std::unordered_map<koopa_raw_basic_block_t, std::string> block_name_map;
@@ -93,7 +354,7 @@ public:
         return block_name_map[block];
     }
 
-    size_t size_of_koopa_type(const koopa_raw_type_t& type) {
+    static size_t size_of_koopa_type(const koopa_raw_type_t& type) {
         switch(type->tag) {
             case KOOPA_RTT_UNIT:
                 return 0;
@@ -111,13 +372,16 @@ public:
 
     void add_space_for_temp_var_in_stack(koopa_raw_value_t value_ptr) {
         local_var_map.emplace(value_ptr, local_vars_size);
+        size_t size;
         if (value_ptr->kind.tag == KOOPA_RVT_ALLOC) {
             // store an alloc pointer
-            local_vars_size += size_of_koopa_type(value_ptr->ty->data.pointer.base);
+            size = size_of_koopa_type(value_ptr->ty->data.pointer.base);
         } else {
             // for all other types, directly store them in stack
-            local_vars_size += size_of_koopa_type(value_ptr->ty);
+            size = size_of_koopa_type(value_ptr->ty);
         }
+        local_vars_size += size;
+        unshared_local_vars_size += size;
     }
 };
 
@@ -0,0 +1,300 @@
+#ifndef COMPILER_LIVENESS_H
+#define COMPILER_LIVENESS_H
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "koopa.h"
+
+// Instructions are numbered in layout order. Instruction i reads its operands at 2 * i and
+// writes its result at 2 * i + 1, so a result may reuse the register of an operand that dies
+// in the same instruction. The code generator therefore must read every operand register
+// before it writes the result register.
+#define FUNC_PARAM_DEF_POS 1
+#define FIRST_INSTR_POS 2
+
+class LiveInterval {
+public:
+    koopa_raw_value_t value;
+    size_t start;
+    size_t end;
+    bool crosses_call = false;
+    bool used = false;
+    std::optional<std::string> hint;  // register that saves a move if it is free
+    std::optional<std::string> reg;   // std::nullopt after allocation means spilled
+    LiveInterval(koopa_raw_value_t _value, size_t pos): value(_value), start(pos), end(pos) { }
+
+    void extend(size_t pos) {
+        start = std::min(start, pos);
+        end = std::max(end, pos);
+    }
+};
+
+std::vector<koopa_raw_value_t> get_value_operands(const koopa_raw_value_t& value_ptr) {
+    const auto& kind = value_ptr->kind;
+    std::vector<koopa_raw_value_t> operands;
+    auto append_slice = [&operands](const koopa_raw_slice_t& slice) {
+        for (size_t i = 0; i < slice.len; i++) {
+            operands.push_back(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+        }
+    };
+    switch (kind.tag) {
+        case KOOPA_RVT_LOAD:
+            operands.push_back(kind.data.load.src);
+            break;
+        case KOOPA_RVT_STORE:
+            operands.push_back(kind.data.store.value);
+            operands.push_back(kind.data.store.dest);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            operands.push_back(kind.data.get_ptr.src);
+            operands.push_back(kind.data.get_ptr.index);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            operands.push_back(kind.data.get_elem_ptr.src);
+            operands.push_back(kind.data.get_elem_ptr.index);
+            break;
+        case KOOPA_RVT_BINARY:
+            operands.push_back(kind.data.binary.lhs);
+            operands.push_back(kind.data.binary.rhs);
+            break;
+        case KOOPA_RVT_BRANCH:
+            operands.push_back(kind.data.branch.cond);
+            append_slice(kind.data.branch.true_args);
+            append_slice(kind.data.branch.false_args);
+            break;
+        case KOOPA_RVT_JUMP:
+            append_slice(kind.data.jump.args);
+            break;
+        case KOOPA_RVT_CALL:
+            append_slice(kind.data.call.args);
+            break;
+        case KOOPA_RVT_RETURN:
+            if (kind.data.ret.value != nullptr) {
+                operands.push_back(kind.data.ret.value);
+            }
+            break;
+        default:
+            break;
+    }
+    return operands;
+}
+
+std::vector<koopa_raw_basic_block_t> get_block_successors(const koopa_raw_basic_block_t& bb) {
+    if (bb->insts.len == 0) {
+        return {};
+    }
+    auto terminator = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+    switch (terminator->kind.tag) {
+        case KOOPA_RVT_BRANCH:
+            return {terminator->kind.data.branch.true_bb, terminator->kind.data.branch.false_bb};
+        case KOOPA_RVT_JUMP:
+            return {terminator->kind.data.jump.target};
+        default:
+            return {};
+    }
+}
+
+bool is_compare_op(koopa_raw_binary_op_t op) {
+    switch (op) {
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ:
+        case KOOPA_RBO_LT:
+        case KOOPA_RBO_GT:
+        case KOOPA_RBO_LE:
+        case KOOPA_RBO_GE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The values an instruction reads at its own position. An inlined value (a compare fused into
+// a branch, a pointer folded into an address) is computed by its user, so its operands are read
+// there instead, recursively for a folded chain.
+std::vector<koopa_raw_value_t> get_live_operands(const koopa_raw_value_t& value_ptr,
+                                                 const std::unordered_set<koopa_raw_value_t>& inlined_values) {
+    if (inlined_values.count(value_ptr)) {
+        return {};
+    }
+    std::vector<koopa_raw_value_t> operands;
+    std::vector<koopa_raw_value_t> worklist = get_value_operands(value_ptr);
+    while (!worklist.empty()) {
+        koopa_raw_value_t operand = worklist.back();
+        worklist.pop_back();
+        if (inlined_values.count(operand)) {
+            for (auto& inner : get_value_operands(operand)) {
+                worklist.push_back(inner);
+            }
+        } else {
+            operands.push_back(operand);
+        }
+    }
+    return operands;
+}
+
+// Values that live in a register (or in a spill slot when registers run out).
+// Allocs are stack objects addressed from sp, and arguments beyond the eighth already have
+// a home in the caller's frame.
+bool is_register_candidate(const koopa_raw_value_t& value_ptr) {
+    switch (value_ptr->kind.tag) {
+        case KOOPA_RVT_FUNC_ARG_REF:
+            return value_ptr->kind.data.func_arg_ref.index < 8;
+        case KOOPA_RVT_BLOCK_ARG_REF:
+        case KOOPA_RVT_LOAD:
+        case KOOPA_RVT_GET_PTR:
+        case KOOPA_RVT_GET_ELEM_PTR:
+        case KOOPA_RVT_BINARY:
+        case KOOPA_RVT_CALL:
+            return value_ptr->ty->tag != KOOPA_RTT_UNIT;
+        default:
+            return false;
+    }
+}
+
+// Classic liveness dataflow over the basic blocks, then one interval [first, last] per value
+// covering every point where it is live. The parameters of a block are defined where the block
+// starts; the jumps to it write them.
+std::vector<LiveInterval> compute_live_intervals(const koopa_raw_function_t& func,
+                                                 const std::vector<koopa_raw_basic_block_t>& blocks,
+                                                 const std::unordered_set<koopa_raw_value_t>& inlined_values) {
+    std::unordered_map<koopa_raw_value_t, size_t> value_index;
+    std::vector<LiveInterval> intervals;
+    auto add_candidate = [&](koopa_raw_value_t value_ptr, size_t def_pos) {
+        if (is_register_candidate(value_ptr) && !inlined_values.count(value_ptr)
+            && value_index.find(value_ptr) == value_index.end()) {
+            value_index.emplace(value_ptr, intervals.size());
+            intervals.emplace_back(value_ptr, def_pos);
+        }
+    };
+
+    for (size_t i = 0; i < func->params.len; i++) {
+        auto param = reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]);
+        add_candidate(param, FUNC_PARAM_DEF_POS);
+        auto it = value_index.find(param);
+        if (it != value_index.end()) {
+            intervals[it->second].hint = "a" + std::to_string(param->kind.data.func_arg_ref.index);
+        }
+    }
+
+    std::unordered_map<koopa_raw_basic_block_t, size_t> block_index;
+    std::vector<size_t> block_start, block_end;
+    std::vector<size_t> call_positions;
+    size_t pos = FIRST_INSTR_POS;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        block_index.emplace(blocks[b], b);
+        block_start.push_back(pos);
+        for (size_t j = 0; j < blocks[b]->params.len; j++) {
+            add_candidate(reinterpret_cast<koopa_raw_value_t>(blocks[b]->params.buffer[j]), pos);
+        }
+        for (size_t j = 0; j < blocks[b]->insts.len; j++) {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(blocks[b]->insts.buffer[j]);
+            add_candidate(inst, pos + 1);
+            if (inst->kind.tag == KOOPA_RVT_CALL) {
+                call_positions.push_back(pos);
+                auto it = value_index.find(inst);
+                if (it != value_index.end()) {
+                    intervals[it->second].hint = "a0";
+                }
+            }
+            pos += 2;
+        }
+        block_end.push_back(pos - 1);
+    }
+
+    size_t value_num = intervals.size();
+    std::vector<std::vector<bool>> use(blocks.size(), std::vector<bool>(value_num, false));
+    std::vector<std::vector<bool>> def(blocks.size(), std::vector<bool>(value_num, false));
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (size_t j = 0; j < blocks[b]->params.len; j++) {
+            auto it = value_index.find(reinterpret_cast<koopa_raw_value_t>(blocks[b]->params.buffer[j]));
+            if (it != value_index.end()) {
+                def[b][it->second] = true;
+            }
+        }
+        for (size_t j = 0; j < blocks[b]->insts.len; j++) {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(blocks[b]->insts.buffer[j]);
+            for (auto& operand : get_live_operands(inst, inlined_values)) {
+                auto it = value_index.find(operand);
+                if (it != value_index.end() && !def[b][it->second]) {
+                    use[b][it->second] = true;
+                }
+            }
+            auto it = value_index.find(inst);
+            if (it != value_index.end()) {
+                def[b][it->second] = true;
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> successors(blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (auto& succ : get_block_successors(blocks[b])) {
+            successors[b].push_back(block_index.at(succ));
+        }
+    }
+
+    std::vector<std::vector<bool>> live_in(blocks.size(), std::vector<bool>(value_num, false));
+    std::vector<std::vector<bool>> live_out(blocks.size(), std::vector<bool>(value_num, false));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = blocks.size(); b-- > 0;) {
+            for (auto succ : successors[b]) {
+                for (size_t v = 0; v < value_num; v++) {
+                    if (live_in[succ][v] && !live_out[b][v]) {
+                        live_out[b][v] = true;
+                    }
+                }
+            }
+            for (size_t v = 0; v < value_num; v++) {
+                bool in = use[b][v] || (live_out[b][v] && !def[b][v]);
+                if (in && !live_in[b][v]) {
+                    live_in[b][v] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (size_t v = 0; v < value_num; v++) {
+            if (live_in[b][v]) {
+                intervals[v].extend(block_start[b]);
+            }
+            if (live_out[b][v]) {
+                intervals[v].extend(block_end[b]);
+            }
+        }
+        size_t inst_pos = block_start[b];
+        for (size_t j = 0; j < blocks[b]->insts.len; j++, inst_pos += 2) {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(blocks[b]->insts.buffer[j]);
+            for (auto& operand : get_live_operands(inst, inlined_values)) {
+                auto it = value_index.find(operand);
+                if (it != value_index.end()) {
+                    intervals[it->second].extend(inst_pos);
+                    intervals[it->second].used = true;
+                }
+            }
+        }
+    }
+
+    // A value crosses a call when it is live both before and after it,
+    // i.e. it has to survive the caller-saved registers being clobbered.
+    std::vector<LiveInterval> result;
+    for (auto& interval : intervals) {
+        if (!interval.used) {
+            continue;
+        }
+        auto it = std::lower_bound(call_positions.begin(), call_positions.end(), interval.start);
+        interval.crosses_call = it != call_positions.end() && *it < interval.end;
+        result.push_back(interval);
+    }
+    return result;
+}
+
+#endif //COMPILER_LIVENESS_H
@@ -0,0 +1,546 @@
+#ifndef COMPILER_MACHINE_INSTR_H
+#define COMPILER_MACHINE_INSTR_H
+
+#include <string>
+#include <vector>
+
+#include "format_instr.h"
+
+enum class MachineOpcode {
+    DIRECTIVE,  // e.g. .text, printed verbatim
+    LABEL,
+
+    LI,
+    LA,
+    MV,
+    SEQZ,
+    SNEZ,
+    NEG,
+
+    LW,
+    SW,
+
+    ADD,
+    SUB,
+    MUL,
+    MULH,
+    DIV,
+    REM,
+    AND,
+    OR,
+    XOR,
+    SLT,
+    SLTU,
+    SLL,
+    SRL,
+    SRA,
+
+    ADDI,
+    ANDI,
+    ORI,
+    XORI,
+    SLTI,
+    SLTIU,
+    SLLI,
+    SRLI,
+    SRAI,
+
+    J,
+    BEQZ,
+    BNEZ,
+    BEQ,
+    BNE,
+    BLT,
+    BGE,
+    CALL,
+    TAIL,
+    RET,
+};
+
+enum class MachineInstrFormat {
+    DIRECTIVE,
+    LABEL,
+    REG_IMM,      // op rd, imm
+    REG_SYMBOL,   // op rd, symbol
+    REG_REG,      // op rd, rs1
+    LOAD,         // op rd, imm(rs1)
+    STORE,        // op rs2, imm(rs1)
+    REG_REG_REG,  // op rd, rs1, rs2
+    REG_REG_IMM,  // op rd, rs1, imm
+    SYMBOL,       // op symbol
+    REG_SYMBOL_BRANCH,  // op rs1, symbol
+    REG_REG_SYMBOL_BRANCH,  // op rs1, rs2, symbol
+    NONE,         // op
+};
+
+class MachineOpcodeInfo {
+public:
+    const char *name;
+    MachineInstrFormat format;
+};
+
+MachineOpcodeInfo get_opcode_info(MachineOpcode opcode) {
+    switch (opcode) {
+        case MachineOpcode::DIRECTIVE: return {"", MachineInstrFormat::DIRECTIVE};
+        case MachineOpcode::LABEL: return {"", MachineInstrFormat::LABEL};
+        case MachineOpcode::LI: return {"li", MachineInstrFormat::REG_IMM};
+        case MachineOpcode::LA: return {"la", MachineInstrFormat::REG_SYMBOL};
+        case MachineOpcode::MV: return {"mv", MachineInstrFormat::REG_REG};
+        case MachineOpcode::SEQZ: return {"seqz", MachineInstrFormat::REG_REG};
+        case MachineOpcode::SNEZ: return {"snez", MachineInstrFormat::REG_REG};
+        case MachineOpcode::NEG: return {"neg", MachineInstrFormat::REG_REG};
+        case MachineOpcode::LW: return {"lw", MachineInstrFormat::LOAD};
+        case MachineOpcode::SW: return {"sw", MachineInstrFormat::STORE};
+        case MachineOpcode::ADD: return {"add", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SUB: return {"sub", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::MUL: return {"mul", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::MULH: return {"mulh", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::DIV: return {"div", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::REM: return {"rem", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::AND: return {"and", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::OR: return {"or", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::XOR: return {"xor", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SLT: return {"slt", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SLTU: return {"sltu", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SLL: return {"sll", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SRL: return {"srl", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::SRA: return {"sra", MachineInstrFormat::REG_REG_REG};
+        case MachineOpcode::ADDI: return {"addi", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::ANDI: return {"andi", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::ORI: return {"ori", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::XORI: return {"xori", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::SLTI: return {"slti", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::SLTIU: return {"sltiu", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::SLLI: return {"slli", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::SRLI: return {"srli", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::SRAI: return {"srai", MachineInstrFormat::REG_REG_IMM};
+        case MachineOpcode::J: return {"j", MachineInstrFormat::SYMBOL};
+        case MachineOpcode::BEQZ: return {"beqz", MachineInstrFormat::REG_SYMBOL_BRANCH};
+        case MachineOpcode::BNEZ: return {"bnez", MachineInstrFormat::REG_SYMBOL_BRANCH};
+        case MachineOpcode::BEQ: return {"beq", MachineInstrFormat::REG_REG_SYMBOL_BRANCH};
+        case MachineOpcode::BNE: return {"bne", MachineInstrFormat::REG_REG_SYMBOL_BRANCH};
+        case MachineOpcode::BLT: return {"blt", MachineInstrFormat::REG_REG_SYMBOL_BRANCH};
+        case MachineOpcode::BGE: return {"bge", MachineInstrFormat::REG_REG_SYMBOL_BRANCH};
+        case MachineOpcode::CALL: return {"call", MachineInstrFormat::SYMBOL};
+        case MachineOpcode::TAIL: return {"tail", MachineInstrFormat::SYMBOL};
+        case MachineOpcode::RET: return {"ret", MachineInstrFormat::NONE};
+        default:
+            throw std::invalid_argument("get_opcode_info: unknown machine opcode!");
+    }
+}
+
+// The branch taken exactly when the given one is not.
+MachineOpcode invert_branch_opcode(MachineOpcode opcode) {
+    switch (opcode) {
+        case MachineOpcode::BEQZ: return MachineOpcode::BNEZ;
+        case MachineOpcode::BNEZ: return MachineOpcode::BEQZ;
+        case MachineOpcode::BEQ: return MachineOpcode::BNE;
+        case MachineOpcode::BNE: return MachineOpcode::BEQ;
+        case MachineOpcode::BLT: return MachineOpcode::BGE;
+        case MachineOpcode::BGE: return MachineOpcode::BLT;
+        default:
+            throw std::invalid_argument("invert_branch_opcode: not a conditional branch!");
+    }
+}
+
+class MachineInstr {
+public:
+    MachineOpcode opcode;
+    std::string rd;
+    std::string rs1;
+    std::string rs2;
+    int imm;
+    std::string symbol;  // label, global symbol, callee, or directive text
+    MachineInstr(MachineOpcode _opcode, std::string _rd = "", std::string _rs1 = "", std::string _rs2 = "",
+                 int _imm = 0, std::string _symbol = ""):
+            opcode(_opcode), rd(_rd), rs1(_rs1), rs2(_rs2), imm(_imm), symbol(_symbol) { }
+
+    MachineInstrFormat format() const {
+        return get_opcode_info(opcode).format;
+    }
+
+    // The register written by the instruction, if any. Calls are handled by the users.
+    std::string get_def() const {
+        switch (format()) {
+            case MachineInstrFormat::REG_IMM:
+            case MachineInstrFormat::REG_SYMBOL:
+            case MachineInstrFormat::REG_REG:
+            case MachineInstrFormat::LOAD:
+            case MachineInstrFormat::REG_REG_REG:
+            case MachineInstrFormat::REG_REG_IMM:
+                return rd;
+            default:
+                return "";
+        }
+    }
+
+    bool reads(const std::string& reg) const {
+        switch (format()) {
+            case MachineInstrFormat::REG_REG:
+            case MachineInstrFormat::LOAD:
+            case MachineInstrFormat::REG_REG_IMM:
+            case MachineInstrFormat::REG_SYMBOL_BRANCH:
+                return rs1 == reg;
+            case MachineInstrFormat::STORE:
+            case MachineInstrFormat::REG_REG_REG:
+            case MachineInstrFormat::REG_REG_SYMBOL_BRANCH:
+                return rs1 == reg || rs2 == reg;
+            default:
+                return false;
+        }
+    }
+
+    // Anything that ends straight-line code: control flow may enter or leave here.
+    bool is_barrier() const {
+        switch (format()) {
+            case MachineInstrFormat::DIRECTIVE:
+            case MachineInstrFormat::LABEL:
+            case MachineInstrFormat::SYMBOL:
+            case MachineInstrFormat::REG_SYMBOL_BRANCH:
+            case MachineInstrFormat::REG_REG_SYMBOL_BRANCH:
+            case MachineInstrFormat::NONE:
+                return true;
+            default:
+                return false;
+        }
+    }
+};
+
+OutputWriter& operator<<(OutputWriter& out, const MachineInstr& instr) {
+    MachineOpcodeInfo info = get_opcode_info(instr.opcode);
+    switch (info.format) {
+        case MachineInstrFormat::DIRECTIVE:
+            out << "  " << instr.symbol << '\n';
+            break;
+        case MachineInstrFormat::LABEL:
+            out << instr.symbol << ":\n";
+            break;
+        case MachineInstrFormat::REG_IMM:
+            begin_instr(out, info.name) << instr.rd << ", " << instr.imm << '\n';
+            break;
+        case MachineInstrFormat::REG_SYMBOL:
+            format_instr(out, info.name, instr.rd, instr.symbol);
+            break;
+        case MachineInstrFormat::REG_REG:
+            format_instr(out, info.name, instr.rd, instr.rs1);
+            break;
+        case MachineInstrFormat::LOAD:
+            begin_instr(out, info.name) << instr.rd << ", " << instr.imm << '(' << instr.rs1 << ")\n";
+            break;
+        case MachineInstrFormat::STORE:
+            begin_instr(out, info.name) << instr.rs2 << ", " << instr.imm << '(' << instr.rs1 << ")\n";
+            break;
+        case MachineInstrFormat::REG_REG_REG:
+            format_instr(out, info.name, instr.rd, instr.rs1, instr.rs2);
+            break;
+        case MachineInstrFormat::REG_REG_IMM:
+            begin_instr(out, info.name) << instr.rd << ", " << instr.rs1 << ", " << instr.imm << '\n';
+            break;
+        case MachineInstrFormat::SYMBOL:
+            format_instr(out, info.name, instr.symbol);
+            break;
+        case MachineInstrFormat::REG_SYMBOL_BRANCH:
+            format_instr(out, info.name, instr.rs1, instr.symbol);
+            break;
+        case MachineInstrFormat::REG_REG_SYMBOL_BRANCH:
+            format_instr(out, info.name, instr.rs1, instr.rs2, instr.symbol);
+            break;
+        case MachineInstrFormat::NONE:
+            out << "  " << info.name << '\n';
+            break;
+    }
+    return out;
+}
+
+// The instructions of one function, kept in memory until the peephole pass has run over them.
+class MachineInstrBuffer {
+public:
+    std::vector<MachineInstr> instrs;
+
+    void append(const MachineInstr& instr) {
+        instrs.push_back(instr);
+    }
+
+    void flush(OutputWriter& out) {
+        for (auto& instr : instrs) {
+            out << instr;
+        }
+        instrs.clear();
+    }
+};
+
+class InstructionPrinter {
+public:
+    MachineInstrBuffer& buf;
+    std::string reg;
+    InstructionPrinter(MachineInstrBuffer& _buf, std::string _reg): buf(_buf), reg(_reg) { }
+
+    void directive(std::string text) {
+        buf.append(MachineInstr(MachineOpcode::DIRECTIVE, "", "", "", 0, text));
+    }
+
+    void label(std::string name) {
+        buf.append(MachineInstr(MachineOpcode::LABEL, "", "", "", 0, name));
+    }
+
+    void load_addr(std::string dst, std::string symbol) {
+        buf.append(MachineInstr(MachineOpcode::LA, dst, "", "", 0, symbol));
+    }
+
+    void load_word(std::string dst, std::string base_reg, int offset) {
+        if (within_12(offset)) {
+            buf.append(MachineInstr(MachineOpcode::LW, dst, base_reg, "", offset));
+        } else {
+            addi(reg, base_reg, offset);
+            buf.append(MachineInstr(MachineOpcode::LW, dst, reg, "", 0));
+        }
+    }
+
+    void store_word(std::string src, std::string base_reg, int offset) {
+        if (within_12(offset)) {
+            buf.append(MachineInstr(MachineOpcode::SW, "", base_reg, src, offset));
+        } else {
+            addi(reg, base_reg, offset);
+            buf.append(MachineInstr(MachineOpcode::SW, "", reg, src, 0));
+        }
+    }
+
+    void load_imm(std::string dst, int imm) {
+        buf.append(MachineInstr(MachineOpcode::LI, dst, "", "", imm));
+    }
+
+    void addi(std::string dst, std::string src, int imm) {
+        if (within_12(imm)) {
+            buf.append(MachineInstr(MachineOpcode::ADDI, dst, src, "", imm));
+        } else {
+            load_imm(reg, imm);
+            binary(MachineOpcode::ADD, dst, src, reg);
+        }
+    }
+
+    void slli(std::string dst, std::string src, int imm) {
+        buf.append(MachineInstr(MachineOpcode::SLLI, dst, src, "", imm));
+    }
+
+    void binary_imm(MachineOpcode opcode, std::string dst, std::string src, int imm) {
+        buf.append(MachineInstr(opcode, dst, src, "", imm));
+    }
+
+    // dst = src * imm. Multipliers of the form +-2^a, +-(2^a + 2^b) and +-(2^a - 1) become
+    // shifts and adds; dst is written only after src has been read.
+    void mul_imm(std::string dst, std::string src, int imm) {
+        uint32_t abs_imm = imm < 0 ? -uint32_t(imm) : uint32_t(imm);
+        if (imm == 0) {
+            load_imm(dst, 0);
+            return;
+        }
+        if (is_power_of_2(abs_imm)) {
+            int shift = log_2(abs_imm);
+            if (shift == 0) {
+                mv(dst, src);
+            } else {
+                slli(dst, src, shift);
+            }
+        } else if (is_power_of_2(abs_imm & (abs_imm - 1)) || is_power_of_2(abs_imm + 1)) {
+            bool is_sum = is_power_of_2(abs_imm & (abs_imm - 1));
+            int high = is_sum ? log_2(abs_imm & (abs_imm - 1)) : log_2(abs_imm + 1);
+            slli(reg, src, high);
+            if (!is_sum) {
+                binary(MachineOpcode::SUB, dst, reg, src);
+            } else {
+                int low = log_2(abs_imm & -abs_imm);
+                if (low == 0) {
+                    binary(MachineOpcode::ADD, dst, reg, src);
+                } else {
+                    slli(dst, src, low);
+                    binary(MachineOpcode::ADD, dst, dst, reg);
+                }
+            }
+        } else {
+            // use mul
+            load_imm(reg, imm);
+            binary(MachineOpcode::MUL, dst, src, reg);
+            return;
+        }
+        if (imm < 0) {
+            unary(MachineOpcode::NEG, dst, dst);
+        }
+    }
+
+    // dst = src / imm with C semantics (truncation towards zero), without a div instruction
+    // when imm is a constant other than 0. Uses reg and tmp as scratch registers.
+    void div_imm(std::string dst, std::string src, int imm, std::string tmp) {
+        uint32_t abs_imm = imm < 0 ? -uint32_t(imm) : uint32_t(imm);
+        if (imm == 0) {
+            load_imm(reg, imm);
+            binary(MachineOpcode::DIV, dst, src, reg);
+        } else if (imm == 1) {
+            mv(dst, src);
+        } else if (imm == -1) {
+            unary(MachineOpcode::NEG, dst, src);
+        } else if (imm == INT32_MIN) {
+            // only INT32_MIN itself gives a non-zero quotient
+            load_imm(reg, imm);
+            binary(MachineOpcode::XOR, reg, src, reg);
+            unary(MachineOpcode::SEQZ, dst, reg);
+        } else if (is_power_of_2(abs_imm)) {
+            // round towards zero: add 2^k - 1 to negative dividends before shifting
+            int shift = log_2(abs_imm);
+            add_pow2_bias(reg, src, shift);
+            binary_imm(MachineOpcode::SRAI, dst, reg, shift);
+            if (imm < 0) {
+                unary(MachineOpcode::NEG, dst, dst);
+            }
+        } else {
+            div_by_magic(dst, src, imm, tmp);
+        }
+    }
+
+    // dst = src % imm with C semantics (the result has the sign of src).
+    // Uses reg and tmp as scratch registers.
+    void rem_imm(std::string dst, std::string src, int imm, std::string tmp) {
+        uint32_t abs_imm = imm < 0 ? -uint32_t(imm) : uint32_t(imm);
+        if (imm == 0 || imm == INT32_MIN) {
+            load_imm(reg, imm);
+            binary(MachineOpcode::REM, dst, src, reg);
+        } else if (imm == 1 || imm == -1) {
+            load_imm(dst, 0);
+        } else if (is_power_of_2(abs_imm)) {
+            // src - ((src + bias) & -2^k), where bias = 2^k - 1 for negative src, 0 otherwise
+            int shift = log_2(abs_imm);
+            add_pow2_bias(reg, src, shift);
+            int mask = -int(abs_imm);
+            if (within_12(mask)) {
+                binary_imm(MachineOpcode::ANDI, reg, reg, mask);
+            } else {
+                load_imm(tmp, mask);
+                binary(MachineOpcode::AND, reg, reg, tmp);
+            }
+            binary(MachineOpcode::SUB, dst, src, reg);
+        } else {
+            // src - (src / imm) * imm
+            div_by_magic(reg, src, imm, tmp);
+            load_imm(tmp, imm);
+            binary(MachineOpcode::MUL, reg, reg, tmp);
+            binary(MachineOpcode::SUB, dst, src, reg);
+        }
+    }
+
+    void mv(std::string dst, std::string src) {
+        if (dst != src) {
+            unary(MachineOpcode::MV, dst, src);
+        }
+    }
+
+    void unary(MachineOpcode opcode, std::string dst, std::string src) {
+        buf.append(MachineInstr(opcode, dst, src));
+    }
+
+    void binary(MachineOpcode opcode, std::string dst, std::string lhs, std::string rhs) {
+        buf.append(MachineInstr(opcode, dst, lhs, rhs));
+    }
+
+    void jump(std::string target) {
+        buf.append(MachineInstr(MachineOpcode::J, "", "", "", 0, target));
+    }
+
+    void branch_zero(MachineOpcode opcode, std::string src, std::string target) {
+        buf.append(MachineInstr(opcode, "", src, "", 0, target));
+    }
+
+    void branch(MachineOpcode opcode, std::string lhs, std::string rhs, std::string target) {
+        buf.append(MachineInstr(opcode, "", lhs, rhs, 0, target));
+    }
+
+    void call(std::string callee) {
+        buf.append(MachineInstr(MachineOpcode::CALL, "", "", "", 0, callee));
+    }
+
+    // a call that does not come back here: the callee returns to our caller
+    void tail(std::string callee) {
+        buf.append(MachineInstr(MachineOpcode::TAIL, "", "", "", 0, callee));
+    }
+
+private:
+    // dst = src + (src < 0 ? 2^shift - 1 : 0)
+    void add_pow2_bias(std::string dst, std::string src, int shift) {
+        if (shift == 1) {
+            binary_imm(MachineOpcode::SRLI, dst, src, 31);
+        } else {
+            binary_imm(MachineOpcode::SRAI, dst, src, 31);
+            binary_imm(MachineOpcode::SRLI, dst, dst, 32 - shift);
+        }
+        binary(MachineOpcode::ADD, dst, dst, src);
+    }
+
+    // Signed division by a constant with 2 <= |imm| via a multiply-high (Hacker's Delight, 10-1).
+    // The quotient is accumulated in reg; dst is written last.
+    void div_by_magic(std::string dst, std::string src, int imm, std::string tmp) {
+        auto [magic, shift] = signed_div_magic(imm);
+        load_imm(reg, magic);
+        binary(MachineOpcode::MULH, reg, src, reg);
+        if (imm > 0 && magic < 0) {
+            binary(MachineOpcode::ADD, reg, reg, src);
+        } else if (imm < 0 && magic > 0) {
+            binary(MachineOpcode::SUB, reg, reg, src);
+        }
+        if (shift > 0) {
+            binary_imm(MachineOpcode::SRAI, reg, reg, shift);
+        }
+        // add 1 to negative quotients to truncate towards zero
+        binary_imm(MachineOpcode::SRLI, tmp, reg, 31);
+        binary(MachineOpcode::ADD, dst, reg, tmp);
+    }
+
+public:
+    // ra sits at the top of the frame, followed downwards by the saved callee-saved registers.
+    void print_func_header(std::string func_name, size_t stack_frame_size, bool is_leaf_func,
+                           const std::vector<std::string>& callee_saved_regs = {}) {
+        std::string name = func_name.substr(1);
+        directive(".text");
+        directive(".globl " + name);
+        label(name);
+
+        int offset = int(stack_frame_size);
+        // sp is callee-saved!
+        if (offset != 0) {
+            addi("sp", "sp", -offset);
+            int slot = offset;
+            if (!is_leaf_func) {
+                slot -= 4;
+                store_word("ra", "sp", slot);
+            }
+            for (auto& saved_reg : callee_saved_regs) {
+                slot -= 4;
+                store_word(saved_reg, "sp", slot);
+            }
+        }
+    }
+
+    void print_func_epilogue(size_t stack_frame_size, bool is_leaf_func,
+                             const std::vector<std::string>& callee_saved_regs = {}) {
+        print_frame_teardown(stack_frame_size, is_leaf_func, callee_saved_regs);
+        buf.append(MachineInstr(MachineOpcode::RET));
+    }
+
+    // Restores what the header saved and pops the frame, everything of the epilogue but ret.
+    void print_frame_teardown(size_t stack_frame_size, bool is_leaf_func,
+                              const std::vector<std::string>& callee_saved_regs = {}) {
+        // sp is callee-saved!
+        int offset = int(stack_frame_size);
+        if (offset != 0) {
+            int slot = offset;
+            if (!is_leaf_func) {
+                slot -= 4;
+                load_word("ra", "sp", slot);
+            }
+            for (auto& saved_reg : callee_saved_regs) {
+                slot -= 4;
+                load_word(saved_reg, "sp", slot);
+            }
+            addi("sp", "sp", offset);
+        }
+    }
+};
+
+#endif //COMPILER_MACHINE_INSTR_H
@@ -0,0 +1,159 @@
+#ifndef COMPILER_PEEPHOLE_H
+#define COMPILER_PEEPHOLE_H
+
+#include <map>
+#include <vector>
+
+#include "machine_instr.h"
+
+// The scratch registers never carry a value across a label, a jump or a call,
+// see register.h.
+inline bool is_scratch_reg(const std::string& reg) {
+    return reg == "t0" || reg == "t1" || reg == "t2";
+}
+
+// Whether reg is dead right after instrs[idx].
+bool is_reg_dead_after(const std::vector<MachineInstr>& instrs, size_t idx, const std::string& reg) {
+    for (size_t i = idx + 1; i < instrs.size(); i++) {
+        if (instrs[i].reads(reg)) {
+            return false;
+        }
+        if (instrs[i].get_def() == reg) {
+            return true;
+        }
+        if (instrs[i].is_barrier()) {
+            return is_scratch_reg(reg);
+        }
+    }
+    return true;
+}
+
+// sw rs, off(base) ... lw rd, off(base)  ==>  sw rs, off(base) ... mv rd, rs
+// The same holds for a second load from a slot that has already been loaded.
+// Word accesses through the same base at different offsets never overlap; a store through
+// any other base may alias, and so may everything across a label or a call.
+bool forward_stored_values(std::vector<MachineInstr>& instrs) {
+    bool changed = false;
+    std::map<std::pair<std::string, int>, std::string> known_slots;  // (base, offset) -> register
+    auto invalidate_reg = [&known_slots](const std::string& reg) {
+        for (auto it = known_slots.begin(); it != known_slots.end();) {
+            if (it->first.first == reg || it->second == reg) {
+                it = known_slots.erase(it);
+            } else {
+                it++;
+            }
+        }
+    };
+
+    for (auto& instr : instrs) {
+        if (instr.is_barrier()) {
+            known_slots.clear();
+            continue;
+        }
+        if (instr.opcode == MachineOpcode::SW) {
+            for (auto it = known_slots.begin(); it != known_slots.end();) {
+                if (it->first.first != instr.rs1 || it->first.second == instr.imm) {
+                    it = known_slots.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            known_slots[{instr.rs1, instr.imm}] = instr.rs2;
+            continue;
+        }
+        if (instr.opcode == MachineOpcode::LW) {
+            auto it = known_slots.find({instr.rs1, instr.imm});
+            std::pair<std::string, int> slot = {instr.rs1, instr.imm};
+            if (it != known_slots.end()) {
+                std::string src = it->second;
+                instr = MachineInstr(MachineOpcode::MV, instr.rd, src);
+                changed = true;
+                invalidate_reg(instr.rd);
+                if (instr.rd != slot.first) {
+                    known_slots[slot] = src;
+                }
+            } else {
+                invalidate_reg(instr.rd);
+                if (instr.rd != slot.first) {
+                    known_slots[slot] = instr.rd;
+                }
+            }
+            continue;
+        }
+        std::string def = instr.get_def();
+        if (!def.empty()) {
+            invalidate_reg(def);
+        }
+    }
+    return changed;
+}
+
+// li rt, imm; add rd, rs, rt  ==>  addi rd, rs, imm  when rt dies there
+bool fold_load_imm_into_add(std::vector<MachineInstr>& instrs) {
+    bool changed = false;
+    for (size_t i = 0; i + 1 < instrs.size(); i++) {
+        MachineInstr& li = instrs[i];
+        MachineInstr& add = instrs[i + 1];
+        if (li.opcode != MachineOpcode::LI || add.opcode != MachineOpcode::ADD || !within_12(li.imm)) {
+            continue;
+        }
+        if ((add.rs1 == li.rd) == (add.rs2 == li.rd)) {
+            continue;
+        }
+        if (add.rd != li.rd && !is_reg_dead_after(instrs, i + 1, li.rd)) {
+            continue;
+        }
+        std::string src = add.rs1 == li.rd ? add.rs2 : add.rs1;
+        add = MachineInstr(MachineOpcode::ADDI, add.rd, src, "", li.imm);
+        li = MachineInstr(MachineOpcode::MV, li.rd, li.rd);  // removed below
+        changed = true;
+    }
+    return changed;
+}
+
+// j label; label:  ==>  label:
+bool remove_jump_to_next(std::vector<MachineInstr>& instrs) {
+    bool changed = false;
+    for (size_t i = 0; i < instrs.size(); i++) {
+        if (instrs[i].opcode != MachineOpcode::J) {
+            continue;
+        }
+        for (size_t j = i + 1; j < instrs.size() && instrs[j].opcode == MachineOpcode::LABEL; j++) {
+            if (instrs[j].symbol == instrs[i].symbol) {
+                instrs[i] = MachineInstr(MachineOpcode::MV, "zero", "zero");  // removed below
+                changed = true;
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+bool remove_self_moves(std::vector<MachineInstr>& instrs) {
+    size_t kept = 0;
+    for (size_t i = 0; i < instrs.size(); i++) {
+        if (instrs[i].opcode == MachineOpcode::MV && instrs[i].rd == instrs[i].rs1) {
+            continue;
+        }
+        if (kept != i) {
+            instrs[kept] = std::move(instrs[i]);
+        }
+        kept++;
+    }
+    bool changed = kept != instrs.size();
+    instrs.erase(instrs.begin() + kept, instrs.end());
+    return changed;
+}
+
+void run_peephole(MachineInstrBuffer& buf) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        changed |= forward_stored_values(buf.instrs);
+        changed |= fold_load_imm_into_add(buf.instrs);
+        changed |= remove_jump_to_next(buf.instrs);
+        changed |= remove_self_moves(buf.instrs);
+    }
+}
+
+#endif //COMPILER_PEEPHOLE_H
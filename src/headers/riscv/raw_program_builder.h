@@ -0,0 +1,481 @@
+#ifndef COMPILER_RAW_PROGRAM_BUILDER_H
+#define COMPILER_RAW_PROGRAM_BUILDER_H
+
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+#include "headers/program.h"
+
+/* Lowers a Program to the raw program the backend visits, the same one libkoopa would build
+ * from the text of the program, without printing the text and parsing it again. As in
+ * libkoopa, every integer operand is a value of its own, and the used_by of a value lists each
+ * of its users once.
+ * The raw program belongs to the builder. A program may also be built a few items at a time
+ * (see the -stream option): the functions and globals built before stay visible to later
+ * builds, while everything else a build makes is released by the next one.
+ */
+class RawProgramBuilder {
+public:
+    RawProgramBuilder(const std::vector<Signature>& lib_signatures) {
+        for (auto& signature : lib_signatures) {
+            lib_funcs.push_back(declare_function(signature.koopa_ident.prefixed("@"), signature.param_types, signature.func_type));
+        }
+    }
+
+    koopa_raw_program_t build(Program& program) {
+        scratch = Storage();
+        value_users.clear();
+        block_users.clear();
+        for (auto global : used_globals) {
+            // its users from the last build are gone, and its initializer is not visited again
+            global->used_by = make_slice({}, KOOPA_RSIK_VALUE);
+        }
+        used_globals.clear();
+
+        std::vector<const void*> global_values;
+        std::vector<const void*> funcs = std::move(lib_funcs);  // declared in the first build only
+        lib_funcs.clear();
+        for (auto& item : program.items) {
+            if (item.global_decl.has_value()) {
+                global_values.push_back(build_global(item.global_decl.value()));
+            } else {
+                std::vector<OperandType> param_types;
+                for (auto& param : item.func_ptr->param_list) {
+                    param_types.push_back(param.type);
+                }
+                funcs.push_back(declare_function(item.func_ptr->ident.prefixed("@"), param_types, item.func_ptr->func_type));
+            }
+        }
+        // every function is declared first, so that a call may come before the callee
+        for (auto func_ptr : program.get_functions()) {
+            build_body(*func_ptr, function_by_name.at(func_ptr->ident.prefixed("@")));
+        }
+
+        for (auto& [value, users] : value_users) {
+            value->used_by = make_slice(users, KOOPA_RSIK_VALUE);
+            if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+                used_globals.push_back(value);
+            }
+        }
+        for (auto& [block, users] : block_users) {
+            block->used_by = make_slice(users, KOOPA_RSIK_VALUE);
+        }
+        koopa_raw_program_t raw;
+        raw.values = make_slice(global_values, KOOPA_RSIK_VALUE);
+        raw.funcs = make_slice(funcs, KOOPA_RSIK_FUNCTION);
+        return raw;
+    }
+
+private:
+    // what a build makes, released at once
+    class Storage {
+    public:
+        std::deque<koopa_raw_value_data_t> values;
+        std::deque<koopa_raw_basic_block_data_t> blocks;
+        std::deque<std::vector<const void*> > slice_buffers;
+        std::deque<std::string> names;
+    };
+
+    Storage kept;  // the globals and the declarations of the functions
+    Storage scratch;  // the rest of the last build
+    Storage* storage = &scratch;  // where new values, blocks, slices and names go
+    std::deque<koopa_raw_type_kind_t> types;
+    std::deque<koopa_raw_function_data_t> functions;
+    std::vector<const void*> lib_funcs;
+
+    koopa_raw_type_t int_type = nullptr;
+    koopa_raw_type_t unit_type = nullptr;
+    std::unordered_map<koopa_raw_type_t, koopa_raw_type_t> pointer_types;  // base -> *base
+    std::map<std::pair<koopa_raw_type_t, size_t>, koopa_raw_type_t> array_types;  // (base, len) -> [base, len]
+
+    std::unordered_map<Symbol, koopa_raw_function_data_t*> function_by_name;
+    std::unordered_map<Symbol, koopa_raw_value_data_t*> global_by_name;
+    std::vector<koopa_raw_value_data_t*> used_globals;  // those given users by the last build
+    std::unordered_map<koopa_raw_value_data_t*, std::vector<const void*> > value_users;
+    std::unordered_map<koopa_raw_basic_block_data_t*, std::vector<const void*> > block_users;
+
+    // those of the function being built
+    std::unordered_map<Symbol, koopa_raw_value_data_t*> value_by_name;
+    std::unordered_map<Symbol, koopa_raw_basic_block_data_t*> block_by_name;
+    std::unordered_map<Symbol, const Instruction*> defs;
+
+    koopa_raw_slice_t make_slice(const std::vector<const void*>& items, koopa_raw_slice_item_kind_t kind) {
+        koopa_raw_slice_t slice;
+        slice.buffer = nullptr;
+        slice.len = uint32_t(items.size());
+        slice.kind = kind;
+        if (!items.empty()) {
+            storage->slice_buffers.push_back(items);
+            slice.buffer = storage->slice_buffers.back().data();
+        }
+        return slice;
+    }
+
+    const char* keep_name(Symbol name) {
+        storage->names.push_back(name.str());
+        return storage->names.back().c_str();
+    }
+
+    koopa_raw_type_t get_int_type() {
+        if (int_type == nullptr) {
+            types.emplace_back();
+            types.back().tag = KOOPA_RTT_INT32;
+            int_type = &types.back();
+        }
+        return int_type;
+    }
+
+    koopa_raw_type_t get_unit_type() {
+        if (unit_type == nullptr) {
+            types.emplace_back();
+            types.back().tag = KOOPA_RTT_UNIT;
+            unit_type = &types.back();
+        }
+        return unit_type;
+    }
+
+    koopa_raw_type_t get_pointer_type(koopa_raw_type_t base) {
+        auto it = pointer_types.find(base);
+        if (it != pointer_types.end()) {
+            return it->second;
+        }
+        types.emplace_back();
+        types.back().tag = KOOPA_RTT_POINTER;
+        types.back().data.pointer.base = base;
+        pointer_types.emplace(base, &types.back());
+        return &types.back();
+    }
+
+    koopa_raw_type_t get_array_type(koopa_raw_type_t base, size_t len) {
+        auto it = array_types.find({base, len});
+        if (it != array_types.end()) {
+            return it->second;
+        }
+        types.emplace_back();
+        types.back().tag = KOOPA_RTT_ARRAY;
+        types.back().data.array.base = base;
+        types.back().data.array.len = len;
+        array_types.emplace(std::make_pair(base, len), &types.back());
+        return &types.back();
+    }
+
+    koopa_raw_type_t get_type(const OperandType& type) {
+        switch (type.type_enum) {
+            case OperandTypeEnum::INT:
+                return get_int_type();
+            case OperandTypeEnum::POINTER:
+                return get_pointer_type(get_type(*type.pointed_type));
+            case OperandTypeEnum::ARRAY:
+                return get_array_type(get_type(*type.pointed_type), type.array_len);
+            default:
+                throw std::invalid_argument("RawProgramBuilder::get_type: unexpected OperandTypeEnum!");
+        }
+    }
+
+    koopa_raw_value_data_t* new_value(koopa_raw_value_tag_t tag, koopa_raw_type_t ty, const char* name = nullptr) {
+        storage->values.emplace_back();
+        koopa_raw_value_data_t* value = &storage->values.back();
+        value->ty = ty;
+        value->name = name;
+        value->used_by = make_slice({}, KOOPA_RSIK_VALUE);
+        value->kind.tag = tag;
+        return value;
+    }
+
+    koopa_raw_function_data_t* declare_function(Symbol name, const std::vector<OperandType>& param_types,
+                                                FuncType func_type) {
+        storage = &kept;
+        std::vector<const void*> param_tys;
+        for (auto& param_type : param_types) {
+            param_tys.push_back(get_type(param_type));
+        }
+        types.emplace_back();
+        types.back().tag = KOOPA_RTT_FUNCTION;
+        types.back().data.function.params = make_slice(param_tys, KOOPA_RSIK_TYPE);
+        types.back().data.function.ret = func_type == FuncType::INT ? get_int_type() : get_unit_type();
+
+        functions.emplace_back();
+        koopa_raw_function_data_t* func = &functions.back();
+        func->ty = &types.back();
+        func->name = keep_name(name);
+        func->params = make_slice({}, KOOPA_RSIK_VALUE);
+        func->bbs = make_slice({}, KOOPA_RSIK_BASIC_BLOCK);
+        function_by_name.emplace(name, func);
+        storage = &scratch;
+        return func;
+    }
+
+    // the elements of [begin, begin + the size of type) as Array prints them, zeroinit for zeros
+    koopa_raw_value_t build_initializer(const Array& init, const OperandType& type, size_t begin) {
+        if (type.type_enum == OperandTypeEnum::INT) {
+            koopa_raw_value_data_t* value = new_value(KOOPA_RVT_INTEGER, get_int_type());
+            value->kind.data.integer.value = init.get(begin);
+            return value;
+        }
+        size_t stride = 1;
+        for (auto len : type.pointed_type->get_array_dim()) {
+            stride *= len;
+        }
+        if (init.is_zero(begin, begin + stride * type.array_len)) {
+            return new_value(KOOPA_RVT_ZERO_INIT, get_type(type));
+        }
+        std::vector<const void*> elems;
+        for (size_t i = 0; i < type.array_len; i++) {
+            elems.push_back(build_initializer(init, *type.pointed_type, begin + i * stride));
+        }
+        koopa_raw_value_data_t* value = new_value(KOOPA_RVT_AGGREGATE, get_type(type));
+        value->kind.data.aggregate.elems = make_slice(elems, KOOPA_RSIK_VALUE);
+        return value;
+    }
+
+    koopa_raw_value_t build_global(const GlobalDecl& decl) {
+        koopa_raw_value_t init = decl.init != nullptr ? build_initializer(*decl.init, decl.type, 0)
+                                                      : new_value(KOOPA_RVT_ZERO_INIT, get_type(decl.type));
+        storage = &kept;
+        koopa_raw_value_data_t* value = new_value(KOOPA_RVT_GLOBAL_ALLOC,
+                                                  get_pointer_type(get_type(decl.type)),
+                                                  keep_name(decl.koopa_var_name));
+        value->kind.data.global_alloc.init = init;
+        global_by_name.emplace(decl.koopa_var_name, value);
+        storage = &scratch;
+        return value;
+    }
+
+    koopa_raw_value_data_t* get_named_value(Symbol name) {
+        auto it = value_by_name.find(name);
+        if (it != value_by_name.end()) {
+            return it->second;
+        }
+        auto global_it = global_by_name.find(name);
+        if (global_it == global_by_name.end()) {
+            throw std::invalid_argument("RawProgramBuilder: undefined value " + name.str());
+        }
+        return global_it->second;
+    }
+
+    // the type of a value is only known from its operands, which may be defined in a later block
+    koopa_raw_type_t get_value_type(Symbol name) {
+        koopa_raw_value_data_t* value = get_named_value(name);
+        if (value->ty != nullptr) {
+            return value->ty;
+        }
+        const Instruction& instr = *defs.at(name);
+        switch (instr.op_type) {
+            case OpType::LOAD:
+                value->ty = get_value_type(std::get<Symbol>(instr.t1->assoc_val))->data.pointer.base;
+                break;
+            case OpType::GETPTR:
+                value->ty = get_value_type(std::get<Symbol>(instr.t1->assoc_val));
+                break;
+            case OpType::GETELEMPTR: {
+                koopa_raw_type_t src_ty = get_value_type(std::get<Symbol>(instr.t1->assoc_val));
+                value->ty = get_pointer_type(src_ty->data.pointer.base->data.array.base);
+                break;
+            }
+            case OpType::CALL:
+                value->ty = get_int_type();
+                break;
+            case OpType::ALLOC:
+                value->ty = get_type(instr.t0->type);
+                break;
+            default:
+                value->ty = get_int_type();  // arithmetic and comparisons
+                break;
+        }
+        return value->ty;
+    }
+
+    koopa_raw_value_t use(const Operand& op, koopa_raw_value_t user) {
+        koopa_raw_value_data_t* value;
+        if (std::holds_alternative<int>(op.assoc_val)) {
+            value = new_value(KOOPA_RVT_INTEGER, get_int_type());
+            value->kind.data.integer.value = std::get<int>(op.assoc_val);
+        } else {
+            value = get_named_value(std::get<Symbol>(op.assoc_val));
+        }
+        auto& users = value_users[value];
+        if (users.empty() || users.back() != user) {
+            users.push_back(user);
+        }
+        return value;
+    }
+
+    koopa_raw_slice_t use_all(const std::optional<std::vector<Operand> >& ops, koopa_raw_value_t user) {
+        std::vector<const void*> args;
+        for (auto& op : ops.value_or(std::vector<Operand>())) {
+            args.push_back(use(op, user));
+        }
+        return make_slice(args, KOOPA_RSIK_VALUE);
+    }
+
+    koopa_raw_basic_block_t use_block(const Operand& op, koopa_raw_value_t user) {
+        auto it = block_by_name.find(std::get<Symbol>(op.assoc_val));
+        if (it == block_by_name.end()) {
+            throw std::invalid_argument("RawProgramBuilder: undefined block " +
+                                        std::get<Symbol>(op.assoc_val).str());
+        }
+        block_users[it->second].push_back(user);
+        return it->second;
+    }
+
+    static koopa_raw_binary_op_t get_binary_op(OpType op_type) {
+        switch (op_type) {
+            case OpType::ADD: return KOOPA_RBO_ADD;
+            case OpType::SUB: return KOOPA_RBO_SUB;
+            case OpType::MUL: return KOOPA_RBO_MUL;
+            case OpType::DIV: return KOOPA_RBO_DIV;
+            case OpType::MOD: return KOOPA_RBO_MOD;
+            case OpType::EQ: return KOOPA_RBO_EQ;
+            case OpType::NE: return KOOPA_RBO_NOT_EQ;
+            case OpType::GT: return KOOPA_RBO_GT;
+            case OpType::GE: return KOOPA_RBO_GE;
+            case OpType::LT: return KOOPA_RBO_LT;
+            case OpType::LE: return KOOPA_RBO_LE;
+            case OpType::AND: return KOOPA_RBO_AND;
+            case OpType::OR: return KOOPA_RBO_OR;
+            case OpType::XOR: return KOOPA_RBO_XOR;
+            default:
+                throw std::invalid_argument("RawProgramBuilder::get_binary_op: not a binary OpType!");
+        }
+    }
+
+    void build_instr(const Instruction& instr, koopa_raw_value_data_t* value) {
+        switch (instr.op_type) {
+            case OpType::GETELEMPTR:
+                value->kind.tag = KOOPA_RVT_GET_ELEM_PTR;
+                value->kind.data.get_elem_ptr.src = use(instr.t1.value(), value);
+                value->kind.data.get_elem_ptr.index = use(instr.t2.value(), value);
+                break;
+            case OpType::GETPTR:
+                value->kind.tag = KOOPA_RVT_GET_PTR;
+                value->kind.data.get_ptr.src = use(instr.t1.value(), value);
+                value->kind.data.get_ptr.index = use(instr.t2.value(), value);
+                break;
+            case OpType::BR:
+                value->kind.tag = KOOPA_RVT_BRANCH;
+                value->kind.data.branch.cond = use(instr.t0.value(), value);
+                value->kind.data.branch.true_bb = use_block(instr.t1.value(), value);
+                value->kind.data.branch.false_bb = use_block(instr.t2.value(), value);
+                value->kind.data.branch.true_args = make_slice({}, KOOPA_RSIK_VALUE);
+                value->kind.data.branch.false_args = make_slice({}, KOOPA_RSIK_VALUE);
+                break;
+            case OpType::JUMP:
+                value->kind.tag = KOOPA_RVT_JUMP;
+                value->kind.data.jump.target = use_block(instr.t0.value(), value);
+                value->kind.data.jump.args = use_all(instr.param_list, value);
+                break;
+            case OpType::RET:
+                value->kind.tag = KOOPA_RVT_RETURN;
+                value->kind.data.ret.value = instr.t0.has_value() ? use(instr.t0.value(), value) : nullptr;
+                break;
+            case OpType::CALL: {
+                const Operand& callee = instr.t1.has_value() ? instr.t1.value() : instr.t0.value();
+                value->kind.tag = KOOPA_RVT_CALL;
+                value->kind.data.call.callee = function_by_name.at(std::get<Symbol>(callee.assoc_val));
+                value->kind.data.call.args = use_all(instr.param_list, value);
+                break;
+            }
+            case OpType::ALLOC:
+                value->kind.tag = KOOPA_RVT_ALLOC;
+                break;
+            case OpType::LOAD:
+                value->kind.tag = KOOPA_RVT_LOAD;
+                value->kind.data.load.src = use(instr.t1.value(), value);
+                break;
+            case OpType::STORE:
+                value->kind.tag = KOOPA_RVT_STORE;
+                value->kind.data.store.value = use(instr.t0.value(), value);
+                value->kind.data.store.dest = use(instr.t1.value(), value);
+                break;
+            default:
+                value->kind.tag = KOOPA_RVT_BINARY;
+                value->kind.data.binary.op = get_binary_op(instr.op_type);
+                value->kind.data.binary.lhs = use(instr.t1.value(), value);
+                value->kind.data.binary.rhs = use(instr.t2.value(), value);
+                break;
+        }
+    }
+
+    void build_body(const Function& func, koopa_raw_function_data_t* func_data) {
+        value_by_name.clear();
+        block_by_name.clear();
+        defs.clear();
+
+        std::vector<const void*> params;
+        for (size_t i = 0; i < func.param_list.size(); i++) {
+            const FParam& param = func.param_list[i];
+            koopa_raw_value_data_t* value = new_value(KOOPA_RVT_FUNC_ARG_REF, get_type(param.type),
+                                                      keep_name(param.koopa_var_name));
+            value->kind.data.func_arg_ref.index = i;
+            value_by_name.emplace(param.koopa_var_name, value);
+            params.push_back(value);
+        }
+        func_data->params = make_slice(params, KOOPA_RSIK_VALUE);
+
+        // the blocks and the values they define, before anything refers to them
+        std::vector<const BasicBlock*> kept_blocks;
+        std::vector<koopa_raw_basic_block_data_t*> block_datas;
+        for (auto block_ptr : func.get_blocks()) {
+            if (block_ptr->instruction_lists.empty() && block_ptr->ending_instruction == nullptr) {
+                continue;  // not printed either
+            }
+            storage->blocks.emplace_back();
+            koopa_raw_basic_block_data_t* block = &storage->blocks.back();
+            block->name = keep_name(block_ptr->basic_block_name);
+            block->used_by = make_slice({}, KOOPA_RSIK_VALUE);
+            std::vector<const void*> block_params;
+            for (size_t i = 0; i < block_ptr->params.size(); i++) {
+                Symbol name = std::get<Symbol>(block_ptr->params[i].assoc_val);
+                koopa_raw_value_data_t* value = new_value(KOOPA_RVT_BLOCK_ARG_REF, get_type(block_ptr->params[i].type),
+                                                          keep_name(name));
+                value->kind.data.block_arg_ref.index = i;
+                value_by_name.emplace(name, value);
+                block_params.push_back(value);
+            }
+            block->params = make_slice(block_params, KOOPA_RSIK_VALUE);
+            block_by_name.emplace(block_ptr->basic_block_name, block);
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                auto result = instr_ptr->get_result();
+                if (result.has_value()) {
+                    value_by_name.emplace(result.value(), new_value(KOOPA_RVT_UNDEF, nullptr,
+                                                                    keep_name(result.value())));
+                    defs.emplace(result.value(), instr_ptr);
+                }
+            }
+            kept_blocks.push_back(block_ptr);
+            block_datas.push_back(block);
+        }
+
+        std::vector<const void*> bbs;
+        for (size_t b = 0; b < kept_blocks.size(); b++) {
+            std::vector<const Instruction*> instrs;
+            for (auto& instr_ptr : kept_blocks[b]->instruction_lists) {
+                instrs.push_back(instr_ptr);
+            }
+            instrs.push_back(kept_blocks[b]->ending_instruction);
+            std::vector<const void*> insts;
+            for (auto instr : instrs) {
+                auto result = instr->get_result();
+                koopa_raw_value_data_t* value;
+                if (result.has_value()) {
+                    value = value_by_name.at(result.value());
+                    get_value_type(result.value());
+                } else {
+                    value = new_value(KOOPA_RVT_UNDEF, get_unit_type());
+                }
+                build_instr(*instr, value);
+                insts.push_back(value);
+            }
+            block_datas[b]->insts = make_slice(insts, KOOPA_RSIK_VALUE);
+            bbs.push_back(block_datas[b]);
+        }
+        func_data->bbs = make_slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+    }
+};
+
+#endif //COMPILER_RAW_PROGRAM_BUILDER_H
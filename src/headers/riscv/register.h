@@ -3,15 +3,18 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 
-#define TOTAL_AVAIL_REG_NUM 15  // WARNING: hard-coded
+#include "liveness.h"
+
+// t0, t1 and t2 are never allocated: the code generator uses them as scratch registers
+// for spilled values, long immediates and parallel moves.
+#define TOTAL_AVAIL_REG_NUM 24  // WARNING: hard-coded
 
 class RegisterAllocator {
 public:
     enum available_registers {
-        REG_T0,
-        REG_T1,
-        REG_T2,
         REG_T3,
         REG_T4,
         REG_T5,
@@ -25,36 +28,124 @@ public:
         REG_A5,
         REG_A6,
         REG_A7,
+
+        REG_S0,
+        REG_S1,
+        REG_S2,
+        REG_S3,
+        REG_S4,
+        REG_S5,
+        REG_S6,
+        REG_S7,
+        REG_S8,
+        REG_S9,
+        REG_S10,
+        REG_S11,
     };
     bool used[TOTAL_AVAIL_REG_NUM] = {0};
-    const std::string register_names[TOTAL_AVAIL_REG_NUM] = {"t0",
-                                          "t1",
-                                          "t2",
-                                          "t3",
-                                          "t4",
-                                          "t5",
-                                          "t6",
-                                          "a0",
-                                          "a1",
-                                          "a2",
-                                          "a3",
-                                          "a4",
-                                          "a5",
-                                          "a6",
-                                          "a7"};
-
-    RegisterAllocator() {
-        used[REG_A0] = true;  // Reserve for return
+    bool ever_used[TOTAL_AVAIL_REG_NUM] = {0};
+    const std::string register_names[TOTAL_AVAIL_REG_NUM] = {"t3", "t4", "t5", "t6",
+                                                             "a0", "a1", "a2", "a3",
+                                                             "a4", "a5", "a6", "a7",
+                                                             "s0", "s1", "s2", "s3",
+                                                             "s4", "s5", "s6", "s7",
+                                                             "s8", "s9", "s10", "s11"};
+
+    static bool is_callee_saved(int reg) {
+        return reg >= REG_S0;
     }
 
-    std::string allocate() {
+    int index_of(const std::string& name) const {
         for (int i = 0; i < TOTAL_AVAIL_REG_NUM; i++) {
+            if (register_names[i] == name) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Linear scan (Poletto & Sarkar) over the intervals of one function.
+    // Intervals that cross a call may only live in callee-saved registers; the others prefer
+    // caller-saved ones so that leaf functions need not save anything. When no register is
+    // left, the interval (active or current) that ends last is spilled.
+    // Intervals left without `reg` must be given a stack slot by the caller.
+    void allocate(std::vector<LiveInterval>& intervals) {
+        std::fill(std::begin(used), std::end(used), false);
+        std::fill(std::begin(ever_used), std::end(ever_used), false);
+        std::vector<size_t> order(intervals.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&intervals](size_t a, size_t b) {
+            return intervals[a].start < intervals[b].start;
+        });
+
+        std::vector<std::pair<size_t, int>> active;  // (interval, register)
+        for (size_t cur : order) {
+            LiveInterval& interval = intervals[cur];
+            // expire the intervals that end before this one starts
+            for (auto it = active.begin(); it != active.end();) {
+                if (intervals[it->first].end < interval.start) {
+                    used[it->second] = false;
+                    it = active.erase(it);
+                } else {
+                    it++;
+                }
+            }
+
+            int reg = pick_free_register(interval);
+            if (reg < 0) {
+                // steal the register of the active interval that ends last, if it ends after us
+                auto victim = active.end();
+                for (auto it = active.begin(); it != active.end(); it++) {
+                    if (!interval.crosses_call || is_callee_saved(it->second)) {
+                        if (victim == active.end() || intervals[it->first].end > intervals[victim->first].end) {
+                            victim = it;
+                        }
+                    }
+                }
+                if (victim != active.end() && intervals[victim->first].end > interval.end) {
+                    reg = victim->second;
+                    intervals[victim->first].reg = std::nullopt;
+                    active.erase(victim);
+                }
+            }
+            if (reg >= 0) {
+                used[reg] = true;
+                ever_used[reg] = true;
+                interval.reg = register_names[reg];
+                active.emplace_back(cur, reg);
+            } else {
+                interval.reg = std::nullopt;
+            }
+        }
+    }
+
+    std::vector<std::string> get_used_callee_saved_registers() const {
+        std::vector<std::string> regs;
+        for (int i = REG_S0; i < TOTAL_AVAIL_REG_NUM; i++) {
+            if (ever_used[i]) {
+                regs.push_back(register_names[i]);
+            }
+        }
+        return regs;
+    }
+
+private:
+    int pick_free_register(const LiveInterval& interval) {
+        int first = interval.crosses_call ? REG_S0 : REG_T3;
+        if (interval.hint.has_value()) {
+            int hinted = index_of(interval.hint.value());
+            if (hinted >= first && !used[hinted]) {
+                return hinted;
+            }
+        }
+        for (int i = first; i < TOTAL_AVAIL_REG_NUM; i++) {
             if (!used[i]) {
-                used[i] = true;
-                return register_names[i];
+                return i;
             }
         }
-        return {};  // remember to check empty string
+        return -1;
     }
 };
 
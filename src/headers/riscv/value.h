@@ -1,10 +1,13 @@
 #ifndef COMPILER_VALUE_H
 #define COMPILER_VALUE_H
 
+#include <algorithm>
+#include <optional>
 #include <string>
 #include <variant>
+#include <vector>
 
-#include "format_instr.h"
+#include "machine_instr.h"
 
 
 class LocalVariable {
@@ -14,23 +17,30 @@ public:
     LocalVariable(size_t _offset, bool _is_pointer = false): offset(_offset), is_pointer(_is_pointer) { }
 };
 
+class RegisterVariable {
+public:
+    std::string reg;
+    bool is_pointer;
+    RegisterVariable(std::string _reg, bool _is_pointer = false): reg(_reg), is_pointer(_is_pointer) { }
+};
+
 enum class ValueType {
     UNIT,  // usually for unassigned expression: ...; 2 + 3; ...;
     CONST,
     LOCAL,
     GLOBAL,
-    ARG,
+    REG,
 };
 
 class Value {
 public:
     ValueType type;
-    std::variant<std::monostate, std::string, int, LocalVariable, size_t> value;
+    std::variant<std::monostate, std::string, int, LocalVariable, RegisterVariable> value;
     Value(std::monostate _value): type(ValueType::UNIT), value(_value) { }
     Value(int _value): type(ValueType::CONST), value(_value) { }
     Value(LocalVariable _value): type(ValueType::LOCAL), value(_value) { }
     Value(std::string _value): type(ValueType::GLOBAL), value(_value) { }
-    Value(size_t _value): type(ValueType::ARG), value(_value) { }
+    Value(RegisterVariable _value): type(ValueType::REG), value(_value) { }
     Value(std::optional<LocalVariable> local_var) {
         if (local_var.has_value()) {
             type = ValueType::LOCAL;
@@ -41,12 +51,13 @@ public:
         }
     }
     bool is_pointer() const {
-        return type == ValueType::LOCAL && std::get<LocalVariable>(value).is_pointer;
+        return (type == ValueType::LOCAL && std::get<LocalVariable>(value).is_pointer)
+               || (type == ValueType::REG && std::get<RegisterVariable>(value).is_pointer);
     }
 };
 
-void load_value_to_reg(std::ostream& out, const Value& val, const std::string& reg, std::optional<size_t> stack_frame_size_opt = std::nullopt) {
-    InstructionPrinter printer = InstructionPrinter(out, reg);
+void load_value_to_reg(MachineInstrBuffer& buf, const Value& val, const std::string& reg) {
+    InstructionPrinter printer = InstructionPrinter(buf, reg);
     switch(val.type) {
         case ValueType::CONST: {
             printer.load_imm(reg, std::get<int>(val.value));
@@ -61,14 +72,8 @@ void load_value_to_reg(std::ostream& out, const Value& val, const std::string& r
             printer.load_word(reg, reg, 0);
             break;
         }
-        case ValueType::ARG: {
-            size_t arg_idx = std::get<size_t>(val.value);
-            if (arg_idx < 8) {
-                printer.mv(reg, "a" + std::to_string(arg_idx));
-            } else {
-                size_t stack_frame_size = stack_frame_size_opt.value();  // will throw an error if there's no value
-                printer.load_word(reg, "sp", int(stack_frame_size + (arg_idx - 8) * 4));
-            }
+        case ValueType::REG: {
+            printer.mv(reg, std::get<RegisterVariable>(val.value).reg);
             break;
         }
         default: {
@@ -77,8 +82,21 @@ void load_value_to_reg(std::ostream& out, const Value& val, const std::string& r
     }
 }
 
-void load_value_addr_to_reg(std::ostream& out, const Value& val, const std::string& reg) {
-    InstructionPrinter printer = InstructionPrinter(out, reg);
+// Returns the register that holds val, loading it into reg only if it is not in a register yet.
+// The result is read-only: it may be an allocated register or the zero register.
+std::string get_value_in_reg(MachineInstrBuffer& buf, const Value& val, const std::string& reg) {
+    if (val.type == ValueType::REG) {
+        return std::get<RegisterVariable>(val.value).reg;
+    }
+    if (val.type == ValueType::CONST && std::get<int>(val.value) == 0) {
+        return "zero";
+    }
+    load_value_to_reg(buf, val, reg);
+    return reg;
+}
+
+void load_value_addr_to_reg(MachineInstrBuffer& buf, const Value& val, const std::string& reg) {
+    InstructionPrinter printer = InstructionPrinter(buf, reg);
     switch(val.type) {
         case ValueType::GLOBAL: {
             printer.load_addr(reg, std::get<std::string>(val.value));
@@ -94,8 +112,8 @@ void load_value_addr_to_reg(std::ostream& out, const Value& val, const std::stri
     }
 }
 
-void store_reg_to_value(std::ostream& out, const Value& val, const std::string& src_reg, const std::string& addr_reg) {
-    InstructionPrinter printer = InstructionPrinter(out, addr_reg);
+void store_reg_to_value(MachineInstrBuffer& buf, const Value& val, const std::string& src_reg, const std::string& addr_reg) {
+    InstructionPrinter printer = InstructionPrinter(buf, addr_reg);
     switch(val.type) {
         case ValueType::GLOBAL: {
             printer.load_addr(addr_reg, std::get<std::string>(val.value));
@@ -106,15 +124,8 @@ void store_reg_to_value(std::ostream& out, const Value& val, const std::string&
             printer.store_word(src_reg, "sp", int(std::get<LocalVariable>(val.value).offset));
             break;
         }
-        case ValueType::ARG: {
-            size_t arg_index = std::get<size_t>(val.value);
-            if (arg_index < 8) {
-                // in the reg
-                printer.mv("a" + std::to_string(arg_index), src_reg);
-            } else {
-                // on the stack
-                printer.store_word(src_reg, "sp", int(arg_index - 8) * 4);
-            }
+        case ValueType::REG: {
+            printer.mv(std::get<RegisterVariable>(val.value).reg, src_reg);
             break;
         }
         case ValueType::UNIT: {
@@ -127,4 +138,77 @@ void store_reg_to_value(std::ostream& out, const Value& val, const std::string&
     }
 }
 
+// Where a value lives, as far as moves can overwrite it: a register, or a stack slot
+// ("sp+offset"). Constants and globals have no location.
+std::optional<std::string> get_location(const Value& val) {
+    switch (val.type) {
+        case ValueType::REG:
+            return std::get<RegisterVariable>(val.value).reg;
+        case ValueType::LOCAL:
+            return "sp+" + std::to_string(std::get<LocalVariable>(val.value).offset);
+        default:
+            return std::nullopt;
+    }
+}
+
+// Performs all moves "at once": no destination is written before every source that needs
+// its old value has been read. A destination is a register or a stack slot; cycles are broken
+// through scratch_reg, and a move to the stack goes through t1 (and t2 for a long offset).
+void emit_parallel_value_moves(MachineInstrBuffer& buf, std::vector<std::pair<Value, Value>> moves,
+                               const std::string& scratch_reg) {
+    InstructionPrinter printer = InstructionPrinter(buf, "t2");
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [](const std::pair<Value, Value>& move) {
+        return get_location(move.first) == get_location(move.second);
+    }), moves.end());
+    auto emit = [&buf, &printer](const Value& dst, const Value& src) {
+        if (dst.type == ValueType::REG) {
+            load_value_to_reg(buf, src, std::get<RegisterVariable>(dst.value).reg);
+        } else {
+            std::string src_reg = get_value_in_reg(buf, src, "t1");
+            printer.store_word(src_reg, "sp", int(std::get<LocalVariable>(dst.value).offset));
+        }
+    };
+
+    while (!moves.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < moves.size(); i++) {
+            std::optional<std::string> dst = get_location(moves[i].first);
+            bool dst_is_source = false;
+            for (size_t j = 0; j < moves.size(); j++) {
+                if (j != i && get_location(moves[j].second) == dst) {
+                    dst_is_source = true;
+                    break;
+                }
+            }
+            if (!dst_is_source) {
+                emit(moves[i].first, moves[i].second);
+                moves.erase(moves.begin() + i);
+                progress = true;
+                break;
+            }
+        }
+        if (!progress) {
+            // only cycles are left: save one destination and redirect its readers
+            Value saved = moves.front().first;
+            std::optional<std::string> saved_location = get_location(saved);
+            load_value_to_reg(buf, saved, scratch_reg);
+            for (auto& move : moves) {
+                if (get_location(move.second) == saved_location) {
+                    move.second = Value(RegisterVariable(scratch_reg));
+                }
+            }
+        }
+    }
+}
+
+// the moves of values into registers, e.g. the arguments of a call
+void emit_parallel_moves(MachineInstrBuffer& buf, const std::vector<std::pair<std::string, Value>>& moves,
+                         const std::string& scratch_reg) {
+    std::vector<std::pair<Value, Value>> value_moves;
+    for (auto& move : moves) {
+        value_moves.emplace_back(Value(RegisterVariable(move.first)), move.second);
+    }
+    emit_parallel_value_moves(buf, value_moves, scratch_reg);
+}
+
 #endif //COMPILER_VALUE_H
@@ -2,46 +2,79 @@
 #define COMPILER_VISIT_RAW_PROGRAM_H
 
 #include <iostream>
+#include <cstdint>
 #include <cstring>
+#include <optional>
 #include <unordered_map>
 #include <iomanip>
-#include <set>
 
+#include "headers/output_writer.h"
 #include "headers/riscv/register.h"
 #include "koopa.h"
+#include "liveness.h"
 #include "value.h"
 #include "koopa_function.h"
-
-#define DUMMY_JUMP_BLOCK_BASENAME "dummy_jump_block"
-
-void Visit(const koopa_raw_program_t &program, RegisterAllocator &reg_alloc, std::ostream& out = std::cout);
-void Visit(const koopa_raw_slice_t &slice, RegisterAllocator &reg_alloc, std::ostream& out = std::cout);
-void Visit(const koopa_raw_function_t &func, RegisterAllocator &reg_alloc, std::ostream& out = std::cout);
-void Visit(const koopa_raw_basic_block_t &bb, RegisterAllocator &reg_alloc, std::ostream& out = std::cout);
-void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, std::ostream& out = std::cout);
-std::string Visit(const koopa_raw_binary_t &binary, RegisterAllocator &reg_alloc, std::ostream& out);
+#include "machine_instr.h"
+#include "peephole.h"
+#include "branch_relax.h"
+#include "data_directive.h"
+
+// base + sum(index * scale) + offset: the address a chain of folded getelemptr/getptr computes.
+// base is an alloc, a global or a pointer value.
+class AddressExpr {
+public:
+    koopa_raw_value_t base;
+    std::vector<std::pair<koopa_raw_value_t, int>> scaled_indices;  // outermost first
+    int offset = 0;
+    AddressExpr(koopa_raw_value_t _base): base(_base) { }
+};
+
+// whole_program: all the users of the globals are in program, so that one only read goes to .rodata
+void Visit(const koopa_raw_program_t &program, RegisterAllocator &reg_alloc, OutputWriter& out,
+           bool whole_program = true);
+void Visit(const koopa_raw_slice_t &slice, RegisterAllocator &reg_alloc, OutputWriter& out);
+void Visit(const koopa_raw_function_t &func, RegisterAllocator &reg_alloc, OutputWriter& out);
+void Visit(const koopa_raw_basic_block_t &bb, RegisterAllocator &reg_alloc, OutputWriter& out);
+void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, OutputWriter& out);
+void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, MachineInstrBuffer& buf);
+std::string Visit(const koopa_raw_binary_t &binary, const std::string& res_reg, MachineInstrBuffer& buf);
+AddressExpr get_address_expr(const koopa_raw_value_t& ptr);
+AddressExpr get_pointer_offset_expr(const koopa_raw_value_t& ptr);
+std::pair<std::string, int> Visit_address(const AddressExpr& address, const std::string& dst_reg,
+                                          MachineInstrBuffer& buf);
+void Visit_branch(const koopa_raw_branch_t& koopa_branch, MachineInstrBuffer& buf);
+void Visit_initializer(const koopa_raw_value_t& init, DataDirectiveWriter& writer);
 std::unordered_map<koopa_raw_value_t, std::string> valueSymbolName;
 std::unique_ptr<KoopaFunction> current_func_ptr;
 Value get_koopa_value_Value(const koopa_raw_value_t &value);
 size_t dummy_jump_block_cnt = 0;
+std::ostream* frame_size_report = nullptr;  // per-function frame sizes with and without shared slots
 
 
-void Visit(const koopa_raw_program_t &program, RegisterAllocator &reg_alloc, std::ostream& out) {
+void Visit(const koopa_raw_program_t &program, RegisterAllocator &reg_alloc, OutputWriter& out, bool whole_program) {
     // get_koopa_value_Value global values
     for (size_t i = 0; i < program.values.len; ++i) {
         const koopa_raw_value_t& global_value = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
         const std::string value_name = std::string(global_value->name).substr(1);
         valueSymbolName[global_value] = value_name;
-        out << "  .data" << std::endl;
-        out << "  .globl " << value_name << std::endl;
-        out << value_name << ":" << std::endl;
+        // zero everywhere: leave it to the loader instead of spelling it out in the binary
+        if (is_zero_initializer(global_value->kind.data.global_alloc.init)) {
+            out << "  .bss" << '\n';
+        } else if (whole_program && is_read_only_pointer(global_value)) {
+            // e.g. const arrays and the templates of local array initializers, also when a loop steps through them
+            out << "  .section .rodata" << '\n';
+        } else {
+            out << "  .data" << '\n';
+        }
+        out << "  .globl " << value_name << '\n';
+        out << value_name << ":" << '\n';
         Visit(global_value, reg_alloc, out);
-        out << std::endl;
+        out << '\n';
     }
     Visit(program.funcs, reg_alloc, out);
 }
 
-void Visit(const koopa_raw_slice_t &slice, RegisterAllocator &reg_alloc, std::ostream& out) {
+void Visit(const koopa_raw_slice_t &slice, RegisterAllocator &reg_alloc, OutputWriter& out) {
     for (size_t i = 0; i < slice.len; ++i) {
         auto ptr = slice.buffer[i];
         switch (slice.kind) {
@@ -63,60 +96,106 @@ void Visit(const koopa_raw_slice_t &slice, RegisterAllocator &reg_alloc, std::os
     }
 }
 
-inline bool is_local_instruction(koopa_raw_value_tag_t tag) {
-    std::set<koopa_raw_value_tag_t> local_type = {
-            KOOPA_RVT_ALLOC,
-            KOOPA_RVT_LOAD,
-            KOOPA_RVT_STORE,
-            KOOPA_RVT_GET_PTR,
-            KOOPA_RVT_GET_ELEM_PTR,
-            KOOPA_RVT_BINARY,
-            KOOPA_RVT_BRANCH,
-            KOOPA_RVT_JUMP,
-            KOOPA_RVT_CALL,
-            KOOPA_RVT_RETURN,
-    };
-    return local_type.find(tag) != local_type.end();
-}
-
-void Visit(const koopa_raw_function_t& func, RegisterAllocator& reg_alloc, std::ostream& out) {
+void Visit(const koopa_raw_function_t& func, RegisterAllocator& reg_alloc, OutputWriter& out) {
     if (func->bbs.len == 0) {
         // lib func declaration
         return;
     }
     current_func_ptr = std::make_unique<KoopaFunction>(func);
+    current_func_ptr->find_tail_calls();
+    // scalars and spill slots go below the arrays, where sp-relative offsets fit in 12 bits
+    std::vector<koopa_raw_value_t> array_allocs;
     for (auto& koopa_value_ptr : current_func_ptr->koopa_value_ptrs) {
-        if (is_local_instruction(koopa_value_ptr->kind.tag) && koopa_value_ptr->used_by.len > 0) {
-            current_func_ptr->add_space_for_temp_var_in_stack(koopa_value_ptr);
+        if (koopa_value_ptr->kind.tag == KOOPA_RVT_ALLOC) {
+            if (koopa_value_ptr->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
+                array_allocs.push_back(koopa_value_ptr);
+            } else {
+                current_func_ptr->add_space_for_temp_var_in_stack(koopa_value_ptr);
+            }
         }
-        if (koopa_value_ptr->kind.tag == KOOPA_RVT_CALL) {
+        if (koopa_value_ptr->kind.tag == KOOPA_RVT_CALL && !current_func_ptr->is_tail_call(koopa_value_ptr)) {
+            // a tail call neither needs ra nor an outgoing argument area
             current_func_ptr->update_arg_num_max(koopa_value_ptr->kind.data.call.args.len);
         }
     }
 
+    current_func_ptr->layout_basic_blocks();
+    current_func_ptr->find_fused_compares();
+    current_func_ptr->find_folded_pointers();
+    std::vector<LiveInterval> intervals = compute_live_intervals(func, current_func_ptr->koopa_basic_blocks,
+                                                                 current_func_ptr->inlined_values);
+    reg_alloc.allocate(intervals);
+    std::vector<LiveInterval> spilled;
+    for (auto& interval : intervals) {
+        if (interval.reg.has_value()) {
+            current_func_ptr->reg_map.emplace(interval.value, interval.reg.value());
+        } else {
+            spilled.push_back(interval);
+        }
+    }
+    current_func_ptr->assign_spill_slots(spilled);
+    for (auto& alloc : array_allocs) {
+        current_func_ptr->add_space_for_temp_var_in_stack(alloc);
+    }
+    current_func_ptr->callee_saved_regs = reg_alloc.get_used_callee_saved_registers();
+    if (frame_size_report != nullptr) {
+        *frame_size_report << std::string(func->name).substr(1) << ": frame size "
+                           << current_func_ptr->get_stack_frame_size(current_func_ptr->unshared_local_vars_size)
+                           << " -> " << current_func_ptr->get_stack_frame_size() << " bytes" << std::endl;
+    }
+
     for (auto& basic_block : current_func_ptr->koopa_basic_blocks) {
         current_func_ptr->insert_riscv_block_name(basic_block, basic_block->name);
     }
 
-    InstructionPrinter printer = InstructionPrinter(out, "t0");
+    // instructions are collected per function so that the peephole pass can see them
+    MachineInstrBuffer buf;
+    InstructionPrinter printer = InstructionPrinter(buf, "t0");
     printer.print_func_header(func->name,
                               current_func_ptr->get_stack_frame_size(),
-                              current_func_ptr->is_leaf_function());
+                              current_func_ptr->is_leaf_function(),
+                              current_func_ptr->callee_saved_regs);
+
+    if (current_func_ptr->has_self_tail_call) {
+        printer.label(current_func_ptr->get_tail_recursion_label());
+    }
+
+    // move the register arguments to where the allocator put them
+    std::vector<std::pair<std::string, Value>> param_moves;
+    for (size_t i = 0; i < func->params.len && i < 8; i++) {
+        auto param = reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]);
+        Value param_val = get_koopa_value_Value(param);
+        std::string arg_reg = "a" + std::to_string(i);
+        if (param_val.type == ValueType::REG) {
+            param_moves.emplace_back(std::get<RegisterVariable>(param_val.value).reg,
+                                     Value(RegisterVariable(arg_reg)));
+        } else {
+            store_reg_to_value(buf, param_val, arg_reg, "t0");
+        }
+    }
+    emit_parallel_moves(buf, param_moves, "t0");
 
-    for (size_t i = 0; i < func->bbs.len; i++) {
-        const koopa_raw_basic_block_t& basic_block_ptr = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
-        std::string block_name = current_func_ptr->get_riscv_block_name(basic_block_ptr);
-        out << block_name << ":" << std::endl;
+    for (auto& basic_block_ptr : current_func_ptr->koopa_basic_blocks) {
+        current_func_ptr->current_block = basic_block_ptr;
+        printer.label(current_func_ptr->get_riscv_block_name(basic_block_ptr));
         for (size_t j = 0; j < basic_block_ptr->insts.len; j++) {
-            Visit(reinterpret_cast<koopa_raw_value_t>(basic_block_ptr->insts.buffer[j]), reg_alloc, out);
+            auto inst = reinterpret_cast<koopa_raw_value_t>(basic_block_ptr->insts.buffer[j]);
+            if (current_func_ptr->after_tail_calls.count(inst)) {
+                break;
+            }
+            Visit(inst, reg_alloc, buf);
         }
     }
 
+    run_peephole(buf);
+    relax_branches(buf, dummy_jump_block_cnt);
+    buf.flush(out);
+
     // release
-    out << std::endl;
+    out << '\n';
 }
 
-void Visit(const koopa_raw_basic_block_t &bb, RegisterAllocator &reg_alloc, std::ostream& out) {
+void Visit(const koopa_raw_basic_block_t &bb, RegisterAllocator &reg_alloc, OutputWriter& out) {
     Visit(bb->insts, reg_alloc, out);  // koopa_raw_slice_t
 }
 
@@ -139,9 +218,19 @@ Value get_koopa_value_Value(const koopa_raw_value_t &value) {
             return {int(value->kind.data.integer.value)};
         }
         case KOOPA_RVT_FUNC_ARG_REF: {
-            return {size_t(value->kind.data.func_arg_ref.index)};
+            size_t arg_idx = value->kind.data.func_arg_ref.index;
+            if (arg_idx >= 8) {
+                // passed on the stack, in the caller's frame
+                size_t offset = current_func_ptr->get_stack_frame_size() + (arg_idx - 8) * 4;
+                return {LocalVariable(offset, value->ty->tag == KOOPA_RTT_POINTER)};
+            }
         }
+        // fall through
         default: {
+            auto opt_reg = current_func_ptr->get_reg(value);
+            if (opt_reg.has_value()) {
+                return {RegisterVariable(opt_reg.value(), value->ty->tag == KOOPA_RTT_POINTER)};
+            }
             auto opt_local = current_func_ptr->get_local_var_info(value);
             if (opt_local.has_value()) {
                 return {opt_local.value()};
@@ -152,162 +241,162 @@ Value get_koopa_value_Value(const koopa_raw_value_t &value) {
     }
 }
 
-void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, std::ostream& out) {
+// The register an instruction should write its result to: the allocated one, or a scratch
+// register when the value is spilled (or never used).
+std::string get_result_reg(const koopa_raw_value_t& value_ptr) {
+    return current_func_ptr->get_reg(value_ptr).value_or("t0");
+}
+
+void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, OutputWriter& out) {
     switch(value_ptr->kind.tag) {
+        case KOOPA_RVT_GLOBAL_ALLOC: {
+            DataDirectiveWriter writer(out);
+            Visit_initializer(value_ptr->kind.data.global_alloc.init, writer);
+            writer.flush();
+            break;
+        }
+        default: {
+            throw std::invalid_argument("In visiting global koopa_raw_value_data: unrecognized kind.tag: "
+                                        + std::to_string(value_ptr->kind.tag));
+        }
+    }
+}
+
+void Visit_initializer(const koopa_raw_value_t& init, DataDirectiveWriter& writer) {
+    switch(init->kind.tag) {
         case KOOPA_RVT_INTEGER:
-            out << ".word " << value_ptr->kind.data.integer.value << std::endl;
+            writer.append_word(init->kind.data.integer.value);
             break;
         case KOOPA_RVT_ZERO_INIT:
-            out << ".zero " << current_func_ptr->size_of_koopa_type(value_ptr->ty) << std::endl;
+            writer.append_zero_bytes(KoopaFunction::size_of_koopa_type(init->ty));
             break;
         case KOOPA_RVT_AGGREGATE: {
-            auto& elems = value_ptr->kind.data.aggregate.elems;
+            auto& elems = init->kind.data.aggregate.elems;
             for (size_t i = 0; i < elems.len; i++) {
-                Visit(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]), reg_alloc, out);
+                Visit_initializer(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]), writer);
             }
             break;
         }
+        default: {
+            throw std::invalid_argument("In visiting a global initializer: unrecognized kind.tag: "
+                                        + std::to_string(init->kind.tag));
+        }
+    }
+}
+
+void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, MachineInstrBuffer& buf) {
+    switch(value_ptr->kind.tag) {
         case KOOPA_RVT_UNDEF:
         case KOOPA_RVT_FUNC_ARG_REF:
         case KOOPA_RVT_BLOCK_ARG_REF:
         case KOOPA_RVT_ALLOC:
             break;
-        case KOOPA_RVT_GLOBAL_ALLOC:
-            Visit(value_ptr->kind.data.global_alloc.init, reg_alloc, out);
-            break;
         case KOOPA_RVT_LOAD: {
-            Value load_src = get_koopa_value_Value(value_ptr->kind.data.load.src);
-            load_value_to_reg(out, load_src, "t0");
-
-            if (load_src.is_pointer()) {
-                // if load_src is a pointer (not alloc), then the real value should be loaded with another instr.
-                format_instr(out, "lw", "t0", "0(t0)");
-            }
-
-            auto local_variable = current_func_ptr->get_local_var_info(value_ptr);
-            Value val = Value(local_variable);
-            store_reg_to_value(out, val, "t0", "t1");
+            auto address = Visit_address(get_address_expr(value_ptr->kind.data.load.src), "t1", buf);
+            std::string res_reg = get_result_reg(value_ptr);
+            InstructionPrinter(buf, "t2").load_word(res_reg, address.first, address.second);
+            store_reg_to_value(buf, get_koopa_value_Value(value_ptr), res_reg, "t1");
             break;
         }
         case KOOPA_RVT_STORE: {
+            // the address never ends up in t0, where the stored value goes
+            auto address = Visit_address(get_address_expr(value_ptr->kind.data.store.dest), "t1", buf);
             Value src_value = get_koopa_value_Value(value_ptr->kind.data.store.value);
-            if (src_value.type == ValueType::ARG) {
-                size_t stack_frame_size = current_func_ptr->get_stack_frame_size();
-                load_value_to_reg(out, src_value, "t0", stack_frame_size);
-            } else {
-                load_value_to_reg(out, src_value, "t0");
-            }
-            Value dst_value = get_koopa_value_Value(value_ptr->kind.data.store.dest);
-
-            if (!dst_value.is_pointer()) {
-                store_reg_to_value(out, dst_value, "t0", "t1");
-            } else {
-                load_value_to_reg(out, dst_value, "t1");
-                InstructionPrinter printer = InstructionPrinter(out, "t2");
-                printer.store_word("t0", "t1", 0);
-            }
-            break;
-        }
-        case KOOPA_RVT_GET_PTR: {
-            Value src_val = get_koopa_value_Value(value_ptr->kind.data.get_ptr.src);
-            if (src_val.is_pointer()) {
-                load_value_to_reg(out, src_val, "t0");
-            } else {
-                load_value_addr_to_reg(out, src_val, "t0");
-            }
-
-            Value index_val = get_koopa_value_Value(value_ptr->kind.data.get_ptr.index);
-            load_value_to_reg(out, index_val, "t1");
-
-            // getptr returns the same type as the src
-            size_t pointer_data_size = current_func_ptr->size_of_koopa_type(value_ptr->ty->data.pointer.base);
-            InstructionPrinter printer = InstructionPrinter(out, "t2");
-            printer.mul_imm("t1", "t1", int(pointer_data_size));
-            format_instr(out, "add", "t0", "t0", "t1");
-
-            // store the value
-            auto local_var_opt = current_func_ptr->get_local_var_info(value_ptr);
-            Value store_val = Value(local_var_opt);
-            store_reg_to_value(out, store_val, "t0", "t1");
+            std::string src_reg = get_value_in_reg(buf, src_value, "t0");
+            InstructionPrinter(buf, "t2").store_word(src_reg, address.first, address.second);
             break;
         }
+        case KOOPA_RVT_GET_PTR:
         case KOOPA_RVT_GET_ELEM_PTR: {
-            Value src_val = get_koopa_value_Value(value_ptr->kind.data.get_elem_ptr.src);
-            if (src_val.is_pointer()) {
-                load_value_to_reg(out, src_val, "t0");
+            if (current_func_ptr->is_folded_pointer(value_ptr)) {
+                break;
+            }
+            auto address = Visit_address(get_pointer_offset_expr(value_ptr), "t1", buf);
+            std::string res_reg = get_result_reg(value_ptr);
+            InstructionPrinter printer = InstructionPrinter(buf, "t2");
+            if (address.second == 0) {
+                printer.mv(res_reg, address.first);
             } else {
-                load_value_addr_to_reg(out, src_val, "t0");
+                printer.addi(res_reg, address.first, address.second);
             }
-
-            Value index_val = get_koopa_value_Value(value_ptr->kind.data.get_elem_ptr.index);
-            load_value_to_reg(out, index_val, "t1");
-
-            // the size is determined by the returned pointer type
-            size_t pointer_data_size = current_func_ptr->size_of_koopa_type(value_ptr->ty->data.pointer.base);
-            InstructionPrinter printer = InstructionPrinter(out, "t2");
-            printer.mul_imm("t1", "t1", int(pointer_data_size));
-            format_instr(out, "add", "t0", "t0", "t1");
-
-            // store the value
-            auto local_var_opt = current_func_ptr->get_local_var_info(value_ptr);
-            Value store_val = Value(local_var_opt);
-            store_reg_to_value(out, store_val, "t0", "t1");
+            store_reg_to_value(buf, get_koopa_value_Value(value_ptr), res_reg, "t1");
             break;
         }
         case KOOPA_RVT_BINARY: {
-            std::string res_reg = Visit(value_ptr->kind.data.binary, reg_alloc, out);
-            auto res_var = current_func_ptr->get_local_var_info(value_ptr);
-            Value local_val = Value(res_var);
-            // WARNING: in this implementation, res_reg should be t0.
-            store_reg_to_value(out, local_val, res_reg, "t1");
+            if (current_func_ptr->is_fused_compare(value_ptr)) {
+                // evaluated by the branch that uses it
+                break;
+            }
+            std::string res_reg = Visit(value_ptr->kind.data.binary, get_result_reg(value_ptr), buf);
+            store_reg_to_value(buf, get_koopa_value_Value(value_ptr), res_reg, "t1");
             break;
         }
         case KOOPA_RVT_BRANCH: {
-            const koopa_raw_branch_t& koopa_branch = value_ptr->kind.data.branch;
-            Value condition = get_koopa_value_Value(koopa_branch.cond);
-            load_value_to_reg(out, condition, "t0");
-
-            std::string true_block_name = current_func_ptr->get_riscv_block_name(koopa_branch.true_bb);
-            std::string false_block_name = current_func_ptr->get_riscv_block_name(koopa_branch.false_bb);
-
-//            format_instr(out, "bnez", "t0", true_block_name);
-            std::string dummy_jump_block_str = DUMMY_JUMP_BLOCK_BASENAME + std::to_string(dummy_jump_block_cnt++);
-            format_instr(out, "beqz", "t0", dummy_jump_block_str);
-            format_instr(out, "j", true_block_name);
-            out << dummy_jump_block_str << ":" << std::endl;
-            format_instr(out, "j", false_block_name);
+            Visit_branch(value_ptr->kind.data.branch, buf);
             break;
         }
         case KOOPA_RVT_JUMP: {
-            std::string target_block_name = current_func_ptr->get_riscv_block_name(value_ptr->kind.data.jump.target);
-            format_instr(out, "j", target_block_name);
+            const koopa_raw_jump_t& koopa_jump = value_ptr->kind.data.jump;
+            // bind the parameters of the target, all at once since an argument may be a parameter
+            std::vector<std::pair<Value, Value>> arg_moves;
+            for (size_t i = 0; i < koopa_jump.args.len; i++) {
+                Value param_val = get_koopa_value_Value(
+                        reinterpret_cast<koopa_raw_value_t>(koopa_jump.target->params.buffer[i]));
+                Value arg_val = get_koopa_value_Value(reinterpret_cast<koopa_raw_value_t>(koopa_jump.args.buffer[i]));
+                if (param_val.type != ValueType::UNIT && arg_val.type != ValueType::UNIT) {
+                    arg_moves.emplace_back(param_val, arg_val);
+                }
+            }
+            emit_parallel_value_moves(buf, arg_moves, "t0");
+            std::string target_block_name = current_func_ptr->get_riscv_block_name(koopa_jump.target);
+            InstructionPrinter(buf, "t0").jump(target_block_name);
             break;
         }
         case KOOPA_RVT_CALL: {
             const koopa_raw_call_t& koopa_call = value_ptr->kind.data.call;
+            // Values living across the call are in callee-saved registers or on the stack,
+            // so only the arguments have to be set up here.
+            std::vector<std::pair<std::string, Value>> arg_moves;
             for (size_t i = 0; i < koopa_call.args.len; i++) {
                 Value arg_val = get_koopa_value_Value(reinterpret_cast<koopa_raw_value_t>(koopa_call.args.buffer[i]));
-                load_value_to_reg(out, arg_val, "t0");
-                store_reg_to_value(out, Value(i), "t0", "t1");
+                if (i < 8) {
+                    arg_moves.emplace_back("a" + std::to_string(i), arg_val);
+                } else {
+                    // on the stack, before any argument register is overwritten
+                    std::string arg_reg = get_value_in_reg(buf, arg_val, "t0");
+                    InstructionPrinter(buf, "t1").store_word(arg_reg, "sp", int(i - 8) * 4);
+                }
             }
+            emit_parallel_moves(buf, arg_moves, "t0");
             std::string callee_name = std::string(koopa_call.callee->name).substr(1);
-            format_instr(out, "call", callee_name);
+            InstructionPrinter printer = InstructionPrinter(buf, "t0");
+            if (current_func_ptr->is_tail_call(value_ptr)) {
+                if (koopa_call.callee == current_func_ptr->koopa_func_ptr) {
+                    // self tail recursion is a loop: the arguments are set up exactly like on entry
+                    printer.jump(current_func_ptr->get_tail_recursion_label());
+                } else {
+                    printer.print_frame_teardown(current_func_ptr->get_stack_frame_size(),
+                                                 current_func_ptr->is_leaf_function(),
+                                                 current_func_ptr->callee_saved_regs);
+                    printer.tail(callee_name);
+                }
+                break;
+            }
+            printer.call(callee_name);
 
             // store the return value
-            if (value_ptr->used_by.len > 0) {
-                auto ret_var = current_func_ptr->get_local_var_info(value_ptr);
-                Value ret_value = Value(ret_var);
-                store_reg_to_value(out, ret_value, "a0", "t0");
-            }
+            store_reg_to_value(buf, get_koopa_value_Value(value_ptr), "a0", "t0");
             break;
         }
         case KOOPA_RVT_RETURN: {
             if (value_ptr->kind.data.ret.value != nullptr) {
                 Value ret_value = get_koopa_value_Value(value_ptr->kind.data.ret.value);
-                load_value_to_reg(out, ret_value, "a0");
+                load_value_to_reg(buf, ret_value, "a0");
             }
-            InstructionPrinter printer = InstructionPrinter(out, "t0");
-            printer.print_func_epilogue(current_func_ptr->get_stack_frame_size(), current_func_ptr->is_leaf_function());
+            InstructionPrinter printer = InstructionPrinter(buf, "t0");
+            printer.print_func_epilogue(current_func_ptr->get_stack_frame_size(),
+                                        current_func_ptr->is_leaf_function(),
+                                        current_func_ptr->callee_saved_regs);
             break;
         }
         default: {
@@ -317,93 +406,366 @@ void Visit(const koopa_raw_value_t& value_ptr, RegisterAllocator& reg_alloc, std
     }
 }
 
-std::string Visit(const koopa_raw_binary_t &binary, RegisterAllocator &reg_alloc, std::ostream& out) {
-    std::string arith_op;
+// Lowers to a single conditional branch when one of the targets is the next block in the layout.
+// A fused compare turns into blt/bge/beq/bne on its operands; a > b and a <= b swap them.
+// The frontend only passes block arguments along jumps (critical edges are split for that).
+void Visit_branch(const koopa_raw_branch_t& koopa_branch, MachineInstrBuffer& buf) {
+    if (koopa_branch.true_args.len != 0 || koopa_branch.false_args.len != 0) {
+        throw std::invalid_argument("Visit_branch: branches with block arguments are not supported!");
+    }
+    MachineOpcode opcode;
+    std::string lhs_reg, rhs_reg;
+    if (current_func_ptr->is_fused_compare(koopa_branch.cond)) {
+        const koopa_raw_binary_t& compare = koopa_branch.cond->kind.data.binary;
+        lhs_reg = get_value_in_reg(buf, get_koopa_value_Value(compare.lhs), "t0");
+        rhs_reg = get_value_in_reg(buf, get_koopa_value_Value(compare.rhs), "t1");
+        switch (compare.op) {
+            case KOOPA_RBO_EQ:
+                opcode = MachineOpcode::BEQ;
+                break;
+            case KOOPA_RBO_NOT_EQ:
+                opcode = MachineOpcode::BNE;
+                break;
+            case KOOPA_RBO_LT:
+                opcode = MachineOpcode::BLT;
+                break;
+            case KOOPA_RBO_GE:
+                opcode = MachineOpcode::BGE;
+                break;
+            case KOOPA_RBO_GT:
+                opcode = MachineOpcode::BLT;
+                std::swap(lhs_reg, rhs_reg);
+                break;
+            case KOOPA_RBO_LE:
+                opcode = MachineOpcode::BGE;
+                std::swap(lhs_reg, rhs_reg);
+                break;
+            default:
+                throw std::invalid_argument("Visit_branch: fused a non-compare binary!");
+        }
+        if (lhs_reg == "zero" && (opcode == MachineOpcode::BEQ || opcode == MachineOpcode::BNE)) {
+            std::swap(lhs_reg, rhs_reg);
+        }
+        if (rhs_reg == "zero" && (opcode == MachineOpcode::BEQ || opcode == MachineOpcode::BNE)) {
+            opcode = opcode == MachineOpcode::BEQ ? MachineOpcode::BEQZ : MachineOpcode::BNEZ;
+        }
+    } else {
+        lhs_reg = get_value_in_reg(buf, get_koopa_value_Value(koopa_branch.cond), "t0");
+        opcode = MachineOpcode::BNEZ;
+    }
+
+    std::string true_block_name = current_func_ptr->get_riscv_block_name(koopa_branch.true_bb);
+    std::string false_block_name = current_func_ptr->get_riscv_block_name(koopa_branch.false_bb);
+    koopa_raw_basic_block_t fallthrough = current_func_ptr->get_next_block_in_layout(current_func_ptr->current_block);
+    InstructionPrinter printer = InstructionPrinter(buf, "t0");
+    if (fallthrough == koopa_branch.true_bb) {
+        printer.branch(invert_branch_opcode(opcode), lhs_reg, rhs_reg, false_block_name);
+    } else {
+        printer.branch(opcode, lhs_reg, rhs_reg, true_block_name);
+        if (fallthrough != koopa_branch.false_bb) {
+            printer.jump(false_block_name);
+        }
+    }
+}
+
+// The address computed by a getelemptr/getptr itself, with its source folded in if possible.
+// For both, the index is scaled by the size of what the result points to.
+AddressExpr get_pointer_offset_expr(const koopa_raw_value_t& ptr) {
+    const auto& kind = ptr->kind;
+    bool is_get_ptr = kind.tag == KOOPA_RVT_GET_PTR;
+    koopa_raw_value_t src = is_get_ptr ? kind.data.get_ptr.src : kind.data.get_elem_ptr.src;
+    koopa_raw_value_t index = is_get_ptr ? kind.data.get_ptr.index : kind.data.get_elem_ptr.index;
+    AddressExpr address = get_address_expr(src);
+    int scale = int(current_func_ptr->size_of_koopa_type(ptr->ty->data.pointer.base));
+    Value index_val = get_koopa_value_Value(index);
+    if (index_val.type == ValueType::CONST) {
+        address.offset += std::get<int>(index_val.value) * scale;
+    } else {
+        address.scaled_indices.emplace_back(index, scale);
+    }
+    return address;
+}
+
+// The address a pointer operand points to.
+AddressExpr get_address_expr(const koopa_raw_value_t& ptr) {
+    if (current_func_ptr->is_folded_pointer(ptr)) {
+        return get_pointer_offset_expr(ptr);
+    }
+    return AddressExpr(ptr);
+}
+
+// Computes the address so that it equals base_reg + offset, for the offset(base) form of lw/sw.
+// The scaled indices are accumulated in dst_reg Horner-style, as every scale is a multiple of
+// the next one: ((i * d1 + j) * d2 + k) * 4. Besides dst_reg this uses t0 and t2, and base_reg
+// is never t0.
+std::pair<std::string, int> Visit_address(const AddressExpr& address, const std::string& dst_reg,
+                                          MachineInstrBuffer& buf) {
+    InstructionPrinter printer = InstructionPrinter(buf, "t2");
+    int offset = address.offset;
+    std::string acc_reg;
+    int acc_scale = 0;
+    for (auto& scaled_index : address.scaled_indices) {
+        Value index_val = get_koopa_value_Value(scaled_index.first);
+        if (acc_reg.empty()) {
+            acc_reg = get_value_in_reg(buf, index_val, dst_reg);
+        } else {
+            if (acc_scale % scaled_index.second != 0) {
+                throw std::invalid_argument("Visit_address: scales of the folded indices do not nest!");
+            }
+            printer.mul_imm(dst_reg, acc_reg, acc_scale / scaled_index.second);
+            std::string index_reg = get_value_in_reg(buf, index_val, "t2");
+            printer.binary(MachineOpcode::ADD, dst_reg, dst_reg, index_reg);
+            acc_reg = dst_reg;
+        }
+        acc_scale = scaled_index.second;
+    }
+
+    // without indices the base itself goes to dst_reg
+    std::string base_scratch = acc_reg.empty() ? dst_reg : "t0";
+    std::string base_reg;
+    Value base_val = get_koopa_value_Value(address.base);
+    if (base_val.type == ValueType::LOCAL && !base_val.is_pointer()) {
+        // an alloc, i.e. a stack object
+        base_reg = "sp";
+        offset += int(std::get<LocalVariable>(base_val.value).offset);
+    } else if (base_val.type == ValueType::GLOBAL) {
+        base_reg = base_scratch;
+        printer.load_addr(base_reg, std::get<std::string>(base_val.value));
+    } else {
+        base_reg = get_value_in_reg(buf, base_val, base_scratch);
+    }
+
+    if (acc_reg.empty()) {
+        return {base_reg, offset};
+    }
+    printer.mul_imm(dst_reg, acc_reg, acc_scale);
+    printer.binary(MachineOpcode::ADD, dst_reg, base_reg, dst_reg);
+    return {dst_reg, offset};
+}
+
+// The op that gives the same result with the operands swapped, if there is one.
+std::optional<koopa_raw_binary_op_t> get_mirrored_binary_op(koopa_raw_binary_op_t op) {
+    switch (op) {
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_MUL:
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ:
+            return op;
+        case KOOPA_RBO_LT:
+            return KOOPA_RBO_GT;
+        case KOOPA_RBO_GT:
+            return KOOPA_RBO_LT;
+        case KOOPA_RBO_LE:
+            return KOOPA_RBO_GE;
+        case KOOPA_RBO_GE:
+            return KOOPA_RBO_LE;
+        default:
+            return std::nullopt;
+    }
+}
+
+// res = lhs op imm with the immediate encoded in the instruction. Returns false when op has
+// no such form or imm does not fit into 12 bits.
+bool Visit_binary_imm(koopa_raw_binary_op_t op, const std::string& lhs_reg, int imm,
+                      const std::string& res_reg, MachineInstrBuffer& buf) {
+    InstructionPrinter printer = InstructionPrinter(buf, "t2");
+    int64_t imm64 = imm;
+    switch (op) {
+        case KOOPA_RBO_ADD:
+            if (!within_12(imm)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::ADDI, res_reg, lhs_reg, imm);
+            return true;
+        case KOOPA_RBO_SUB:
+            // a - imm <=> a + (-imm)
+            if (imm64 == INT32_MIN || !within_12(-imm)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::ADDI, res_reg, lhs_reg, -imm);
+            return true;
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR: {
+            if (!within_12(imm)) {
+                return false;
+            }
+            MachineOpcode opcode = op == KOOPA_RBO_AND ? MachineOpcode::ANDI
+                                 : op == KOOPA_RBO_OR  ? MachineOpcode::ORI
+                                                       : MachineOpcode::XORI;
+            printer.binary_imm(opcode, res_reg, lhs_reg, imm);
+            return true;
+        }
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ: {
+            MachineOpcode opcode = op == KOOPA_RBO_EQ ? MachineOpcode::SEQZ : MachineOpcode::SNEZ;
+            if (imm == 0) {
+                printer.unary(opcode, res_reg, lhs_reg);
+                return true;
+            }
+            if (!within_12(imm)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::XORI, res_reg, lhs_reg, imm);
+            printer.unary(opcode, res_reg, res_reg);
+            return true;
+        }
+        case KOOPA_RBO_LT:
+            if (!within_12(imm)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::SLTI, res_reg, lhs_reg, imm);
+            return true;
+        case KOOPA_RBO_GE:
+            // a >= imm <=> !(a < imm)
+            if (!within_12(imm)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::SLTI, res_reg, lhs_reg, imm);
+            printer.binary_imm(MachineOpcode::XORI, res_reg, res_reg, 1);
+            return true;
+        case KOOPA_RBO_LE:
+            // a <= imm <=> a < imm + 1
+            if (imm64 == INT32_MAX || !within_12(imm + 1)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::SLTI, res_reg, lhs_reg, imm + 1);
+            return true;
+        case KOOPA_RBO_GT:
+            // a > imm <=> !(a < imm + 1)
+            if (imm64 == INT32_MAX || !within_12(imm + 1)) {
+                return false;
+            }
+            printer.binary_imm(MachineOpcode::SLTI, res_reg, lhs_reg, imm + 1);
+            printer.binary_imm(MachineOpcode::XORI, res_reg, res_reg, 1);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Computes the binary into res_reg. Both operands are read before res_reg is written,
+// so res_reg may be the register of one of them.
+std::string Visit(const koopa_raw_binary_t &binary, const std::string& res_reg, MachineInstrBuffer& buf) {
+    MachineOpcode arith_op = MachineOpcode::ADD;
     bool instr_complete = false;
 
+    koopa_raw_binary_op_t op = binary.op;
     Value lhs = get_koopa_value_Value(binary.lhs);
     Value rhs = get_koopa_value_Value(binary.rhs);
 
-    load_value_to_reg(out, lhs, "t0");
-    load_value_to_reg(out, rhs, "t1");
+    InstructionPrinter printer = InstructionPrinter(buf, "t2");
+
+    // keep a constant operand on the right, where the immediate forms take it
+    if (lhs.type == ValueType::CONST && rhs.type != ValueType::CONST) {
+        std::optional<koopa_raw_binary_op_t> mirrored_op = get_mirrored_binary_op(op);
+        if (mirrored_op.has_value()) {
+            op = mirrored_op.value();
+            std::swap(lhs, rhs);
+        }
+    }
+
+    std::string lhs_reg = get_value_in_reg(buf, lhs, "t0");
+    if (rhs.type == ValueType::CONST) {
+        int imm = std::get<int>(rhs.value);
+        // strength reduction: multiply, divide and remainder by a constant
+        if (op == KOOPA_RBO_MUL) {
+            printer.mul_imm(res_reg, lhs_reg, imm);
+            return res_reg;
+        }
+        if (op == KOOPA_RBO_DIV) {
+            printer.div_imm(res_reg, lhs_reg, imm, "t1");
+            return res_reg;
+        }
+        if (op == KOOPA_RBO_MOD) {
+            printer.rem_imm(res_reg, lhs_reg, imm, "t1");
+            return res_reg;
+        }
+        if (Visit_binary_imm(op, lhs_reg, imm, res_reg, buf)) {
+            return res_reg;
+        }
+    }
+    std::string rhs_reg = get_value_in_reg(buf, rhs, "t1");
 
-    InstructionPrinter printer = InstructionPrinter(out, "t2");
-    switch (binary.op) {
+    switch (op) {
         case KOOPA_RBO_EQ: {
-            format_instr(out, "xor", "t0", "t0", "t1");
-            format_instr(out, "seqz", "t0", "t0");
+            printer.binary(MachineOpcode::XOR, res_reg, lhs_reg, rhs_reg);
+            printer.unary(MachineOpcode::SEQZ, res_reg, res_reg);
             instr_complete = true;
             break;
         }
         case KOOPA_RBO_NOT_EQ: {
-            format_instr(out, "xor", "t0", "t0", "t1");
-            format_instr(out, "snez", "t0", "t0");
+            printer.binary(MachineOpcode::XOR, res_reg, lhs_reg, rhs_reg);
+            printer.unary(MachineOpcode::SNEZ, res_reg, res_reg);
             instr_complete = true;
             break;
         }
         case KOOPA_RBO_LE: {
             // a <= b <=> !(a > b)
             // use slt (sgt is a pseudo instr, though)
-            format_instr(out, "slt", "t0", "t1", "t0");
-            format_instr(out, "seqz", "t0", "t0");
+            printer.binary(MachineOpcode::SLT, res_reg, rhs_reg, lhs_reg);
+            printer.unary(MachineOpcode::SEQZ, res_reg, res_reg);
             instr_complete = true;
             break;
         }
         case KOOPA_RBO_GE: {
             // a >= b <=> !(a < b)
-            format_instr(out, "slt", "t0", "t0", "t1");
-            format_instr(out, "seqz", "t0", "t0");
+            printer.binary(MachineOpcode::SLT, res_reg, lhs_reg, rhs_reg);
+            printer.unary(MachineOpcode::SEQZ, res_reg, res_reg);
             instr_complete = true;
             break;
         }
         case KOOPA_RBO_GT: {
             // use slt (sgt is a pseudo instr, though)
-            format_instr(out, "slt", "t0", "t1", "t0");
+            printer.binary(MachineOpcode::SLT, res_reg, rhs_reg, lhs_reg);
             instr_complete = true;
             break;
         }
         case KOOPA_RBO_LT: {
-            arith_op = "slt";
+            arith_op = MachineOpcode::SLT;
             break;
         }
         case KOOPA_RBO_AND: {
-            arith_op = "and";
+            arith_op = MachineOpcode::AND;
             break;
         }
         case KOOPA_RBO_OR: {
-            arith_op = "or";
+            arith_op = MachineOpcode::OR;
             break;
         }
         case KOOPA_RBO_SUB: {
-            arith_op = "sub";
+            arith_op = MachineOpcode::SUB;
             break;
         }
         case KOOPA_RBO_ADD: {
-            arith_op = "add";
+            arith_op = MachineOpcode::ADD;
             break;
         }
         case KOOPA_RBO_MUL: {
-            arith_op = "mul";
+            arith_op = MachineOpcode::MUL;
             break;
         }
         case KOOPA_RBO_DIV: {
-            arith_op = "div";
+            arith_op = MachineOpcode::DIV;
             break;
         }
         case KOOPA_RBO_MOD: {
-            arith_op = "rem";
+            arith_op = MachineOpcode::REM;
             break;
         }
         default:
             std::cout << "------ Error information -------" << std::endl;
-            std::cout << "Invalid binary operation:" << binary.op << std::endl;
+            std::cout << "Invalid binary operation:" << op << std::endl;
             throw std::invalid_argument("Invalid binary operation!");
     }
     if (!instr_complete) {
-        format_instr(out, arith_op, "t0", "t0", "t1");
+        printer.binary(arith_op, res_reg, lhs_reg, rhs_reg);
     }
 
-    return std::string("t0");
+    return res_reg;
 }
 
 #endif //COMPILER_VISIT_RAW_PROGRAM_H
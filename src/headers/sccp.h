@@ -0,0 +1,314 @@
+#ifndef COMPILER_SCCP_H
+#define COMPILER_SCCP_H
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "cfg.h"
+#include "fold.h"
+#include "function.h"
+
+/* Sparse conditional constant propagation (Wegman and Zadeck) over a function in SSA form.
+ * Every value starts as undefined and can only go down to a constant and then to overdefined.
+ * A block is only evaluated once an edge into it is known to be taken, and a branch on a
+ * constant only takes one of its edges, so
+ *     if (DEBUG) { ... }          with DEBUG a constant, or a global never stored to
+ * loses the whole region: the branch becomes a jump and the blocks behind it are removed.
+ * The parameters of a block meet the arguments of the taken edges into it.
+ */
+class ConstantPropagation {
+public:
+    ConstantPropagation(Function& _func, const std::unordered_map<Symbol, int>& _constant_globals):
+            func(_func), constant_globals(_constant_globals) { }
+
+    void run() {
+        collect_defs_and_users();
+        solve();
+        rewrite();
+    }
+
+private:
+    class LatticeValue {
+    public:
+        enum Kind {
+            UNDEFINED,
+            CONSTANT,
+            OVERDEFINED,
+        };
+        Kind kind = UNDEFINED;
+        int value = 0;
+
+        static LatticeValue constant(int value) {
+            LatticeValue lattice_value;
+            lattice_value.kind = CONSTANT;
+            lattice_value.value = value;
+            return lattice_value;
+        }
+
+        static LatticeValue overdefined() {
+            LatticeValue lattice_value;
+            lattice_value.kind = OVERDEFINED;
+            return lattice_value;
+        }
+
+        LatticeValue meet(const LatticeValue& other) const {
+            if (kind == UNDEFINED) {
+                return other;
+            }
+            if (other.kind == UNDEFINED) {
+                return *this;
+            }
+            if (kind == CONSTANT && other.kind == CONSTANT && value == other.value) {
+                return *this;
+            }
+            return overdefined();
+        }
+
+        bool operator==(const LatticeValue& other) const {
+            return kind == other.kind && (kind != CONSTANT || value == other.value);
+        }
+    };
+
+    Function& func;
+    const std::unordered_map<Symbol, int>& constant_globals;
+    std::unordered_map<Symbol, BasicBlock*> block_by_name;
+    std::unordered_map<Symbol, LatticeValue> values;  // the values defined in the function
+    std::unordered_map<Symbol, std::vector<BasicBlock*> > user_blocks;
+    std::unordered_map<BasicBlock*, std::vector<std::pair<BasicBlock*, Instruction*> > > incoming_jumps;
+    std::set<std::pair<BasicBlock*, BasicBlock*> > executable_edges;
+    std::unordered_set<BasicBlock*> executable_blocks;
+    std::vector<BasicBlock*> worklist;
+
+    // ADD through XOR
+    static bool is_binary(OpType op_type) {
+        return op_type >= OpType::ADD;
+    }
+
+    // the operands an instruction reads, the arguments included
+    static std::vector<Operand*> get_uses(Instruction& instr) {
+        std::vector<Operand*> uses;
+        bool defines = instr.get_result().has_value();
+        for (auto op : {&instr.t0, &instr.t1, &instr.t2}) {
+            if (op->has_value() && !(defines && op == &instr.t0)) {
+                uses.push_back(&op->value());
+            }
+        }
+        if (instr.param_list.has_value()) {
+            for (auto& param : instr.param_list.value()) {
+                uses.push_back(&param);
+            }
+        }
+        return uses;
+    }
+
+    LatticeValue get_value(const Operand& op) const {
+        if (std::holds_alternative<int>(op.assoc_val)) {
+            return LatticeValue::constant(std::get<int>(op.assoc_val));
+        }
+        auto it = values.find(std::get<Symbol>(op.assoc_val));
+        // function parameters, allocs and globals
+        return it == values.end() ? LatticeValue::overdefined() : it->second;
+    }
+
+    void collect_defs_and_users() {
+        for (auto block_ptr : func.get_blocks()) {
+            block_by_name.emplace(block_ptr->basic_block_name, block_ptr);
+        }
+        for (auto block_ptr : func.get_blocks()) {
+            for (auto& param : block_ptr->params) {
+                values.emplace(std::get<Symbol>(param.assoc_val), LatticeValue());
+            }
+            std::vector<Instruction*> instrs;
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                instrs.push_back(instr_ptr);
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                instrs.push_back(block_ptr->ending_instruction);
+            }
+            for (auto instr : instrs) {
+                auto result = instr->get_result();
+                if (result.has_value()) {
+                    values.emplace(result.value(), LatticeValue());
+                }
+                for (auto use : get_uses(*instr)) {
+                    if (std::holds_alternative<Symbol>(use->assoc_val)) {
+                        user_blocks[std::get<Symbol>(use->assoc_val)].push_back(block_ptr);
+                    }
+                }
+                if (instr->op_type == OpType::JUMP) {
+                    // the arguments are read by the parameters of the target
+                    BasicBlock* target = block_by_name.at(std::get<Symbol>(instr->t0->assoc_val));
+                    incoming_jumps[target].emplace_back(block_ptr, instr);
+                    for (auto& arg : instr->param_list.value_or(std::vector<Operand>())) {
+                        if (std::holds_alternative<Symbol>(arg.assoc_val)) {
+                            user_blocks[std::get<Symbol>(arg.assoc_val)].push_back(target);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void set_value(Symbol name, const LatticeValue& new_value) {
+        LatticeValue& value = values.at(name);
+        LatticeValue lowered = value.meet(new_value);
+        if (lowered == value) {
+            return;
+        }
+        value = lowered;
+        for (auto user_block : user_blocks[name]) {
+            if (executable_blocks.count(user_block)) {
+                worklist.push_back(user_block);
+            }
+        }
+    }
+
+    void mark_edge(BasicBlock* from, const Operand& target_op) {
+        BasicBlock* target = block_by_name.at(std::get<Symbol>(target_op.assoc_val));
+        if (executable_edges.emplace(from, target).second) {
+            executable_blocks.insert(target);
+            worklist.push_back(target);
+        }
+    }
+
+    void evaluate(const Instruction& instr) {
+        auto result = instr.get_result();
+        if (!result.has_value()) {
+            return;
+        }
+        if (instr.op_type == OpType::LOAD) {
+            auto it = constant_globals.find(std::get<Symbol>(instr.t1->assoc_val));
+            set_value(result.value(), it == constant_globals.end() ? LatticeValue::overdefined()
+                                                                   : LatticeValue::constant(it->second));
+            return;
+        }
+        if (!is_binary(instr.op_type)) {
+            set_value(result.value(), LatticeValue::overdefined());
+            return;
+        }
+        LatticeValue lhs = get_value(instr.t1.value()), rhs = get_value(instr.t2.value());
+        if (lhs.kind == LatticeValue::OVERDEFINED || rhs.kind == LatticeValue::OVERDEFINED) {
+            set_value(result.value(), LatticeValue::overdefined());
+        } else if (lhs.kind == LatticeValue::CONSTANT && rhs.kind == LatticeValue::CONSTANT) {
+            auto folded = ConstantFolder::fold(instr.op_type, lhs.value, rhs.value);
+            set_value(result.value(), folded.has_value() ? LatticeValue::constant(folded.value())
+                                                         : LatticeValue::overdefined());
+        }
+    }
+
+    void visit_block(BasicBlock* block_ptr) {
+        for (size_t i = 0; i < block_ptr->params.size(); i++) {
+            LatticeValue param_value;
+            for (auto& [pred, jump] : incoming_jumps[block_ptr]) {
+                if (executable_edges.count({pred, block_ptr})) {
+                    param_value = param_value.meet(get_value(jump->param_list.value()[i]));
+                }
+            }
+            set_value(std::get<Symbol>(block_ptr->params[i].assoc_val), param_value);
+        }
+        for (auto& instr_ptr : block_ptr->instruction_lists) {
+            evaluate(*instr_ptr);
+        }
+        const auto& ending = block_ptr->ending_instruction;
+        if (ending == nullptr) {
+            return;
+        }
+        if (ending->op_type == OpType::JUMP) {
+            mark_edge(block_ptr, ending->t0.value());
+        } else if (ending->op_type == OpType::BR) {
+            LatticeValue cond = get_value(ending->t0.value());
+            if (cond.kind == LatticeValue::CONSTANT) {
+                mark_edge(block_ptr, cond.value != 0 ? ending->t1.value() : ending->t2.value());
+            } else if (cond.kind == LatticeValue::OVERDEFINED) {
+                mark_edge(block_ptr, ending->t1.value());
+                mark_edge(block_ptr, ending->t2.value());
+            }
+        }
+    }
+
+    void solve() {
+        BasicBlock* entry = func.entry_block_ptr;
+        executable_blocks.insert(entry);
+        worklist.push_back(entry);
+        while (!worklist.empty()) {
+            BasicBlock* block_ptr = worklist.back();
+            worklist.pop_back();
+            visit_block(block_ptr);
+        }
+    }
+
+    std::optional<int> get_constant(const Operand& op) const {
+        LatticeValue value = get_value(op);
+        if (std::holds_alternative<Symbol>(op.assoc_val) && value.kind == LatticeValue::CONSTANT) {
+            return value.value;
+        }
+        return std::nullopt;
+    }
+
+    void rewrite() {
+        // branches on constants become jumps, after which the blocks never reached are unreachable
+        for (auto block_ptr : func.get_blocks()) {
+            auto& ending = block_ptr->ending_instruction;
+            if (!executable_blocks.count(block_ptr) || ending == nullptr || ending->op_type != OpType::BR) {
+                continue;
+            }
+            LatticeValue cond = get_value(ending->t0.value());
+            if (cond.kind == LatticeValue::CONSTANT) {
+                Operand target = cond.value != 0 ? ending->t1.value() : ending->t2.value();
+                ending = ir_arena.make<Instruction>(OpType::JUMP, target);
+            }
+        }
+        ControlFlowGraph::remove_unreachable_blocks(func);
+
+        // the edges left are exactly the executable ones, so a jump from a block that is kept
+        // is a jump from an executable block
+
+        for (auto block_ptr : func.get_blocks()) {
+            for (size_t i = block_ptr->params.size(); i-- > 0;) {
+                if (!get_constant(block_ptr->params[i]).has_value()) {
+                    continue;
+                }
+                block_ptr->params.erase(block_ptr->params.begin() + i);
+                for (auto& [pred, jump] : incoming_jumps[block_ptr]) {
+                    if (executable_blocks.count(pred)) {
+                        jump->param_list->erase(jump->param_list->begin() + i);
+                    }
+                }
+            }
+        }
+
+        for (auto block_ptr : func.get_blocks()) {
+            std::vector<Instruction*> instrs;
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                // only arithmetic and loads of constant globals can be constants, neither has side effects
+                auto result = instr_ptr->get_result();
+                if (result.has_value() && get_constant(Operand(result.value())).has_value()) {
+                    continue;
+                }
+                instrs.push_back(instr_ptr);
+            }
+            block_ptr->instruction_lists = std::move(instrs);
+            std::vector<Instruction*> remaining;
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                remaining.push_back(instr_ptr);
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                remaining.push_back(block_ptr->ending_instruction);
+            }
+            for (auto instr : remaining) {
+                for (auto use : get_uses(*instr)) {
+                    auto constant = get_constant(*use);
+                    if (constant.has_value()) {
+                        *use = Operand(constant.value());
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif //COMPILER_SCCP_H
@@ -3,90 +3,116 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "variable.h"
 #include "function.h"
 
 class Scope {
-    std::vector<std::unordered_map<std::string, Variable> > scoped_symbol_tables;
+    std::vector<std::unordered_map<Symbol, Variable> > scoped_symbol_tables;
 public:
     Scope() {
-        scoped_symbol_tables = std::vector<std::unordered_map<std::string, Variable> >{
-            std::unordered_map<std::string, Variable>()
+        scoped_symbol_tables = std::vector<std::unordered_map<Symbol, Variable> >{
+            std::unordered_map<Symbol, Variable>()
         };
         register_lib_funcs();
     }
 
     std::unique_ptr<Function> current_func_ptr;
     std::vector<Signature> func_signatures;
+    std::unordered_map<Symbol, size_t> signature_index;  // ident -> the first of func_signatures with it
     std::vector<Signature> lib_func_signatures;
+    // the globals and the functions, whose idents the local variables are numbered around
+    std::unordered_set<Symbol> reserved_idents;
+
+    // ident, unless it is taken by a global the compiler added, e.g. the template of an array initializer
+    Symbol get_global_ident(Symbol ident) {
+        Symbol name = ident;
+        size_t count = 0;
+        while (reserved_idents.count(name) > 0) {
+            name = ident.suffixed(count++);
+        }
+        return name;
+    }
+
+    Symbol get_global_koopa_var_name(Symbol ident) {
+        return get_global_ident(ident).prefixed("@");
+    }
 
-    Signature register_signature(const std::unique_ptr<Function>& func_ptr) {
+    Signature register_signature(Symbol ident, const std::unique_ptr<Function>& func_ptr) {
         std::vector<OperandType> op_type_list;
         for (auto& param : func_ptr->param_list) {
             op_type_list.push_back(param.type);
         }
         Signature sign = Signature(func_ptr->func_type,
-                                   func_ptr->ident,
+                                   ident,
                                    op_type_list);
+        sign.koopa_ident = func_ptr->ident;
+        signature_index.emplace(ident, func_signatures.size());
         func_signatures.push_back(sign);
         return sign;
     }
 
-    FuncType get_func_type_by_ident(std::string ident) {
-        for (auto& sign : func_signatures) {
-            if (ident == sign.ident) {
-                return sign.func_type;
-            }
+    const Signature& get_signature_by_ident(Symbol ident) {
+        auto it = signature_index.find(ident);
+        if (it != signature_index.end()) {
+            return func_signatures[it->second];
         }
-        throw std::invalid_argument("In FuncType::get_func_type_by_ident: " + ident + " not found in signature!");
+        throw std::invalid_argument("In Scope::get_signature_by_ident: " + ident.str() + " not found in signature!");
+    }
+
+    FuncType get_func_type_by_ident(Symbol ident) {
+        return get_signature_by_ident(ident).func_type;
     }
 
     void alloc_and_store_for_params(std::unique_ptr<Function>& func_ptr) {
         assert(func_ptr->param_list.size() == func_ptr->original_param_ident_list.size());
-        for (auto i = 0; i < func_ptr->param_list.size(); i++) {
+        for (size_t i = 0; i < func_ptr->param_list.size(); i++) {
             // alloc
-            std::string temp_var_name = "@" + func_ptr->get_koopa_var_name(func_ptr->original_param_ident_list[i]);
+            Symbol temp_var_name = func_ptr->get_koopa_var_name(func_ptr->original_param_ident_list[i]).prefixed("@");
             Operand alloc_op = Operand(temp_var_name,
                                        func_ptr->param_list[i].type,
                                        true);
-            auto alloc_instr = std::make_unique<Instruction>(OpType::ALLOC,
-                                                             alloc_op);
-            func_ptr->entry_block_ptr->instruction_lists.push_back(std::move(alloc_instr));
+            auto alloc_instr = ir_arena.make<Instruction>(OpType::ALLOC,
+                                                          alloc_op);
+            func_ptr->entry_block_ptr->instruction_lists.push_back(alloc_instr);
             // insert into the symbol table
             Variable var = Variable(func_ptr->param_list[i].type, false, temp_var_name);
             insert_var(func_ptr->original_param_ident_list[i], var);
             // store
             Operand param_op = Operand(func_ptr->param_list[i].koopa_var_name,
                                        func_ptr->param_list[i].type);
-            auto store_instr = std::make_unique<Instruction>(OpType::STORE,
-                                                             param_op,
-                                                             alloc_op);
-            func_ptr->append_instr_to_current_block(std::move(store_instr));
+            auto store_instr = ir_arena.make<Instruction>(OpType::STORE,
+                                                          param_op,
+                                                          alloc_op);
+            func_ptr->append_instr_to_current_block(store_instr);
         }
     }
 
-    const Variable& get_var_by_ident(std::string ident) {
+    const Variable& get_var_by_ident(Symbol ident) {
         for (auto it = scoped_symbol_tables.rbegin();
                 it != scoped_symbol_tables.rend();
                 it++) {
-            std::unordered_map<std::string, Variable>& current_table = *it;
+            std::unordered_map<Symbol, Variable>& current_table = *it;
             auto target_pair_it = current_table.find(ident);
             if (target_pair_it != current_table.end()) {
                 // ident exists in this table
                 return target_pair_it->second;
             }
         }
-        throw std::invalid_argument("In Scope::get_var_by_ident: ident " + ident + " not found.");
+        throw std::invalid_argument("In Scope::get_var_by_ident: ident " + ident.str() + " not found.");
     }
 
-    void insert_var(std::string ident, const Variable& var) {
-        std::unordered_map<std::string, Variable>& current_table = *scoped_symbol_tables.rbegin();  // back()
+    void insert_var(Symbol ident, const Variable& var) {
+        std::unordered_map<Symbol, Variable>& current_table = *scoped_symbol_tables.rbegin();  // back()
         current_table.emplace(ident, var);
+        if (scoped_symbol_tables.size() == 1) {
+            reserved_idents.insert(ident);
+        }
     }
 
     void push_scope() {
-        auto new_table = std::unordered_map<std::string, Variable>();
+        auto new_table = std::unordered_map<Symbol, Variable>();
         scoped_symbol_tables.push_back(new_table);
     }
 
@@ -94,21 +120,18 @@ public:
         scoped_symbol_tables.pop_back();
     }
 
-    void enter_func(FuncType type, std::string func_ident) {
-        current_func_ptr = std::make_unique<Function>(type, func_ident);
+    void enter_func(FuncType type, Symbol func_ident) {
+        current_func_ptr = std::make_unique<Function>(type, get_global_ident(func_ident));
         push_scope();
-        auto& global_symbol_table = scoped_symbol_tables[0];
-        for (const auto& [key, value] : global_symbol_table) {
-            current_func_ptr->get_koopa_var_name(key);  // key is the ident
-        }
-        for (const auto& signature: func_signatures) {
-            current_func_ptr->get_koopa_var_name(signature.ident);
-        }
+        current_func_ptr->reserved_idents = &reserved_idents;
     }
 
     void exit_func() {
         current_func_ptr = nullptr;
         pop_scope();
+        // a function's own ident is reserved from the next function on, as it is registered after enter_func
+        reserved_idents.insert(func_signatures.back().ident);
+        reserved_idents.insert(func_signatures.back().koopa_ident);
     }
 
     void register_lib_funcs() {
@@ -140,14 +163,20 @@ public:
         lib_func_signatures.push_back(stoptime);
 
         // append the signatures
-        func_signatures.insert(func_signatures.end(), lib_func_signatures.begin(), lib_func_signatures.end());
+        for (const auto& signature : lib_func_signatures) {
+            signature_index.emplace(signature.ident, func_signatures.size());
+            func_signatures.push_back(signature);
+        }
+        for (const auto& signature : lib_func_signatures) {
+            reserved_idents.insert(signature.ident);
+        }
     }
 
-    void DumpStdlibSignatures(std::ostream& out) {
+    void DumpStdlibSignatures(OutputWriter& out) {
         for (auto signature: lib_func_signatures) {
-            out << "decl " << signature << std::endl;
+            out << "decl " << signature << '\n';
         }
-        out << std::endl;
+        out << '\n';
     }
 };
 
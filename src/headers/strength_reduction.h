@@ -0,0 +1,256 @@
+#ifndef COMPILER_STRENGTH_REDUCTION_H
+#define COMPILER_STRENGTH_REDUCTION_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cfg.h"
+#include "function.h"
+
+/* Strength reduction of the addresses computed in loops. A param i of a loop header to which
+ * every back edge passes i + c, with c a constant, is an induction variable, and an address
+ *     %p = getelemptr base, i + k            (or getptr)
+ * with base computed outside the loop and k a constant becomes a param of the header too:
+ *     %preheader:                            %latch:
+ *       %q0 = getelemptr base, init + k        %q1 = getptr %q, c
+ *       jump %header(init, %q0)                jump %header(%i1, %q1)
+ * so that an iteration moves the pointer by c elements instead of multiplying i by the size of
+ * an element and adding it to base. For a[i][j] the row a[i] left in the preheader of the inner
+ * loop by LoopInvariantCodeMotion is reduced in the outer loop in turn.
+ * The exit test still compares i, Koopa having no comparison of pointers.
+ */
+class StrengthReduction {
+public:
+    StrengthReduction(Function& _func, int& _temp_var): func(_func), temp_var(_temp_var) { }
+
+    void run() {
+        ControlFlowGraph cfg(func);
+        collect_defs(cfg);
+        for (auto& loop : cfg.find_loops()) {
+            reduce(cfg, loop);
+        }
+        apply_replaced();
+    }
+
+private:
+    // i + k with i a param of a header
+    class AffineIndex {
+    public:
+        size_t param_idx;
+        int offset;
+    };
+
+    Function& func;
+    int& temp_var;
+    std::unordered_map<Symbol, Instruction*> defs;
+    std::unordered_map<Symbol, size_t> def_blocks;  // the block defining a param or an instruction
+    std::unordered_map<Symbol, Operand> replaced;  // the addresses reduced -> their params
+
+    void collect_defs(const ControlFlowGraph& cfg) {
+        for (size_t b = 0; b < cfg.blocks.size(); b++) {
+            for (auto& param : cfg.blocks[b]->params) {
+                def_blocks.emplace(param.get_name(), b);
+            }
+            for (auto& instr_ptr : cfg.blocks[b]->instruction_lists) {
+                if (instr_ptr->t0.has_value() && instr_ptr->t0->is_name()
+                    && instr_ptr->op_type != OpType::STORE && instr_ptr->op_type != OpType::CALL) {
+                    defs.emplace(instr_ptr->t0->get_name(), instr_ptr);
+                    def_blocks.emplace(instr_ptr->t0->get_name(), b);
+                }
+            }
+        }
+    }
+
+    Operand new_temp(const OperandType& type) {
+        Operand op(Symbol::temp(temp_var++));
+        op.type = type;
+        return op;
+    }
+
+    // op as base + k, with k a constant, if it is computed so
+    std::optional<std::pair<Symbol, int> > get_offset_from(const Operand& op) const {
+        if (!op.is_name()) {
+            return std::nullopt;
+        }
+        auto it = defs.find(op.get_name());
+        if (it != defs.end()
+            && (it->second->op_type == OpType::ADD || it->second->op_type == OpType::SUB)
+            && it->second->t1.has_value() && it->second->t2.has_value()) {
+            const Instruction& def = *it->second;
+            const Operand& lhs = def.t1.value();
+            const Operand& rhs = def.t2.value();
+            if (def.op_type == OpType::ADD && lhs.is_name() && !rhs.is_name()) {
+                return std::make_pair(lhs.get_name(), std::get<int>(rhs.assoc_val));
+            }
+            if (def.op_type == OpType::ADD && !lhs.is_name() && rhs.is_name()) {
+                return std::make_pair(rhs.get_name(), std::get<int>(lhs.assoc_val));
+            }
+            if (def.op_type == OpType::SUB && lhs.is_name() && !rhs.is_name()
+                && std::get<int>(rhs.assoc_val) != INT32_MIN) {
+                return std::make_pair(lhs.get_name(), -std::get<int>(rhs.assoc_val));
+            }
+        }
+        return std::make_pair(op.get_name(), 0);
+    }
+
+    static void append_before_ending(BasicBlock* block_ptr, Instruction* instr) {
+        block_ptr->instruction_lists.push_back(instr);
+    }
+
+    void reduce(const ControlFlowGraph& cfg, const NaturalLoop& loop) {
+        BasicBlock* header = cfg.blocks[loop.header];
+        if (header->params.empty()) {
+            return;
+        }
+        std::unordered_set<size_t> in_loop(loop.body.begin(), loop.body.end());
+        // the jumps into the header, every edge into a block with params being a jump
+        std::vector<std::pair<size_t, Instruction*> > entering, back_edges;
+        for (auto pred : cfg.predecessors[loop.header]) {
+            Instruction* jump = cfg.blocks[pred]->ending_instruction;
+            (in_loop.count(pred) ? back_edges : entering).emplace_back(pred, jump);
+        }
+
+        // the step of each param along each back edge, if it is an induction variable
+        std::unordered_map<Symbol, size_t> param_index;
+        std::vector<std::optional<std::vector<int> > > steps(header->params.size());
+        for (size_t i = 0; i < header->params.size(); i++) {
+            Symbol param = header->params[i].get_name();
+            param_index.emplace(param, i);
+            std::vector<int> param_steps;
+            for (auto& [pred, jump] : back_edges) {
+                auto offset = get_offset_from(jump->param_list.value()[i]);
+                if (!offset.has_value() || offset->first != param) {
+                    break;
+                }
+                param_steps.push_back(offset->second);
+            }
+            if (param_steps.size() == back_edges.size()) {
+                steps[i] = param_steps;
+            }
+        }
+        auto get_affine_index = [&](const Operand& index) -> std::optional<AffineIndex> {
+            auto offset = get_offset_from(index);
+            if (!offset.has_value()) {
+                return std::nullopt;
+            }
+            auto it = param_index.find(offset->first);
+            if (it == param_index.end() || !steps[it->second].has_value()) {
+                return std::nullopt;
+            }
+            return AffineIndex{it->second, offset->second};
+        };
+        auto is_invariant = [&](const Operand& op) {
+            return !op.is_name() || !def_blocks.count(op.get_name()) || !in_loop.count(def_blocks.at(op.get_name()));
+        };
+
+        // the addresses with the same (getelemptr or getptr, base, i, k) share a param
+        std::map<std::tuple<OpType, Symbol, size_t, int>, std::vector<Instruction*> > groups;
+        for (auto b : loop.body) {
+            for (auto& instr_ptr : cfg.blocks[b]->instruction_lists) {
+                if (instr_ptr->op_type != OpType::GETELEMPTR && instr_ptr->op_type != OpType::GETPTR) {
+                    continue;
+                }
+                const Operand& base = instr_ptr->t1.value();
+                auto index = get_affine_index(instr_ptr->t2.value());
+                if (!base.is_name() || !is_invariant(base) || !index.has_value()) {
+                    continue;
+                }
+                groups[{instr_ptr->op_type, base.get_name(), index->param_idx, index->offset}].push_back(instr_ptr);
+            }
+        }
+
+        std::unordered_set<Instruction*> reduced;
+        for (auto& [key, instrs] : groups) {
+            OpType op_type = std::get<0>(key);
+            size_t param_idx = std::get<2>(key);
+            int offset = std::get<3>(key);
+            const Operand base = instrs[0]->t1.value();
+            const OperandType& type = instrs[0]->t0->type;
+            Operand param = new_temp(type);
+            header->params.push_back(param);
+            def_blocks.emplace(param.get_name(), loop.header);
+
+            for (auto& [pred, jump] : entering) {
+                const Operand& init = jump->param_list.value()[param_idx];
+                Operand index = init;
+                if (!init.is_name()) {
+                    index = Operand(ConstantFolder::fold(OpType::ADD, std::get<int>(init.assoc_val), offset).value());
+                } else if (offset != 0) {
+                    index = Operand(Symbol::temp(temp_var++));
+                    append_before_ending(cfg.blocks[pred], ir_arena.make<Instruction>(OpType::ADD, index, init,
+                                                                                      Operand(offset)));
+                    def_blocks.emplace(index.get_name(), pred);
+                }
+                Operand address = new_temp(type);
+                auto address_instr = ir_arena.make<Instruction>(op_type, address, base, index);
+                defs.emplace(address.get_name(), address_instr);
+                def_blocks.emplace(address.get_name(), pred);
+                append_before_ending(cfg.blocks[pred], address_instr);
+                jump->param_list->push_back(address);
+            }
+            for (size_t e = 0; e < back_edges.size(); e++) {
+                auto& [pred, jump] = back_edges[e];
+                int step = steps[param_idx].value()[e];
+                if (step == 0) {
+                    jump->param_list->push_back(param);
+                    continue;
+                }
+                Operand next = new_temp(type);
+                append_before_ending(cfg.blocks[pred], ir_arena.make<Instruction>(OpType::GETPTR, next, param,
+                                                                                  Operand(step)));
+                def_blocks.emplace(next.get_name(), pred);
+                jump->param_list->push_back(next);
+            }
+            for (auto instr : instrs) {
+                replaced.emplace(instr->t0->get_name(), param);
+                defs.erase(instr->t0->get_name());
+                reduced.insert(instr);
+            }
+        }
+
+        for (auto b : loop.body) {
+            auto& instr_ptrs = cfg.blocks[b]->instruction_lists;
+            instr_ptrs.erase(std::remove_if(instr_ptrs.begin(), instr_ptrs.end(), [&reduced](auto& instr_ptr) {
+                return reduced.count(instr_ptr) > 0;
+            }), instr_ptrs.end());
+        }
+    }
+
+    // an address reduced in an inner loop may be the base of one reduced in an outer loop
+    void apply_replaced() {
+        auto resolve = [this](Operand op) {
+            while (op.is_name() && replaced.count(op.get_name())) {
+                op = replaced.at(op.get_name());
+            }
+            return op;
+        };
+        for (auto block_ptr : func.get_blocks()) {
+            std::vector<Instruction*> instrs;
+            for (auto& instr_ptr : block_ptr->instruction_lists) {
+                instrs.push_back(instr_ptr);
+            }
+            if (block_ptr->ending_instruction != nullptr) {
+                instrs.push_back(block_ptr->ending_instruction);
+            }
+            for (auto instr : instrs) {
+                for (auto op : {&instr->t0, &instr->t1, &instr->t2}) {
+                    if (op->has_value()) {
+                        *op = resolve(op->value());
+                    }
+                }
+                if (instr->param_list.has_value()) {
+                    for (auto& arg : instr->param_list.value()) {
+                        arg = resolve(arg);
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif //COMPILER_STRENGTH_REDUCTION_H
@@ -0,0 +1,164 @@
+#ifndef COMPILER_SYMBOL_H
+#define COMPILER_SYMBOL_H
+
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include "output_writer.h"
+
+
+/* A name, interned: e.g. the identifiers of SysY and the @x_0, %while_entry_5 or @main of the IR.
+ * It is one integer, copied, compared and hashed as such, with the text kept once in the interner.
+ * The temporaries %0, %1, ... are not interned at all, their number being the symbol itself, so
+ *     Symbol::temp(3) == Symbol("%3")
+ * The text is put together only when it is printed, or asked for by str().
+ */
+class Symbol {
+public:
+    Symbol(): id(0) { }  // the empty name
+
+    Symbol(std::string_view name) {
+        if (name.size() > 1 && name[0] == '%' && (name[1] != '0' || name.size() == 2)) {
+            int index = -1;
+            auto [ptr, ec] = std::from_chars(name.data() + 1, name.data() + name.size(), index);
+            if (ec == std::errc() && ptr == name.data() + name.size() && index >= 0) {
+                id = uint32_t(index) << 1 | 1;
+                return;
+            }
+        }
+        id = get_interner().intern(name) << 1;
+    }
+
+    Symbol(const std::string& name): Symbol(std::string_view(name)) { }
+
+    Symbol(const char* name): Symbol(std::string_view(name)) { }
+
+    // %index
+    static Symbol temp(int index) {
+        Symbol sym;
+        sym.id = uint32_t(index) << 1 | 1;
+        return sym;
+    }
+
+    bool empty() const {
+        return id == 0;
+    }
+
+    bool is_temp() const {
+        return (id & 1) != 0;
+    }
+
+    // e.g. '@' for the globals, '%' for the temporaries and the blocks
+    char front() const {
+        if (is_temp()) {
+            return '%';
+        }
+        const std::string& name = get_interner().names[id >> 1];
+        return name.empty() ? '\0' : name[0];
+    }
+
+    // e.g. Symbol("%entry").suffixed(1) is %entry_1
+    Symbol suffixed(size_t n) const {
+        std::string& buffer = get_buffer();
+        buffer.clear();
+        append_to(buffer);
+        buffer += '_';
+        buffer += std::to_string(n);
+        return Symbol(std::string_view(buffer));
+    }
+
+    // e.g. Symbol("x_0").prefixed("@") is @x_0
+    Symbol prefixed(std::string_view prefix) const {
+        std::string& buffer = get_buffer();
+        buffer.assign(prefix);
+        append_to(buffer);
+        return Symbol(std::string_view(buffer));
+    }
+
+    std::string str() const {
+        std::string text;
+        append_to(text);
+        return text;
+    }
+
+    size_t hash() const {
+        return std::hash<uint32_t>()(id);
+    }
+
+    bool operator==(const Symbol& other) const {
+        return id == other.id;
+    }
+
+    bool operator!=(const Symbol& other) const {
+        return id != other.id;
+    }
+
+    // a fixed order, not that of the text: the temporaries by their numbers, the names as interned
+    bool operator<(const Symbol& other) const {
+        return id < other.id;
+    }
+
+    friend OutputWriter& operator<<(OutputWriter& out, const Symbol& sym) {
+        if (sym.is_temp()) {
+            return out << '%' << (sym.id >> 1);
+        }
+        return out << get_interner().names[sym.id >> 1];
+    }
+
+private:
+    uint32_t id;  // index << 1 for an interned name, number << 1 | 1 for a temporary
+
+    class Interner {
+    public:
+        std::deque<std::string> names{""};
+        std::unordered_map<std::string_view, uint32_t> indices{{names[0], 0}};
+
+        uint32_t intern(std::string_view name) {
+            auto it = indices.find(name);
+            if (it != indices.end()) {
+                return it->second;
+            }
+            names.emplace_back(name);
+            indices.emplace(names.back(), uint32_t(names.size() - 1));
+            return uint32_t(names.size() - 1);
+        }
+    };
+
+    void append_to(std::string& text) const {
+        if (is_temp()) {
+            text += '%';
+            text += std::to_string(id >> 1);
+        } else {
+            text += get_interner().names[id >> 1];
+        }
+    }
+
+    // where suffixed() and prefixed() put the text together, reused so that a name already interned costs nothing
+    static std::string& get_buffer() {
+        static std::string buffer;
+        return buffer;
+    }
+
+    // constructed on first use, since the symbols of the library functions are made during static initialization
+    static Interner& get_interner() {
+        static Interner interner;
+        return interner;
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<Symbol> {
+        size_t operator()(const Symbol& sym) const {
+            return sym.hash();
+        }
+    };
+}
+
+#endif //COMPILER_SYMBOL_H
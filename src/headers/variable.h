@@ -11,13 +11,13 @@
 class Variable {
 public:
     OperandType type;
-    std::string koopa_var_name;
+    Symbol koopa_var_name;
     bool is_const;
     std::optional<int> const_val;
     std::optional<std::shared_ptr<Array> > const_array;
     Variable(OperandType _type,
              bool _is_const,
-             std::string _koopa_var_name,
+             Symbol _koopa_var_name,
              std::optional<int> _const_val = std::nullopt,
              std::optional<std::shared_ptr<Array> > _const_array = std::nullopt) {
         type = _type;
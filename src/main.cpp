@@ -11,6 +11,7 @@
 #include "headers/ast.h"
 #include "headers/riscv/visit_raw_program.h"
 #include "headers/riscv/register.h"
+#include "headers/riscv/raw_program_builder.h"
 
 using namespace std;
 
@@ -25,47 +26,69 @@ Scope BaseAST::scope = Scope();
 
 int main(int argc, const char *argv[]) {
     // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-    // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
+    // compiler 模式 输入文件 -o 输出文件 [选项...]
+    assert(argc >= 5);
     auto mode = argv[1];
     auto input = argv[2];
     auto output = argv[4];
+    bool stream = false;
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "-frame-report") == 0) {
+            // 在标准错误中输出每个函数共用栈 slot 前后的栈帧大小
+            frame_size_report = &cerr;
+        } else if (strcmp(argv[i], "-stream") == 0) {
+            // 逐个顶层的声明或函数生成并输出代码, 输出后即释放其 AST 和 IR, 只保留全局符号和函数签名,
+            // 内存占用不随输入的大小增长; 代价是不做函数内联, 也不把从未被 store 的全局变量视为常量
+            stream = true;
+        }
+    }
 
     // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
     yyin = fopen(input, "r");
     assert(yyin);
 
+    ofstream outfile;
+    if (strcmp(mode, "-debug") != 0) {
+        outfile.open(output, fstream::out | fstream::trunc);
+    }
+    // -koopa 和 -riscv 共用, 整块写出而不是每行刷新一次
+    OutputWriter writer(outfile);
+    RawProgramBuilder builder(BaseAST::scope.lib_func_signatures);
+    RegisterAllocator reg_alloc;
+    if (stream && strcmp(mode, "-koopa") == 0) {
+        BaseAST::scope.DumpStdlibSignatures(writer);
+        CompUnitItemListAST::stream_item = [&writer](BaseAST* item) {
+            writer << CompUnitAST::DumpItem(*item);
+        };
+    } else if (stream && strcmp(mode, "-riscv") == 0) {
+        CompUnitItemListAST::stream_item = [&](BaseAST* item) {
+            Visit(builder.build(CompUnitAST::DumpItem(*item)), reg_alloc, writer, false);
+        };
+    }
+
     // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
     unique_ptr<BaseAST> ast;
     auto ret = yyparse(ast);
     assert(!ret);
 
-    if (strcmp(mode, "-debug") == 0) {
+    if (CompUnitItemListAST::stream_item) {
+        // 已在解析的同时输出
+    } else if (strcmp(mode, "-debug") == 0) {
         ast->Dump();
-    } else if (strcmp(mode, "-koopa") == 0) {
-        ofstream outfile;
-        outfile.open(output, fstream::out | fstream::trunc);
-        ast->Dump(outfile);
-        outfile.close();
-    } else if (strcmp(mode, "-riscv") == 0) {
-        ostringstream out_string_stream;
-        ast->Dump(out_string_stream);
-        string koopa_str = out_string_stream.str();
-
-        koopa_program_t program;
-        koopa_error_code_t ret = koopa_parse_from_string(koopa_str.c_str(), &program);
-        assert(ret == KOOPA_EC_SUCCESS);
-        koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-        koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-        koopa_delete_program(program);
-        ofstream outfile;
-        outfile.open(output, fstream::out | fstream::trunc);
-        RegisterAllocator reg_alloc;
-
-        Visit(raw, reg_alloc, outfile);
-
-        outfile.close();
-        koopa_delete_raw_program_builder(builder);
+    } else {
+        Program& program = ast->DumpProgram();
+        // 生成 IR 之后 AST 就不再需要了, 整体释放
+        ast.reset();
+        ast_arena.release();
+        if (strcmp(mode, "-koopa") == 0) {
+            BaseAST::scope.DumpStdlibSignatures(writer);
+            writer << program;
+        } else if (strcmp(mode, "-riscv") == 0) {
+            // 直接由优化后的 IR 构建 raw program, 不再输出 Koopa 文本后重新解析
+            Visit(builder.build(program), reg_alloc, writer);
+        }
     }
+    writer.flush();
+    outfile.close();
     return 0;
 }
@@ -0,0 +1,8 @@
+#!/bin/bash
+# usage: rodata_init_template.sh <compiler>
+# The template of the array initializer in rodata_init_template.sy must be put in .rodata.
+dir=$(dirname "$0")
+out=$(mktemp)
+trap 'rm -f "$out"' EXIT
+"$1" -riscv "$dir/rodata_init_template.sy" -o "$out" || exit 1
+grep -q "^  \.section \.rodata$" "$out" || { echo "rodata_init_template: no .rodata section"; exit 1; }